@@ -0,0 +1,92 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "benchmark.hpp"
+
+namespace
+{
+    std::atomic<uint64_t> allocations(0);
+    std::string filter;
+
+    void *counted_allocate(size_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        void *memory = malloc(size == 0 ? 1 : size);
+        if (memory == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+}
+
+// Every allocation of the executable and of the sdk goes through these
+void *operator new(size_t size)
+{
+    return counted_allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return counted_allocate(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+namespace transbot_benchmark
+{
+    uint64_t allocation_count()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+    void set_filter(const std::string &pattern)
+    {
+        filter = pattern;
+    }
+
+    bool is_selected(const std::string &name)
+    {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    void report(const std::string &name, uint64_t operations, std::chrono::nanoseconds elapsed, uint64_t allocations)
+    {
+        double operations_count = operations == 0 ? 1.0 : static_cast<double>(operations);
+        printf("%-52s %12llu ops %12.1f ns/op %10.3f allocs/op\n", name.c_str(),
+               static_cast<unsigned long long>(operations), elapsed.count() / operations_count,
+               allocations / operations_count);
+        fflush(stdout);
+    }
+} // transbot_benchmark
@@ -0,0 +1,119 @@
+#ifndef TRANSBOT_SDK_BENCHMARK_HPP
+#define TRANSBOT_SDK_BENCHMARK_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Minimal benchmark harness of the sdk, reporting time and heap allocations per operation
+ * @details Allocations are counted by replacing the global operator new of the benchmark executable, which also
+ * counts those of the sdk library and of threads started by a benchmark.
+ */
+namespace transbot_benchmark
+{
+    /**
+     * @brief Get the number of calls of operator new so far, in every thread
+     * @return Number of allocations
+     */
+    uint64_t allocation_count();
+
+    /**
+     * @brief Only run the benchmarks whose name contains a pattern
+     * @param pattern Part of the names, empty for all
+     */
+    void set_filter(const std::string &pattern);
+
+    /**
+     * @brief Decide whether a benchmark is selected by the filter
+     * @param name Name of the benchmark
+     * @return true if the benchmark should run
+     */
+    bool is_selected(const std::string &name);
+
+    /**
+     * @brief Print the result of a benchmark
+     * @param name Name of the benchmark
+     * @param operations Number of operations measured
+     * @param elapsed Time the operations took
+     * @param allocations Allocations made by the operations
+     */
+    void report(const std::string &name, uint64_t operations, std::chrono::nanoseconds elapsed, uint64_t allocations);
+
+    /**
+     * @brief Keep the compiler from optimizing away a value computed by a benchmark
+     * @param value The value
+     */
+    template<class T>
+    inline void do_not_optimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    //! time a benchmark runs at least, after its number of iterations has been calibrated
+    const std::chrono::milliseconds MIN_TIME(200);
+
+    /**
+     * @brief Run an operation often enough to measure it and report the time and allocations per operation
+     * @param name Name of the benchmark
+     * @param operation Called once per iteration
+     * @param operations_per_call Number of operations one call performs, e.g. frames in a parsed stream
+     */
+    template<class Operation>
+    void run(const std::string &name, Operation operation, uint64_t operations_per_call = 1)
+    {
+        if (!is_selected(name))
+        {
+            return;
+        }
+        // Double the iterations until they take long enough, then measure once more for the report
+        uint64_t iterations = 1;
+        while (true)
+        {
+            uint64_t allocations = allocation_count();
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++)
+            {
+                operation();
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            allocations = allocation_count() - allocations;
+            if (elapsed >= MIN_TIME || iterations >= (1ULL << 40))
+            {
+                report(name, iterations * operations_per_call,
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed), allocations);
+                return;
+            }
+            iterations *= elapsed * 8 < MIN_TIME ? 8 : 2;
+        }
+    }
+
+    /**
+     * @brief Run a body performing a fixed number of operations, e.g. spread over threads, and report per operation
+     * @param name Name of the benchmark
+     * @param operations Number of operations the body performs
+     * @param body Called once
+     */
+    template<class Body>
+    void run_batch(const std::string &name, uint64_t operations, Body body)
+    {
+        if (!is_selected(name))
+        {
+            return;
+        }
+        uint64_t allocations = allocation_count();
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        report(name, operations, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed),
+               allocation_count() - allocations);
+    }
+
+    /**
+     * @brief Run the microbenchmarks of Package, the buffers, the memory pool, the latency histogram, the frame parser
+     * and the codec
+     */
+    void run_protocol_benchmarks();
+} // transbot_benchmark
+
+#endif // TRANSBOT_SDK_BENCHMARK_HPP
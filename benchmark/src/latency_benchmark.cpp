@@ -0,0 +1,351 @@
+#include <glog/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "transbot_sdk/transbot_sdk.hpp"
+#include "hardware/firmware_emulator.hpp"
+
+/**
+ * End-to-end latency of the public Transbot API against FirmwareEmulator on a pseudo-terminal.
+ *
+ * Command threads call set_chassis_motion() at a fixed rate each, and the latency of a command is measured from the
+ * call to the moment the emulator read its bytes from the pty, i.e. after they left the fd of the SDK. Every command
+ * is tagged with its thread in the linear velocity and its sequence number in the angular velocity, so the emulator
+ * can tell which call a frame belongs to. Query threads time get_servo_position() from the call to the return of the
+ * response.
+ */
+namespace
+{
+    using clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        double duration = 5.0;
+        int command_threads = 1;
+        //! commands per second of each command thread, 0 for as fast as possible
+        double command_rate = 100.0;
+        int query_threads = 1;
+        //! queries per second of each query thread, 0 for as fast as possible
+        double query_rate = 50.0;
+        //! MOTION_STATUS reports per second of the emulator, as background traffic
+        double report_rate = 20.0;
+    };
+
+    //! distinct sequence tags in the angular velocity, 0.005 to 1.995 rad/s
+    const int SEQUENCE_TAGS = 200;
+    //! distinct thread tags in the linear velocity, 0.005 to 0.445 m/s
+    const int MAX_COMMAND_THREADS = 45;
+    //! commands issued per thread are bounded, so that the send times fit into memory allocated up front
+    const uint64_t MAX_COMMANDS_PER_THREAD = 1 << 20;
+
+    /**
+     * @brief Send times of the commands of one thread and the matching of the frames the emulator received
+     */
+    struct CommandThread
+    {
+        std::unique_ptr<std::atomic<int64_t>[]> sent_at;
+        std::atomic<uint64_t> issued{0};
+        //! only touched by the firmware thread of the emulator
+        uint64_t next_expected = 0;
+        std::vector<int64_t> latencies;
+    };
+
+    int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    }
+
+    void print_usage(const char *name)
+    {
+        printf("Usage: %s [--duration s] [--command-threads n] [--command-rate hz] [--query-threads n]\n"
+               "       [--query-rate hz] [--report-rate hz]\n"
+               "A rate of 0 runs the threads as fast as possible.\n", name);
+    }
+
+    bool parse_options(int argc, char *argv[], Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            std::string option = argv[i];
+            double value = strtod(argv[++i], nullptr);
+            if (value < 0)
+            {
+                return false;
+            }
+            if (option == "--duration")
+            {
+                options.duration = value;
+            }
+            else if (option == "--command-threads")
+            {
+                options.command_threads = static_cast<int>(value);
+            }
+            else if (option == "--command-rate")
+            {
+                options.command_rate = value;
+            }
+            else if (option == "--query-threads")
+            {
+                options.query_threads = static_cast<int>(value);
+            }
+            else if (option == "--query-rate")
+            {
+                options.query_rate = value;
+            }
+            else if (option == "--report-rate")
+            {
+                options.report_rate = value;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return options.command_threads <= MAX_COMMAND_THREADS;
+    }
+
+    /**
+     * @brief Print p50, p99, p99.9 and the maximum of latency samples
+     * @param name Name of the measurement
+     * @param samples Latencies in ns, sorted in place
+     */
+    void report_latency(const char *name, std::vector<int64_t> &samples)
+    {
+        if (samples.empty())
+        {
+            printf("%-28s no samples\n", name);
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&samples](double p)
+        {
+            size_t rank = static_cast<size_t>(std::ceil(p * samples.size()));
+            return samples[rank == 0 ? 0 : rank - 1] / 1000.0;
+        };
+        printf("%-28s %10zu samples  p50 %10.1f us  p99 %10.1f us  p99.9 %10.1f us  max %10.1f us\n", name,
+               samples.size(), percentile(0.5), percentile(0.99), percentile(0.999), samples.back() / 1000.0);
+    }
+
+    /**
+     * @brief Sleep until the next period of a thread running at a fixed rate, without catching up after a stall
+     * @param next Start of the next period, advanced by the period
+     * @param period Period of the thread, 0 to return at once
+     */
+    void wait_for_period(clock::time_point &next, clock::duration period)
+    {
+        if (period == clock::duration::zero())
+        {
+            return;
+        }
+        next += period;
+        auto now = clock::now();
+        if (next > now)
+        {
+            std::this_thread::sleep_until(next);
+        }
+        else
+        {
+            next = now;
+        }
+    }
+
+    clock::duration period_of(double rate)
+    {
+        if (rate <= 0)
+        {
+            return clock::duration::zero();
+        }
+        return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / rate));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FLAGS_logtostderr = true;
+    // Errors only, so that the results are not drowned in the log of the sdk
+    FLAGS_minloglevel = 2;
+    google::InitGoogleLogging(argv[0]);
+
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<CommandThread> commands(options.command_threads);
+    uint64_t max_commands = options.command_rate > 0
+                            ? std::min<uint64_t>(MAX_COMMANDS_PER_THREAD,
+                                                 static_cast<uint64_t>(options.command_rate * options.duration) + 1)
+                            : MAX_COMMANDS_PER_THREAD;
+    for (auto &command: commands)
+    {
+        command.sent_at.reset(new std::atomic<int64_t>[max_commands]);
+        command.latencies.reserve(max_commands);
+    }
+    std::atomic<uint64_t> received_commands(0);
+    std::atomic<int64_t> last_command_at(0);
+
+    auto emulator = std::make_shared<transbot_sdk::FirmwareEmulator>(options.report_rate);
+    emulator->set_frame_observer([&](const uint8_t *frame, clock::time_point received_at)
+                                 {
+                                     if (frame[3] != transbot_sdk::SET_CHASSIS_MOTION)
+                                     {
+                                         return;
+                                     }
+                                     auto motion = reinterpret_cast<const transbot_sdk::Move_Control *>(frame + 4);
+                                     int thread = motion->linear_velocity;
+                                     int tag = motion->angular_velocity;
+                                     if (thread < 0 || thread >= options.command_threads)
+                                     {
+                                         return;
+                                     }
+                                     auto &command = commands[thread];
+                                     // Frames of one thread arrive in order, skip the sequence numbers of lost ones
+                                     uint64_t issued = command.issued.load(std::memory_order_acquire);
+                                     uint64_t sequence = command.next_expected;
+                                     while (sequence < issued && static_cast<int>(sequence % SEQUENCE_TAGS) != tag)
+                                     {
+                                         sequence++;
+                                     }
+                                     if (sequence >= issued)
+                                     {
+                                         return;
+                                     }
+                                     int64_t at = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             received_at.time_since_epoch()).count();
+                                     command.latencies.push_back(
+                                             at - command.sent_at[sequence].load(std::memory_order_relaxed));
+                                     command.next_expected = sequence + 1;
+                                     received_commands.fetch_add(1, std::memory_order_relaxed);
+                                     last_command_at.store(at, std::memory_order_relaxed);
+                                 });
+
+    transbot_sdk::Transbot sdk(emulator);
+    if (!sdk.init())
+    {
+        fprintf(stderr, "Initialize the sdk on the firmware emulator failed.\n");
+        return 1;
+    }
+
+    printf("%d command threads at %s, %d query threads at %s, %.1f s\n", options.command_threads,
+           options.command_rate > 0 ? (std::to_string(options.command_rate) + " Hz").c_str() : "full speed",
+           options.query_threads,
+           options.query_rate > 0 ? (std::to_string(options.query_rate) + " Hz").c_str() : "full speed",
+           options.duration);
+    fflush(stdout);
+
+    std::atomic<bool> is_running(true);
+    std::vector<std::vector<int64_t>> query_latencies(options.query_threads);
+    std::atomic<uint64_t> failed_queries(0);
+    std::vector<std::thread> threads;
+    auto start = clock::now();
+    auto deadline = start + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(options.duration));
+
+    for (int thread = 0; thread < options.command_threads; thread++)
+    {
+        threads.emplace_back([&, thread]
+                             {
+                                 auto &command = commands[thread];
+                                 auto period = period_of(options.command_rate);
+                                 auto next = clock::now();
+                                 double linear = (thread + 0.5) / 100.0;
+                                 for (uint64_t sequence = 0; sequence < max_commands && is_running; sequence++)
+                                 {
+                                     double angular = (sequence % SEQUENCE_TAGS + 0.5) / 100.0;
+                                     command.sent_at[sequence].store(now_ns(), std::memory_order_relaxed);
+                                     command.issued.store(sequence + 1, std::memory_order_release);
+                                     sdk.set_chassis_motion(linear, angular);
+                                     wait_for_period(next, period);
+                                 }
+                             });
+    }
+    for (int thread = 0; thread < options.query_threads; thread++)
+    {
+        threads.emplace_back([&, thread]
+                             {
+                                 auto &latencies = query_latencies[thread];
+                                 auto period = period_of(options.query_rate);
+                                 auto next = clock::now();
+                                 while (is_running)
+                                 {
+                                     int64_t called_at = now_ns();
+                                     if (sdk.get_servo_position(7 + thread % 3) < 0)
+                                     {
+                                         failed_queries++;
+                                     }
+                                     else
+                                     {
+                                         latencies.push_back(now_ns() - called_at);
+                                     }
+                                     wait_for_period(next, period);
+                                 }
+                             });
+    }
+
+    std::this_thread::sleep_until(deadline);
+    is_running = false;
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+    auto stopped_at = clock::now();
+    // Let the transmit queue drain, until no command arrived for a while
+    auto drain_deadline = stopped_at + std::chrono::seconds(5);
+    uint64_t issued = 0;
+    for (auto &command: commands)
+    {
+        issued += command.issued;
+    }
+    while (received_commands < issued && clock::now() < drain_deadline)
+    {
+        uint64_t received = received_commands;
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        if (received == received_commands && received > 0)
+        {
+            break;
+        }
+    }
+    emulator->stop();
+
+    std::vector<int64_t> command_latencies;
+    for (auto &command: commands)
+    {
+        command_latencies.insert(command_latencies.end(), command.latencies.begin(), command.latencies.end());
+    }
+    std::vector<int64_t> all_query_latencies;
+    for (auto &latencies: query_latencies)
+    {
+        all_query_latencies.insert(all_query_latencies.end(), latencies.begin(), latencies.end());
+    }
+
+    report_latency("set_chassis_motion", command_latencies);
+    report_latency("get_servo_position", all_query_latencies);
+
+    double elapsed = std::chrono::duration<double>(stopped_at - start).count();
+    uint64_t received = received_commands;
+    // Throughput on the wire, from the first call to the last command the emulator received
+    double wire_time = received > 0
+                       ? (last_command_at - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            start.time_since_epoch()).count()) / 1e9
+                       : elapsed;
+    printf("commands issued %llu (%.1f/s), received %llu (%.1f/s), lost %llu\n",
+           static_cast<unsigned long long>(issued), issued / elapsed, static_cast<unsigned long long>(received),
+           received / wire_time, static_cast<unsigned long long>(issued - received));
+    printf("queries answered %zu (%.1f/s), failed %llu\n", all_query_latencies.size(),
+           all_query_latencies.size() / elapsed, static_cast<unsigned long long>(failed_queries.load()));
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include <glog/logging.h>
+#include "benchmark.hpp"
+
+/**
+ * Usage: transbot_benchmarks [pattern]
+ * Runs the benchmarks whose name contains pattern, or all of them.
+ */
+int main(int argc, char *argv[])
+{
+    FLAGS_logtostderr = true;
+    // Errors only, so that the results are not drowned in the log of the sdk
+    FLAGS_minloglevel = 2;
+    google::InitGoogleLogging(argv[0]);
+    if (argc > 1)
+    {
+        transbot_benchmark::set_filter(argv[1]);
+    }
+
+    transbot_benchmark::run_protocol_benchmarks();
+    return 0;
+}
@@ -0,0 +1,409 @@
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include "benchmark.hpp"
+#include "protocol/circular_buffer.hpp"
+#include "protocol/codec.hpp"
+#include "protocol/frame_parser.hpp"
+#include "protocol/latency_histogram.hpp"
+#include "protocol/memory_pool.hpp"
+#include "protocol/mpsc_queue.hpp"
+#include "protocol/package.hpp"
+
+using namespace transbot_sdk;
+
+namespace transbot_benchmark
+{
+    namespace
+    {
+        /**
+         * @brief Build the frame the firmware sends for a receive message
+         * @param message The parameters of the frame
+         * @return The frame, including header and checksum
+         */
+        template<class Message>
+        std::vector<uint8_t> receive_frame(const Message &message)
+        {
+            std::vector<uint8_t> frame = {0xFF, RECEIVE, static_cast<uint8_t>(sizeof(Message) + 3), Message::FUNCTION};
+            auto payload = reinterpret_cast<const uint8_t *>(&message);
+            frame.insert(frame.end(), payload, payload + sizeof(Message));
+            uint8_t checksum = 0;
+            for (size_t i = 2; i < frame.size(); i++)
+            {
+                checksum += frame[i];
+            }
+            frame.push_back(checksum);
+            return frame;
+        }
+
+        Movement_Status_Response motion_status()
+        {
+            Movement_Status_Response status{};
+            status.linear_velocity = 30;
+            status.angular_velocity = -120;
+            status.acceleration[2] = 16384;
+            status.gyro[0] = 12;
+            status.battery_voltage = 118;
+            return status;
+        }
+
+        template<class Message>
+        void benchmark_encode(const char *name, const Message &message)
+        {
+            run(std::string("codec/encode/") + name, [&message]
+            {
+                Package package = encode(message);
+                do_not_optimize(package);
+            });
+        }
+
+        template<class Message>
+        void benchmark_decode(const char *name, const Message &message)
+        {
+            Package package(Message::FUNCTION);
+            package.set_data(receive_frame(message).data());
+            run(std::string("codec/decode/") + name, [&package]
+            {
+                const Message *decoded = decode<Message>(package);
+                do_not_optimize(decoded);
+            });
+        }
+
+        void package_benchmarks()
+        {
+            auto frame = receive_frame(motion_status());
+            run("package/construct_set_data", [&frame]
+            {
+                Package package(MOTION_STATUS);
+                package.set_data(frame.data());
+                do_not_optimize(package);
+            });
+
+            Move_Control move_control(30, -120);
+            run("package/construct_set_payload_checksum", [&move_control]
+            {
+                Package package(SET_CHASSIS_MOTION);
+                package.set_payload(&move_control, sizeof(move_control));
+                do_not_optimize(package);
+            });
+
+            Package source(MOTION_STATUS);
+            source.set_data(frame.data());
+            run("package/copy", [&source]
+            {
+                Package package = source;
+                do_not_optimize(package);
+            });
+        }
+
+        void buffer_benchmarks()
+        {
+            auto frame = receive_frame(motion_status());
+            Package package(MOTION_STATUS);
+            package.set_data(frame.data());
+
+            CircularBuffer<Package> single_consumer(64);
+            run("circular_buffer/push_pop", [&]
+            {
+                Package item;
+                single_consumer.push(package);
+                single_consumer.try_pop(item);
+                do_not_optimize(item);
+            });
+
+            CircularBuffer<Package, true> multi_consumer(64);
+            run("circular_buffer/push_pop_multi_consumer", [&]
+            {
+                Package item;
+                multi_consumer.push(package);
+                multi_consumer.try_pop(item);
+                do_not_optimize(item);
+            });
+
+            // Like the receive buffers: the receive thread pushes, getters on other threads take. Threads yield when the
+            // buffer is full or empty, so that the benchmark also finishes on a single core.
+            const uint64_t items = 2000000;
+            for (int consumers: {1, 2, 4})
+            {
+                CircularBuffer<Package, true> contended(64, false);
+                run_batch("circular_buffer/contended_1p_" + std::to_string(consumers) + "c", items, [&]
+                {
+                    std::atomic<uint64_t> taken(0);
+                    std::vector<std::thread> threads;
+                    for (int i = 0; i < consumers; i++)
+                    {
+                        threads.emplace_back([&]
+                        {
+                            Package item;
+                            while (taken.load(std::memory_order_relaxed) < items)
+                            {
+                                if (contended.try_pop(item))
+                                {
+                                    taken.fetch_add(1, std::memory_order_relaxed);
+                                }
+                                else
+                                {
+                                    std::this_thread::yield();
+                                }
+                            }
+                        });
+                    }
+                    for (uint64_t i = 0; i < items; i++)
+                    {
+                        while (!contended.push(package))
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                    for (auto &thread: threads)
+                    {
+                        thread.join();
+                    }
+                });
+            }
+
+            // Like the transmit queue: commands from several threads, one transmit thread
+            for (int producers: {1, 2, 4})
+            {
+                MpscQueue<Package> queue(64);
+                run_batch("mpsc_queue/contended_" + std::to_string(producers) + "p_1c", items, [&]
+                {
+                    std::vector<std::thread> threads;
+                    for (int i = 0; i < producers; i++)
+                    {
+                        threads.emplace_back([&]
+                        {
+                            for (uint64_t j = 0; j < items / producers; j++)
+                            {
+                                while (!queue.try_push(package))
+                                {
+                                    std::this_thread::yield();
+                                }
+                            }
+                        });
+                    }
+                    Package item;
+                    for (uint64_t taken = 0; taken < items / producers * producers;)
+                    {
+                        if (queue.try_pop(item))
+                        {
+                            taken++;
+                        }
+                        else
+                        {
+                            std::this_thread::yield();
+                        }
+                    }
+                    for (auto &thread: threads)
+                    {
+                        thread.join();
+                    }
+                });
+            }
+        }
+
+        void memory_pool_benchmarks()
+        {
+            MemoryPool pool(1024, 1 << 20, 4096);
+            run("memory_pool/alloc_free", [&pool]
+            {
+                MemoryBlock *block = pool.alloc(96);
+                do_not_optimize(block);
+                pool.free(block);
+            });
+
+            // Fragment the pool: blocks of mixed sizes, half of them freed in random order
+            std::mt19937 random(42);
+            std::uniform_int_distribution<size_t> size_of(1, 512);
+            const size_t held_count = 1024;
+            std::vector<MemoryBlock *> held(held_count, nullptr);
+            for (auto &block: held)
+            {
+                block = pool.alloc(size_of(random));
+            }
+            for (size_t i = 0; i < held_count; i += 2)
+            {
+                pool.free(held[i]);
+                held[i] = nullptr;
+            }
+            // Draw the random numbers up front, so that the loop measures the pool only
+            const size_t pattern_length = 4096;
+            std::vector<size_t> sizes(pattern_length);
+            std::vector<size_t> slots(pattern_length);
+            for (size_t i = 0; i < pattern_length; i++)
+            {
+                sizes[i] = size_of(random);
+                slots[i] = random() % held_count;
+            }
+            size_t step = 0;
+            run("memory_pool/free_alloc_fragmented", [&]
+            {
+                size_t index = step++ & (pattern_length - 1);
+                MemoryBlock *&block = held[slots[index]];
+                pool.free(block);
+                block = pool.alloc(sizes[index]);
+                do_not_optimize(block);
+            });
+            run("memory_pool/allocate_deallocate_pointer", [&pool]
+            {
+                void *memory = pool.allocate(200);
+                do_not_optimize(memory);
+                pool.deallocate(memory);
+            });
+            for (auto block: held)
+            {
+                pool.free(block);
+            }
+        }
+
+        void latency_histogram_benchmarks()
+        {
+            LatencyHistogram histogram;
+            uint64_t latency = 0;
+            run("latency_histogram/record", [&]
+            {
+                // Spread over the buckets of microseconds to milliseconds
+                latency = (latency + 7919) & 0xFFFFF;
+                histogram.record(std::chrono::nanoseconds(latency));
+            });
+            run("latency_histogram/get_stats", [&histogram]
+            {
+                do_not_optimize(histogram.get_stats());
+            });
+        }
+
+        /**
+         * @brief Parse a stream in reads of a fixed size, like the receive thread does
+         * @param parser The parser
+         * @param stream The bytes
+         * @param read_size Bytes per read
+         * @return Number of frames parsed
+         */
+        size_t parse_stream(FrameParser &parser, const std::vector<uint8_t> &stream, size_t read_size)
+        {
+            size_t frames = 0;
+            for (size_t offset = 0; offset < stream.size();)
+            {
+                uint8_t *staging = parser.write_ptr();
+                size_t length = std::min(std::min(read_size, parser.writable()), stream.size() - offset);
+                memcpy(staging, stream.data() + offset, length);
+                parser.commit(length);
+                offset += length;
+
+                const uint8_t *frame = nullptr;
+                uint8_t frame_length = 0;
+                while (parser.next_frame(frame, frame_length))
+                {
+                    do_not_optimize(frame);
+                    frames++;
+                }
+            }
+            return frames;
+        }
+
+        void frame_parser_benchmarks()
+        {
+            Yaw_Response yaw{};
+            yaw.yaw = 1800;
+            Servo_Position_Response servo_position{};
+            servo_position.servo_id = 7;
+            servo_position.position = 2000;
+            std::vector<std::vector<uint8_t>> frames = {receive_frame(motion_status()), receive_frame(yaw),
+                                                        receive_frame(servo_position)};
+
+            std::mt19937 random(7);
+            const size_t frame_count = 4096;
+            std::vector<uint8_t> clean;
+            std::vector<uint8_t> noisy;
+            for (size_t i = 0; i < frame_count; i++)
+            {
+                const auto &frame = frames[i % frames.size()];
+                clean.insert(clean.end(), frame.begin(), frame.end());
+                noisy.insert(noisy.end(), frame.begin(), frame.end());
+                if (i % 8 == 0)
+                {
+                    // A burst of garbage, with a header and a corrupted frame in it now and then
+                    for (int j = 0; j < 12; j++)
+                    {
+                        noisy.push_back(static_cast<uint8_t>(random()));
+                    }
+                    if (i % 32 == 0)
+                    {
+                        auto corrupted = frames[0];
+                        corrupted[6] ^= 0x40;
+                        noisy.insert(noisy.end(), corrupted.begin(), corrupted.end());
+                    }
+                }
+            }
+
+            // One operation is one frame, parsed out of reads of a fixed size
+            for (size_t read_size: {32, 512})
+            {
+                FrameParser clean_parser;
+                run("frame_parser/clean_stream_read_" + std::to_string(read_size), [&]
+                {
+                    do_not_optimize(parse_stream(clean_parser, clean, read_size));
+                }, frame_count);
+                FrameParser noisy_parser;
+                run("frame_parser/noisy_stream_read_" + std::to_string(read_size), [&]
+                {
+                    do_not_optimize(parse_stream(noisy_parser, noisy, read_size));
+                }, frame_count);
+            }
+        }
+
+        void codec_benchmarks()
+        {
+            benchmark_encode("PID_Adjust", PID_Adjust(1.5, 0.25, 2.0, 0));
+            benchmark_encode("Move_Control", Move_Control(30, -120));
+            benchmark_encode("PWM_Servo_Control", PWM_Servo_Control(1, 90));
+            benchmark_encode("RGB_Control", RGB_Control(0xFF, 255, 128, 0));
+            benchmark_encode("RGB_Effect", RGB_Effect(2, 5, 1));
+            benchmark_encode("Buzzer", Buzzer(10));
+            benchmark_encode("LED_Light", LED_Light(50));
+            benchmark_encode("Auto_Msg_Sending", Auto_Msg_Sending(1));
+            benchmark_encode("PWM_Velocity", PWM_Velocity(1, -50));
+            benchmark_encode("Min_Velocity_Limit", Min_Velocity_Limit(5, 10, 0));
+            benchmark_encode("Gyro_Direction", Gyro_Direction(1));
+            benchmark_encode("Forward", Forward(20));
+            benchmark_encode("Servo_Control", Servo_Control(7, 2000, 100));
+            benchmark_encode("Set_Servo_Bus_Id", Set_Servo_Bus_Id(7));
+            benchmark_encode("Enable_Servo_Torque", Enable_Servo_Torque(1));
+            benchmark_encode("Control_Arm_Joint_Position", Control_Arm_Joint_Position(2000, 2100, 2200));
+            benchmark_encode("Clear_Flash_Data", Clear_Flash_Data());
+            benchmark_encode("Read_Data_Request", Read_Data_Request(ARM_SERVO_POSITION, 7));
+
+            Firmware_Version_Response firmware_version{};
+            firmware_version.major = 1;
+            firmware_version.minor = 5;
+            benchmark_decode("Firmware_Version_Response", firmware_version);
+            Yaw_Response yaw{};
+            yaw.yaw = 1800;
+            benchmark_decode("Yaw_Response", yaw);
+            Servo_Position_Response servo_position{};
+            servo_position.servo_id = 7;
+            servo_position.position = 2000;
+            benchmark_decode("Servo_Position_Response", servo_position);
+            benchmark_decode("Movement_Status_Response", motion_status());
+            PID_Parameters_Response pid{};
+            pid.P = 1000;
+            pid.I = 100;
+            benchmark_decode("PID_Parameters_Response", pid);
+            Gyro_Assist_Response gyro_assist{};
+            gyro_assist.gyro_assist = 1;
+            benchmark_decode("Gyro_Assist_Response", gyro_assist);
+        }
+    }
+
+    void run_protocol_benchmarks()
+    {
+        package_benchmarks();
+        buffer_benchmarks();
+        memory_pool_benchmarks();
+        latency_histogram_benchmarks();
+        frame_parser_benchmarks();
+        codec_benchmarks();
+    }
+} // transbot_benchmark
@@ -1,6 +1,7 @@
 #ifndef TRANSBOT_SDK_DATA_HPP
 #define TRANSBOT_SDK_DATA_HPP
 
+#include <chrono>
 #include <cstdint>
 
 namespace transbot_sdk
@@ -30,6 +31,49 @@ namespace transbot_sdk
         _pid_parameters(double P, double I, double D) : P(P), I(I), D(D) {}
     } PID_Parameters;
 
+    typedef struct _rgb_color
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+        _rgb_color() : r(0), g(0), b(0) {}
+        _rgb_color(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+        bool operator==(const _rgb_color &other) const { return r == other.r && g == other.g && b == other.b; }
+        bool operator!=(const _rgb_color &other) const { return !(*this == other); }
+    } RGB_Color;
+
+    /**
+     * @brief A point of an arm trajectory, in the angles of set_all_arm_servo_angle()
+     */
+    typedef struct _arm_waypoint
+    {
+        //! time the arm reaches the point, in seconds from the start of the trajectory
+        double time;
+        //! 0-225
+        double joint1;
+        //! 30-270
+        double joint2;
+        //! 30-180
+        double joint3;
+        _arm_waypoint(double time, double joint1, double joint2, double joint3) : time(time), joint1(joint1),
+                                                                                  joint2(joint2), joint3(joint3) {}
+    } Arm_Waypoint;
+
+    /**
+     * @brief Latest value reported by the robot
+     * @tparam T Type of the value, e.g. Motion_Info
+     */
+    template<class T>
+    struct Telemetry
+    {
+        //! the value, zero if sequence is 0
+        T value;
+        //! number of reports of the value received so far, 0 if none has been received
+        uint64_t sequence;
+        //! time the report was read from the serial port
+        std::chrono::steady_clock::time_point received_at;
+    };
+
     enum TRANSBOT_ENABLE : uint8_t
     {
         DISABLE = 0x00,
@@ -54,5 +98,13 @@ namespace transbot_sdk
         JOINT2 = 0x08,
         JOINT3 = 0x09,
     };
+
+    enum TRANSBOT_ARM_INTERPOLATION : uint8_t
+    {
+        //! continuous velocity
+        CUBIC = 0x00,
+        //! continuous velocity and acceleration
+        QUINTIC = 0x01,
+    };
 }
 #endif // TRANSBOT_SDK_DATA_HPP
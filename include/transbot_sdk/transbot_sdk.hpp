@@ -1,13 +1,191 @@
 #ifndef TRANSBOT_TRANSBOT_SDK_HPP
 #define TRANSBOT_TRANSBOT_SDK_HPP
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <string>
+#include <vector>
 #include "data.hpp"
+#include "../src/protocol/codec.hpp"
 #include "../src/protocol/protocol.hpp"
+#include "../src/arm/arm_trajectory_executor.hpp"
+#include "../src/control/control_loop.hpp"
 #include "glog/logging.h"
 
 namespace transbot_sdk
 {
+    class Transbot;
+
+    /**
+     * @brief Commands sent to the robot together, e.g. all the leds of the strip or the arm and the camera at once
+     * @details Create a batch with Transbot::create_batch(), append commands and submit it with Transbot::submit().
+     * The frames are written back to back in a single write, only commands the firmware needs a longer time for, like
+     * those relayed to the servo bus, are followed by a pause. A batch can be submitted again and again. It refers to
+     * the Transbot which created it and must not outlive it.
+     */
+    class CommandBatch
+    {
+    public:
+        /**
+         * @brief Append any send message of the codec, e.g. RGB_Control
+         * @tparam Message Send message of the codec
+         * @param message The parameters of the command
+         */
+        template<class Message>
+        void add(const Message &message)
+        {
+            packages.push_back(encode(message));
+        }
+
+        /**
+         * @brief Append a chassis motion command, see Transbot::set_chassis_motion()
+         * @return false if the command is not appended
+         */
+        bool set_chassis_motion(double linear_velocity, double angular_velocity);
+
+        /**
+         * @brief Append a camara angle command, see Transbot::set_camara_angle()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_camara_angle(TRANSBOT_CAMARA_CHANNEL channel, int angle);
+
+        /**
+         * @brief Append a led strip command, see Transbot::set_led_strip()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_led_strip(int id, int r, int g, int b);
+
+        /**
+         * @brief Append a led strip effect command, see Transbot::set_strip_effect()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_strip_effect(int effect, int velocity, int param);
+
+        /**
+         * @brief Append a beep command, see Transbot::set_beep()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_beep(int duration);
+
+        /**
+         * @brief Append a lightness command, see Transbot::set_light()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_light(int lightness);
+
+        /**
+         * @brief Append a single arm servo command, see Transbot::set_single_arm_servo_angle()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed = 100);
+
+        /**
+         * @brief Append an arm command, see Transbot::set_all_arm_servo_angle()
+         * @return false if a parameter is out of range, the command is not appended then
+         */
+        bool set_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed);
+
+        /**
+         * @brief Get the number of commands appended
+         * @return Number of commands
+         */
+        size_t size() const;
+
+        /**
+         * @brief Remove every command, to build the next batch without allocating again
+         */
+        void clear();
+
+    private:
+        friend class Transbot;
+
+        explicit CommandBatch(Transbot &transbot);
+
+        Transbot &transbot;
+        std::vector<Package> packages;
+    };
+
+    /**
+     * @brief Local copy of the colors of the led strip, sent to the robot by present()
+     * @details Set the pixels as often as needed, present() then sends only what differs from what the strip shows:
+     * a frame per changed led, or a fill of the whole strip with its most common color followed by the leds of other
+     * colors, whichever takes fewer frames. The frames are written together like a CommandBatch, so a full refresh
+     * takes about 2 ms on the wire and effects can run at tens of frames per second. Get it by
+     * Transbot::led_framebuffer(). The pixels are not synchronized, use it from one thread at a time.
+     */
+    class LedFramebuffer
+    {
+    public:
+        //! number of leds of the strip
+        static const int LED_COUNT = 17;
+
+        /**
+         * @brief Set the color of a led, sent by the next present()
+         * @param id the id of the led, 0-16
+         * @param color The color
+         * @return false if the id is out of range
+         */
+        bool set_pixel(int id, RGB_Color color);
+
+        /**
+         * @brief Get the color of a led in the framebuffer
+         * @param id the id of the led, 0-16
+         * @return The color, black if the id is out of range
+         */
+        RGB_Color get_pixel(int id) const;
+
+        /**
+         * @brief Set every led to the same color, sent by the next present()
+         * @param color The color
+         */
+        void fill(RGB_Color color);
+
+        /**
+         * @brief Send the leds which differ from what the strip shows
+         * @return true if the strip shows the framebuffer now, false if the frames were not queued
+         */
+        bool present();
+
+        /**
+         * @brief Forget what the strip shows, the next present() sends the whole framebuffer
+         * @note Called by Transbot::set_led_strip(), set_strip_effect() and submit() of led commands, call it when the
+         * strip has been changed otherwise, e.g. after the robot restarted
+         */
+        void invalidate();
+
+        /**
+         * @brief Get the number of frames the next present() sends
+         * @return Number of frames, 0 if the strip shows the framebuffer already
+         */
+        size_t pending_frames() const;
+
+    private:
+        friend class Transbot;
+
+        explicit LedFramebuffer(Transbot &transbot);
+
+        /**
+         * @brief Find the cheapest way to show the framebuffer
+         * @param is_known Whether the strip shows the colors in shown
+         * @param is_filled Set if filling the strip first takes fewer frames than sending the changed leds
+         * @param fill Set to the color to fill the strip with
+         * @return Number of frames, including the fill
+         */
+        size_t plan(bool is_known, bool &is_filled, RGB_Color &fill) const;
+
+        Transbot &transbot;
+        RGB_Color pixels[LED_COUNT];
+        //! colors the strip shows, valid if shown_generation equals generation
+        RGB_Color shown[LED_COUNT];
+        //! incremented by invalidate(), which may be called from other threads
+        std::atomic<uint64_t> generation;
+        //! generation read before shown was last sent, an invalidate() during the send makes shown unknown again
+        uint64_t shown_generation;
+        //! frames of present(), kept to reuse their memory
+        std::vector<Package> packages;
+    };
+
     class Transbot
     {
     public:
@@ -17,6 +195,24 @@ namespace transbot_sdk
             // google::InitGoogleLogging("transbot_sdk");
         }
 
+        /**
+         * @brief Construct the sdk on a serial port other than /dev/ttyTHS1
+         * @param port_name Path of the serial port, e.g. the pty slave of FirmwareEmulator
+         * @param io_loop Loop receiving for several robots, see IoLoop, nullptr for a receive thread of its own
+         */
+        explicit Transbot(const std::string &port_name, std::shared_ptr<IoLoop> io_loop = nullptr)
+            : protocol(port_name, std::move(io_loop))
+        {}
+
+        /**
+         * @brief Construct the sdk on any hardware, e.g. FirmwareEmulator
+         * @param hardware Hardware to send and receive data
+         * @param io_loop Loop receiving for several robots, see IoLoop, nullptr for a receive thread of its own
+         */
+        explicit Transbot(std::shared_ptr<HardwareInterface> hardware, std::shared_ptr<IoLoop> io_loop = nullptr)
+            : protocol(std::move(hardware), std::move(io_loop))
+        {}
+
         ~Transbot() = default;
         /**
          * @brief Initialize the transbot sdk
@@ -24,6 +220,17 @@ namespace transbot_sdk
          */
         bool init();
 
+        /**
+         * @brief Record every frame sent to and received from the robot into a ring file, for post-mortem analysis
+         * @details The file is memory-mapped, so recording costs a memcpy per frame and the frames recorded survive a
+         * crash of the process. Read it back with FlightRecorder::load().
+         * @note Call this before init()
+         * @param path Path of the ring file, created if it does not exist, continued if it was recorded before
+         * @param frames Number of frames kept, the oldest are overwritten
+         * @return true if success
+         */
+        bool enable_flight_recorder(const std::string &path, size_t frames = 65536);
+
         /**
          * @brief Set the chassis motion
          * @param linear_velocity -45-45
@@ -31,6 +238,19 @@ namespace transbot_sdk
          */
         void set_chassis_motion(double linear_velocity, double angular_velocity);
 
+        /**
+         * @brief Create an empty batch of commands, see CommandBatch
+         * @return The batch
+         */
+        CommandBatch create_batch();
+
+        /**
+         * @brief Send the commands of a batch together, in the order they were appended
+         * @param batch The commands, at most Protocol::MAX_BATCH_SIZE
+         * @return true if every command is queued, nothing is sent otherwise
+         */
+        bool submit(const CommandBatch &batch);
+
         /**
          * @brief Set the camara servo angle
          * @param channel 0x01: horizontal, 0x02: vertical, if using depth camera, 0x01: depth
@@ -47,6 +267,12 @@ namespace transbot_sdk
          */
         void set_led_strip(int id, int r, int g, int b);
 
+        /**
+         * @brief Get the framebuffer of the led strip, see LedFramebuffer
+         * @return The framebuffer
+         */
+        LedFramebuffer &led_framebuffer();
+
         /**
          * @brief Set the led strip effect
          * @param effect Effect id, 0-6
@@ -103,6 +329,103 @@ namespace transbot_sdk
          */
         void set_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed);
 
+        /**
+         * @brief Move the arm along a trajectory, streaming interpolated setpoints on a background thread
+         * @details A running trajectory is preempted smoothly, see ArmTrajectoryExecutor. Returns without waiting for
+         * the arm.
+         * @param waypoints Waypoints with strictly increasing times from 0 s, at most 64, in the angles of
+         * set_all_arm_servo_angle()
+         * @param interpolation CUBIC or QUINTIC
+         * @return false if a waypoint is out of range
+         */
+        bool execute_arm_trajectory(const std::vector<Arm_Waypoint> &waypoints,
+                                    TRANSBOT_ARM_INTERPOLATION interpolation = QUINTIC);
+
+        /**
+         * @brief Stop the running arm trajectory, the arm stays at the last setpoint
+         */
+        void stop_arm_trajectory();
+
+        /**
+         * @brief Check if an arm trajectory is running
+         * @return true until the last trajectory has reached its last waypoint or has been stopped
+         */
+        bool is_arm_trajectory_active() const;
+
+        /**
+         * @brief Set the number of arm setpoints streamed per second
+         * @param rate Above 0, at most what the serial link carries next to the other commands, about 73 at 115200 baud,
+         * 50 by default
+         * @return false if the rate is out of range
+         */
+        bool set_arm_trajectory_rate(double rate);
+
+        /**
+         * @brief Run a control callback at a fixed period on a dedicated thread, see ControlLoop
+         * @details Commands of the callback, e.g. set_chassis_motion(), are queued without blocking and logged
+         * asynchronously. With options.realtime_priority the transmit thread runs with the same SCHED_FIFO priority,
+         * so they are written within a frame time and the guard time of the previous frame.
+         * @param options Period, SCHED_FIFO priority, cpu and memory locking
+         * @param callback Called with the tick and the latest motion info
+         * @return false if the loop is running already or an option cannot be applied
+         */
+        bool start_control_loop(const ControlLoopOptions &options, std::function<void(const ControlTick &)> callback);
+
+        /**
+         * @brief Stop the control loop, can be called from its callback
+         */
+        void stop_control_loop();
+
+        /**
+         * @brief Get the ticks, missed deadlines, wake-up jitter and callback times of the control loop
+         * @return The timing
+         */
+        ControlLoopStats control_loop_stats() const;
+
+        /**
+         * @brief Toggle reporting of MOTION_STATUS by the robot at its own rate, without requests
+         * @param enable true to report, false to stop
+         */
+        void set_auto_report(bool enable);
+
+        /**
+         * @brief Call back with every received message of a type, decoded, e.g. Movement_Status_Response
+         * @details The callback runs on the dispatcher thread of the protocol. Messages completing a getter are not
+         * passed to it.
+         * @tparam Message Receive message of the codec
+         * @param callback Called with every message, nullptr to unsubscribe
+         */
+        template<class Message>
+        void subscribe(std::function<void(const Message &)> callback)
+        {
+            if (!callback)
+            {
+                protocol.subscribe(Message::FUNCTION, nullptr);
+                return;
+            }
+            protocol.subscribe(Message::FUNCTION, [callback](const Package &package)
+            {
+                auto message = decode<Message>(package);
+                if (message != nullptr)
+                {
+                    callback(*message);
+                }
+            });
+        }
+
+        /**
+         * @brief Call back with every motion info the robot reports, see set_auto_report()
+         * @param callback Called on the dispatcher thread, nullptr to unsubscribe
+         */
+        void on_motion_info(std::function<void(const Motion_Info &)> callback);
+
+        /**
+         * @brief Set how long the getters wait for a response from the robot
+         * @note The time includes waiting behind commands queued before the request
+         * @param timeout Time to wait for a response, 100ms by default
+         */
+        void set_request_timeout(std::chrono::milliseconds timeout);
+
         /**
          * @brief Get the firmware version
          * @return firmware version
@@ -122,8 +445,8 @@ namespace transbot_sdk
         int get_servo_position(int channel);
 
         /**
-         * @brief Get chassis motion info
-         * @return The motion info
+         * @brief Get the latest chassis motion info reported, see set_auto_report()
+         * @return The motion info, all zeros if none has been reported
          */
         Motion_Info get_motion_info();
 
@@ -139,11 +462,139 @@ namespace transbot_sdk
          */
         bool is_gyro_assist_enabled();
 
+        /**
+         * @brief Get the latest motion info reported, without waiting
+         * @details The latest values are updated in place by the receive thread and read without locks, so control
+         * loops can read them at any rate. Check sequence to tell a new report from one already seen.
+         * @return The motion info with its sequence number and arrival time
+         */
+        Telemetry<Motion_Info> latest_motion_info() const;
+
+        /**
+         * @brief Get the motion info at a time, e.g. when a camera frame was captured
+         * @details The motion info of the last reports is kept with their arrival time and interpolated linearly
+         * between the two reports around the time. Never blocks nor allocates, so any number of threads can call it at
+         * frame rate. Needs reports, see set_auto_report().
+         * @param time Time on the steady clock
+         * @param motion_info Set to the motion info at the time
+         * @return false if the time is before the oldest or after the newest report kept
+         */
+        bool get_motion_info_at(std::chrono::steady_clock::time_point time, Motion_Info &motion_info) const;
+
+        /**
+         * @brief Get the latest yaw angle received, by get_yaw_angle() or else, without waiting
+         * @return The yaw angle with its sequence number and arrival time
+         */
+        Telemetry<int> latest_yaw_angle() const;
+
+        /**
+         * @brief Get the latest position received of a servo, by get_servo_position() or else, without waiting
+         * @param channel Servo id
+         * @return The servo position with its sequence number and arrival time
+         */
+        Telemetry<int> latest_servo_position(int channel) const;
+
+        /**
+         * @brief Get the latest PID parameters received, by get_pid_parameters() or else, without waiting
+         * @return The PID parameters with their sequence number and arrival time
+         */
+        Telemetry<PID_Parameters> latest_pid_parameters() const;
+
+        /**
+         * @brief Get the latest gyro assist status received, by is_gyro_assist_enabled() or else, without waiting
+         * @return true if gyro assist is enabled, with its sequence number and arrival time
+         */
+        Telemetry<bool> latest_gyro_assist() const;
+
+        /**
+         * @brief Get runtime statistics of the sdk, for monitoring
+         * @details Frames and bytes sent and received, and per function the time commands wait in the transmit queue,
+         * the time their write() takes and the time requests wait for their response, as latency percentiles. The
+         * statistics are kept with relaxed atomics by the threads of the sdk, so scraping them never holds these up.
+         * @return Snapshot of the statistics since init()
+         */
+        ProtocolStats stats() const;
+
     private:
+        friend class CommandBatch;
+        friend class LedFramebuffer;
+
         Protocol protocol;
+        LedFramebuffer framebuffer{*this};
         int angle_offset[3] = {0, 0, 0};
+        std::chrono::milliseconds request_timeout = std::chrono::milliseconds(100);
+        ArmTrajectoryExecutor arm_trajectory{protocol, [this](const double *angles, Package &package)
+        {
+            return encode_arm_joint_position(angles, package);
+        }};
+        ControlLoop control_loop{[this]
+                                 {
+                                     return latest_motion_info();
+                                 },
+                                 [this](int priority)
+                                 {
+                                     return protocol.set_transmit_priority(priority);
+                                 }};
 
         uint16_t angle_to_pwm(int angle, TRANSBOT_ARM_SERVO_ID servoId);
+
+        /**
+         * @brief Convert a fractional angle to the pwm of a servo, rounded rather than truncated
+         */
+        uint16_t angle_to_pwm(double angle, TRANSBOT_ARM_SERVO_ID servoId);
+
+        /**
+         * @brief Encode a setpoint of ArmTrajectoryExecutor, whose angles are in range
+         * @param angles Angles of joint 1, 2 and 3
+         * @param package Set to the SET_ARM_MOTION package
+         * @return true
+         */
+        bool encode_arm_joint_position(const double *angles, Package &package);
+
+        // Check the parameters of a command and encode it, shared by the setters and CommandBatch. Return false, with
+        // the error logged, if a parameter is out of range.
+        bool encode_chassis_motion(double linear_velocity, double angular_velocity, Package &package);
+
+        bool encode_camara_angle(TRANSBOT_CAMARA_CHANNEL channel, int angle, Package &package);
+
+        bool encode_led_strip(int id, int r, int g, int b, Package &package);
+
+        bool encode_strip_effect(int effect, int velocity, int param, Package &package);
+
+        bool encode_beep(int duration, Package &package);
+
+        bool encode_light(int lightness, Package &package);
+
+        bool encode_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed, Package &package);
+
+        bool encode_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed, Package &package);
+
+        /**
+         * @brief Convert a PID parameters frame to real values
+         * @param pid Decoded PID_PARAM parameters
+         * @return The PID parameters
+         */
+        static PID_Parameters to_pid_parameters(const PID_Parameters_Response &pid);
+
+        /**
+         * @brief Decode the latest frame of a receive message
+         * @tparam Message Receive message of the codec
+         * @param empty Value returned if no frame has been received
+         * @param convert Converts the decoded message to the value
+         * @param key Servo id for Servo_Position_Response, -1 otherwise
+         * @return The value with the sequence number and arrival time of the frame
+         */
+        template<class Message, class T, class Convert>
+        Telemetry<T> latest(T empty, Convert convert, int key = -1) const
+        {
+            auto frame = protocol.latest(Message::FUNCTION, key);
+            auto message = decode<Message>(frame.package);
+            if (message == nullptr)
+            {
+                return Telemetry<T>{empty, 0, frame.received_at};
+            }
+            return Telemetry<T>{convert(*message), frame.sequence, frame.received_at};
+        }
     };
 } // transbot_sdk
 
@@ -0,0 +1,377 @@
+#include <algorithm>
+#include "arm_trajectory_executor.hpp"
+#include "protocol/protocol.hpp"
+#include "protocol/codec.hpp"
+#include "log/async_log.hpp"
+
+namespace transbot_sdk
+{
+    namespace
+    {
+        //! angles set_all_arm_servo_angle() accepts for each joint
+        const double MIN_ANGLE[ArmTrajectoryExecutor::JOINTS] = {0, 30, 30};
+        const double MAX_ANGLE[ArmTrajectoryExecutor::JOINTS] = {225, 270, 180};
+    }
+
+    constexpr double ArmTrajectoryExecutor::DEFAULT_RATE;
+    constexpr double ArmTrajectoryExecutor::MAX_LINK_SHARE;
+
+    ArmTrajectoryExecutor::ArmTrajectoryExecutor(Protocol &protocol, Encoder encoder)
+        : m_protocol(protocol), m_encoder(std::move(encoder))
+    {
+        m_back = 0;
+        m_middle = 1;
+        m_front = 2;
+        m_submitted = 0;
+        m_finished = 0;
+        m_period_ns = static_cast<uint64_t>(1e9 / DEFAULT_RATE);
+        m_sent_setpoints = 0;
+        m_missed_ticks = 0;
+        m_is_running = false;
+    }
+
+    ArmTrajectoryExecutor::~ArmTrajectoryExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_is_running = false;
+        }
+        m_condition.notify_one();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool ArmTrajectoryExecutor::execute(const std::vector<Arm_Waypoint> &waypoints,
+                                        TRANSBOT_ARM_INTERPOLATION interpolation)
+    {
+        if (waypoints.empty() || waypoints.size() > MAX_WAYPOINTS)
+        {
+            TRANSBOT_LOG(ERROR, "Number of waypoints out of range: {}", waypoints.size());
+            return false;
+        }
+        if (interpolation != CUBIC && interpolation != QUINTIC)
+        {
+            TRANSBOT_LOG(ERROR, "Interpolation out of range: {}", interpolation);
+            return false;
+        }
+        for (size_t i = 0; i < waypoints.size(); i++)
+        {
+            const Arm_Waypoint &waypoint = waypoints[i];
+            if (!(waypoint.time >= (i == 0 ? 0.0 : waypoints[i - 1].time + 1e-6)))
+            {
+                TRANSBOT_LOG(ERROR, "Time of waypoint {} is not after the previous one: {}", i, waypoint.time);
+                return false;
+            }
+            const double angles[JOINTS] = {waypoint.joint1, waypoint.joint2, waypoint.joint3};
+            for (int joint = 0; joint < JOINTS; joint++)
+            {
+                if (!(angles[joint] >= MIN_ANGLE[joint] && angles[joint] <= MAX_ANGLE[joint]))
+                {
+                    TRANSBOT_LOG(ERROR, "Joint{} angle of waypoint {} out of range: {}", joint + 1, i, angles[joint]);
+                    return false;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(m_submit_mutex);
+        Trajectory &trajectory = m_trajectories[m_back];
+        trajectory.count = waypoints.size();
+        trajectory.interpolation = interpolation;
+        for (size_t i = 0; i < waypoints.size(); i++)
+        {
+            Knot &knot = trajectory.knots[i + 1];
+            knot.time = waypoints[i].time;
+            knot.position[0] = waypoints[i].joint1;
+            knot.position[1] = waypoints[i].joint2;
+            knot.position[2] = waypoints[i].joint3;
+            std::fill(knot.velocity, knot.velocity + JOINTS, 0.0);
+            std::fill(knot.acceleration, knot.acceleration + JOINTS, 0.0);
+        }
+        // The first waypoint is estimated again by the thread if the trajectory starts from the current setpoint
+        for (size_t i = 2; i < waypoints.size(); i++)
+        {
+            estimate_derivatives(trajectory.knots, i);
+        }
+        publish();
+        return true;
+    }
+
+    void ArmTrajectoryExecutor::stop()
+    {
+        std::lock_guard<std::mutex> lock(m_submit_mutex);
+        if (!m_thread.joinable())
+        {
+            return;
+        }
+        m_trajectories[m_back].count = 0;
+        publish();
+    }
+
+    void ArmTrajectoryExecutor::publish()
+    {
+        Trajectory &trajectory = m_trajectories[m_back];
+        trajectory.sequence = m_submitted.load(std::memory_order_relaxed) + 1;
+        m_submitted.store(trajectory.sequence, std::memory_order_release);
+        m_back = m_middle.exchange(m_back | NEW_TRAJECTORY, std::memory_order_acq_rel) & INDEX_MASK;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_is_running)
+            {
+                m_is_running = true;
+                m_thread = std::thread(&ArmTrajectoryExecutor::stream_thread, this);
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    bool ArmTrajectoryExecutor::is_active() const
+    {
+        return m_finished.load(std::memory_order_acquire) != m_submitted.load(std::memory_order_acquire);
+    }
+
+    bool ArmTrajectoryExecutor::set_rate(double rate)
+    {
+        double max_rate = get_max_rate();
+        if (!(rate > 0 && rate <= max_rate))
+        {
+            TRANSBOT_LOG(ERROR, "Arm streaming rate out of range: {}, at most {}", rate, max_rate);
+            return false;
+        }
+        m_period_ns.store(static_cast<uint64_t>(1e9 / rate), std::memory_order_relaxed);
+        return true;
+    }
+
+    double ArmTrajectoryExecutor::get_max_rate() const
+    {
+        // Every setpoint is a frame of the same length, whatever its angles
+        Package setpoint = encode(Control_Arm_Joint_Position(0, 0, 0));
+        auto interval = std::chrono::duration<double>(m_protocol.get_send_interval(setpoint));
+        return MAX_LINK_SHARE / interval.count();
+    }
+
+    uint64_t ArmTrajectoryExecutor::get_sent_setpoints() const
+    {
+        return m_sent_setpoints.load(std::memory_order_relaxed);
+    }
+
+    uint64_t ArmTrajectoryExecutor::get_missed_ticks() const
+    {
+        return m_missed_ticks.load(std::memory_order_relaxed);
+    }
+
+    void ArmTrajectoryExecutor::estimate_derivatives(Knot *knots, size_t index)
+    {
+        const Knot &previous = knots[index - 1];
+        Knot &knot = knots[index];
+        const Knot &next = knots[index + 1];
+        double before = knot.time - previous.time;
+        double after = next.time - knot.time;
+        for (int joint = 0; joint < JOINTS; joint++)
+        {
+            double slope_before = (knot.position[joint] - previous.position[joint]) / before;
+            double slope_after = (next.position[joint] - knot.position[joint]) / after;
+            // Stop where the joint turns, so that it does not overshoot the waypoint
+            knot.velocity[joint] = slope_before * slope_after <= 0
+                                   ? 0.0
+                                   : (slope_before * after + slope_after * before) / (before + after);
+            knot.acceleration[joint] = 2 * (slope_after - slope_before) / (before + after);
+        }
+    }
+
+    void ArmTrajectoryExecutor::evaluate(const Knot &begin, const Knot &end, double time,
+                                         TRANSBOT_ARM_INTERPOLATION interpolation, Knot &state)
+    {
+        double h = end.time - begin.time;
+        double s = std::min(std::max((time - begin.time) / h, 0.0), 1.0);
+        double s2 = s * s;
+        double s3 = s2 * s;
+        state.time = time;
+        if (interpolation == CUBIC)
+        {
+            // Cubic Hermite basis of p0, h*v0, p1, h*v1 and its derivatives in s
+            const double basis[4] = {2 * s3 - 3 * s2 + 1, s3 - 2 * s2 + s, -2 * s3 + 3 * s2, s3 - s2};
+            const double first[4] = {6 * s2 - 6 * s, 3 * s2 - 4 * s + 1, -6 * s2 + 6 * s, 3 * s2 - 2 * s};
+            const double second[4] = {12 * s - 6, 6 * s - 4, -12 * s + 6, 6 * s - 2};
+            for (int joint = 0; joint < JOINTS; joint++)
+            {
+                const double terms[4] = {begin.position[joint], h * begin.velocity[joint],
+                                         end.position[joint], h * end.velocity[joint]};
+                double position = 0, velocity = 0, acceleration = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    position += basis[i] * terms[i];
+                    velocity += first[i] * terms[i];
+                    acceleration += second[i] * terms[i];
+                }
+                state.position[joint] = position;
+                state.velocity[joint] = velocity / h;
+                state.acceleration[joint] = acceleration / (h * h);
+            }
+            return;
+        }
+
+        // Quintic Hermite basis of p0, h*v0, h^2*a0, h^2*a1, h*v1, p1 and its derivatives in s
+        double s4 = s3 * s;
+        double s5 = s4 * s;
+        const double basis[6] = {1 - 10 * s3 + 15 * s4 - 6 * s5,
+                                 s - 6 * s3 + 8 * s4 - 3 * s5,
+                                 0.5 * s2 - 1.5 * s3 + 1.5 * s4 - 0.5 * s5,
+                                 0.5 * s3 - s4 + 0.5 * s5,
+                                 -4 * s3 + 7 * s4 - 3 * s5,
+                                 10 * s3 - 15 * s4 + 6 * s5};
+        const double first[6] = {-30 * s2 + 60 * s3 - 30 * s4,
+                                 1 - 18 * s2 + 32 * s3 - 15 * s4,
+                                 s - 4.5 * s2 + 6 * s3 - 2.5 * s4,
+                                 1.5 * s2 - 4 * s3 + 2.5 * s4,
+                                 -12 * s2 + 28 * s3 - 15 * s4,
+                                 30 * s2 - 60 * s3 + 30 * s4};
+        const double second[6] = {-60 * s + 180 * s2 - 120 * s3,
+                                  -36 * s + 96 * s2 - 60 * s3,
+                                  1 - 9 * s + 18 * s2 - 10 * s3,
+                                  3 * s - 12 * s2 + 10 * s3,
+                                  -24 * s + 84 * s2 - 60 * s3,
+                                  60 * s - 180 * s2 + 120 * s3};
+        for (int joint = 0; joint < JOINTS; joint++)
+        {
+            const double terms[6] = {begin.position[joint], h * begin.velocity[joint],
+                                     h * h * begin.acceleration[joint], h * h * end.acceleration[joint],
+                                     h * end.velocity[joint], end.position[joint]};
+            double position = 0, velocity = 0, acceleration = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                position += basis[i] * terms[i];
+                velocity += first[i] * terms[i];
+                acceleration += second[i] * terms[i];
+            }
+            state.position[joint] = position;
+            state.velocity[joint] = velocity / h;
+            state.acceleration[joint] = acceleration / (h * h);
+        }
+    }
+
+    void ArmTrajectoryExecutor::send_setpoint(const Knot &state)
+    {
+        double angles[JOINTS];
+        for (int joint = 0; joint < JOINTS; joint++)
+        {
+            angles[joint] = std::min(std::max(state.position[joint], MIN_ANGLE[joint]), MAX_ANGLE[joint]);
+        }
+        Package package;
+        if (!m_encoder(angles, package))
+        {
+            return;
+        }
+        if (!m_protocol.send(package))
+        {
+            TRANSBOT_LOG(ERROR, "Send arm setpoint failed. Joint1: {}, Joint2: {}, Joint3: {}",
+                         angles[0], angles[1], angles[2]);
+            return;
+        }
+        m_sent_setpoints.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void ArmTrajectoryExecutor::stream_thread()
+    {
+        TRANSBOT_LOG(INFO, "Arm trajectory thread started.");
+        const auto min_period = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / get_max_rate()));
+        Knot state{};
+        bool has_setpoint = false;
+        Trajectory *active = nullptr;
+        size_t segment = 0;
+        size_t last = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto next_tick = start;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_is_running)
+        {
+            if (active == nullptr && !(m_middle.load(std::memory_order_acquire) & NEW_TRAJECTORY))
+            {
+                m_condition.wait(lock);
+                next_tick = std::chrono::steady_clock::now();
+                continue;
+            }
+            lock.unlock();
+
+            auto now = std::chrono::steady_clock::now();
+            if (m_middle.load(std::memory_order_acquire) & NEW_TRAJECTORY)
+            {
+                m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX_MASK;
+                Trajectory &trajectory = m_trajectories[m_front];
+                active = &trajectory;
+                start = now;
+                last = trajectory.count;
+                Knot *knots = trajectory.knots;
+                if (trajectory.count == 0)
+                {
+                    // Stopped, the arm holds the last setpoint
+                    std::fill(state.velocity, state.velocity + JOINTS, 0.0);
+                    std::fill(state.acceleration, state.acceleration + JOINTS, 0.0);
+                    m_finished.store(trajectory.sequence, std::memory_order_release);
+                    active = nullptr;
+                }
+                else if (knots[1].time > 0)
+                {
+                    // Move to the first waypoint from where the arm is heading now, or hold it until then
+                    knots[0] = has_setpoint ? state : knots[1];
+                    knots[0].time = 0;
+                    if (!has_setpoint)
+                    {
+                        std::fill(knots[0].velocity, knots[0].velocity + JOINTS, 0.0);
+                        std::fill(knots[0].acceleration, knots[0].acceleration + JOINTS, 0.0);
+                    }
+                    if (trajectory.count > 1)
+                    {
+                        estimate_derivatives(knots, 1);
+                    }
+                    segment = 0;
+                }
+                else
+                {
+                    segment = 1;
+                }
+            }
+
+            if (active != nullptr)
+            {
+                double time = std::chrono::duration<double>(now - start).count();
+                const Knot *knots = active->knots;
+                while (segment < last && time >= knots[segment + 1].time)
+                {
+                    segment++;
+                }
+                if (segment == last)
+                {
+                    state = knots[last];
+                }
+                else
+                {
+                    evaluate(knots[segment], knots[segment + 1], time, active->interpolation, state);
+                }
+                send_setpoint(state);
+                has_setpoint = true;
+                if (segment == last)
+                {
+                    m_finished.store(active->sequence, std::memory_order_release);
+                    active = nullptr;
+                }
+
+                // The default rate is not checked by set_rate(), slow links get fewer setpoints
+                auto period = std::max(std::chrono::nanoseconds(m_period_ns.load(std::memory_order_relaxed)),
+                                       min_period);
+                next_tick += period;
+                if (next_tick <= now)
+                {
+                    // Late by whole periods, skip them rather than sending a burst of setpoints
+                    auto missed = (now - next_tick) / period + 1;
+                    m_missed_ticks.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+                    next_tick += missed * period;
+                }
+                std::this_thread::sleep_until(next_tick);
+            }
+            lock.lock();
+        }
+        TRANSBOT_LOG(INFO, "Arm trajectory thread stopped.");
+    }
+} // transbot_sdk
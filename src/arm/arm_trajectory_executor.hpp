@@ -0,0 +1,195 @@
+#ifndef TRANSBOT_SDK_ARM_TRAJECTORY_EXECUTOR_HPP
+#define TRANSBOT_SDK_ARM_TRAJECTORY_EXECUTOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "transbot_sdk/data.hpp"
+#include "../protocol/package.hpp"
+
+class Protocol;
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Streams arm setpoints interpolated between timed waypoints, on a background thread
+     * @details execute() checks the waypoints, estimates the joint velocities (and accelerations for QUINTIC) at each
+     * of them and hands the trajectory over through a lock-free triple buffer, so it never waits for the streaming
+     * thread. The thread evaluates the Hermite spline of the current segment at a fixed rate and sends one SET_ARM_MOTION
+     * frame per tick, without allocating. A new trajectory preempts the running one at the next tick: when its first
+     * waypoint is later than 0 s, the arm moves there from the current setpoint with the current velocity and
+     * acceleration, so there is no jump. Velocities are 0 at the first and last waypoint and at waypoints where a joint
+     * turns, so a joint does not overshoot the waypoints.
+     */
+    class ArmTrajectoryExecutor
+    {
+    public:
+        //! most waypoints of a trajectory
+        static const size_t MAX_WAYPOINTS = 64;
+        static const int JOINTS = 3;
+        //! setpoints per second by default
+        static constexpr double DEFAULT_RATE = 50.0;
+        //! share of the serial link the setpoints may take at most, the rest is left to the other commands
+        static constexpr double MAX_LINK_SHARE = 0.8;
+
+        /**
+         * @brief Encodes the angles of a setpoint into a SET_ARM_MOTION package
+         * @return false if the setpoint is skipped
+         */
+        typedef std::function<bool(const double *angles, Package &package)> Encoder;
+
+        /**
+         * @brief Constructor of the executor, the thread is started by the first execute()
+         * @param protocol Protocol the setpoints are sent by, must outlive the executor
+         * @param encoder Encodes the angles of a setpoint, called on the streaming thread
+         */
+        ArmTrajectoryExecutor(Protocol &protocol, Encoder encoder);
+
+        ~ArmTrajectoryExecutor();
+
+        ArmTrajectoryExecutor(const ArmTrajectoryExecutor &) = delete;
+
+        ArmTrajectoryExecutor &operator=(const ArmTrajectoryExecutor &) = delete;
+
+        /**
+         * @brief Start moving along a trajectory, preempting the running one, without waiting for the thread
+         * @param waypoints Waypoints with strictly increasing times from 0 s, at most MAX_WAYPOINTS
+         * @param interpolation CUBIC or QUINTIC
+         * @return false if a waypoint is invalid, the running trajectory continues then
+         */
+        bool execute(const std::vector<Arm_Waypoint> &waypoints, TRANSBOT_ARM_INTERPOLATION interpolation);
+
+        /**
+         * @brief Stop the running trajectory at the next tick, the arm stays at the last setpoint
+         */
+        void stop();
+
+        /**
+         * @brief Check if a trajectory is running or about to start
+         * @return true until the last trajectory passed has reached its last waypoint or has been stopped
+         */
+        bool is_active() const;
+
+        /**
+         * @brief Set the number of setpoints sent per second
+         * @param rate 0-get_max_rate(), excluding 0
+         * @return false if the rate is out of range
+         */
+        bool set_rate(double rate);
+
+        /**
+         * @brief Get the most setpoints per second the serial link carries next to the other commands
+         * @details A setpoint takes the frame time at the baud rate plus the guard time of SET_ARM_MOTION, which is
+         * 10 ms for the firmware to relay it on the servo bus, and may take MAX_LINK_SHARE of the link. At 115200 baud
+         * that is about 73 setpoints per second.
+         * @return Setpoints per second
+         */
+        double get_max_rate() const;
+
+        /**
+         * @brief Get the number of setpoints sent so far
+         * @return Number of setpoints
+         */
+        uint64_t get_sent_setpoints() const;
+
+        /**
+         * @brief Get the number of ticks missed because the thread was late
+         * @return Number of missed ticks
+         */
+        uint64_t get_missed_ticks() const;
+
+    private:
+        //! flag of the middle buffer, set while it holds a trajectory the thread has not taken yet
+        static const int NEW_TRAJECTORY = 0x4;
+        static const int INDEX_MASK = 0x3;
+
+        /**
+         * @brief State of the joints at a time
+         */
+        typedef struct _knot
+        {
+            //! seconds from the start of the trajectory
+            double time;
+            double position[JOINTS];
+            double velocity[JOINTS];
+            double acceleration[JOINTS];
+        } Knot;
+
+        /**
+         * @brief A trajectory in one of the three buffers
+         */
+        typedef struct _trajectory
+        {
+            //! knots[0] is left for the setpoint the trajectory starts from, the waypoints follow
+            Knot knots[MAX_WAYPOINTS + 1];
+            //! number of waypoints, 0 to stop
+            size_t count;
+            TRANSBOT_ARM_INTERPOLATION interpolation;
+            //! value of m_submitted for the trajectory
+            uint64_t sequence;
+        } Trajectory;
+
+        /**
+         * @brief Estimate the velocity and acceleration at a knot from its neighbours
+         * @param knots The knots
+         * @param index The knot, with a knot before and after it
+         */
+        static void estimate_derivatives(Knot *knots, size_t index);
+
+        /**
+         * @brief Evaluate the spline between two knots
+         * @param begin Knot at the start of the segment
+         * @param end Knot at the end of the segment
+         * @param time Seconds from the start of the trajectory, between the times of the knots
+         * @param interpolation CUBIC or QUINTIC
+         * @param state Set to the position, velocity and acceleration at the time
+         */
+        static void evaluate(const Knot &begin, const Knot &end, double time,
+                             TRANSBOT_ARM_INTERPOLATION interpolation, Knot &state);
+
+        /**
+         * @brief Hand the back buffer over to the thread and wake it up
+         */
+        void publish();
+
+        /**
+         * @brief Encode and send a setpoint
+         * @param state The setpoint
+         */
+        void send_setpoint(const Knot &state);
+
+        void stream_thread();
+
+        Protocol &m_protocol;
+        Encoder m_encoder;
+        Trajectory m_trajectories[3];
+        //! buffer the callers of execute() fill, guarded by m_submit_mutex
+        int m_back;
+        //! buffer exchanged between the callers and the thread, with NEW_TRAJECTORY
+        std::atomic<int> m_middle;
+        //! buffer the thread runs, only used by the thread
+        int m_front;
+        //! serializes the callers of execute() and stop()
+        std::mutex m_submit_mutex;
+        //! number of trajectories passed to the thread, including stops
+        std::atomic<uint64_t> m_submitted;
+        //! sequence of the last trajectory finished or stopped
+        std::atomic<uint64_t> m_finished;
+        std::atomic<uint64_t> m_period_ns;
+        std::atomic<uint64_t> m_sent_setpoints;
+        std::atomic<uint64_t> m_missed_ticks;
+        //! the thread sleeps on it while no trajectory is running
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        bool m_is_running;
+        std::thread m_thread;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_ARM_TRAJECTORY_EXECUTOR_HPP
@@ -0,0 +1,215 @@
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "control_loop.hpp"
+#include "log/async_log.hpp"
+
+namespace transbot_sdk
+{
+    namespace
+    {
+        //! stack touched before the first tick when the memory is locked, so that the loop never faults it in
+        const size_t PREFAULT_STACK_SIZE = 64 * 1024;
+
+        /**
+         * @brief Sleep until an absolute time of the steady clock, which is CLOCK_MONOTONIC on Linux
+         * @param deadline The time
+         */
+        void sleep_until(std::chrono::steady_clock::time_point deadline)
+        {
+            auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+            timespec time{};
+            time.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000LL);
+            time.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000LL);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR)
+            {
+            }
+        }
+
+        void prefault_stack()
+        {
+            uint8_t stack[PREFAULT_STACK_SIZE];
+            memset(stack, 0, sizeof(stack));
+            // Keep the compiler from removing the stores
+            asm volatile("" : : "r"(stack) : "memory");
+        }
+    }
+
+    ControlLoop::ControlLoop(TelemetrySource telemetry, PrioritySetter set_priority)
+        : m_telemetry(std::move(telemetry)), m_set_priority(std::move(set_priority))
+    {
+        m_is_running = false;
+        m_ticks = 0;
+        m_missed_deadlines = 0;
+    }
+
+    ControlLoop::~ControlLoop()
+    {
+        stop();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool ControlLoop::start(const ControlLoopOptions &options, Callback callback)
+    {
+        if (m_is_running)
+        {
+            TRANSBOT_LOG(ERROR, "Control loop is running already.");
+            return false;
+        }
+        if (options.period <= std::chrono::nanoseconds(0))
+        {
+            TRANSBOT_LOG(ERROR, "Control loop period out of range: {}", options.period.count());
+            return false;
+        }
+        if (options.realtime_priority < 0 || options.realtime_priority > 99)
+        {
+            TRANSBOT_LOG(ERROR, "Realtime priority out of range: {}", options.realtime_priority);
+            return false;
+        }
+        if (options.cpu < -1 || options.cpu >= CPU_SETSIZE)
+        {
+            TRANSBOT_LOG(ERROR, "Cpu out of range: {}", options.cpu);
+            return false;
+        }
+        if (!callback)
+        {
+            TRANSBOT_LOG(ERROR, "Control loop callback is empty.");
+            return false;
+        }
+        if (options.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Lock memory failed: {}", strerror(errno));
+            return false;
+        }
+        if (m_thread.joinable())
+        {
+            // Stopped from its own callback
+            m_thread.join();
+        }
+
+        std::promise<bool> configured;
+        std::future<bool> is_configured = configured.get_future();
+        m_is_running = true;
+        m_thread = std::thread([this, options, callback, &configured]
+                               {
+                                   if (!configure_thread(options))
+                                   {
+                                       configured.set_value(false);
+                                       return;
+                                   }
+                                   configured.set_value(true);
+                                   loop_thread(options, callback);
+                               });
+        bool is_started = is_configured.get();
+        if (is_started && options.realtime_priority > 0 && m_set_priority)
+        {
+            is_started = m_set_priority(options.realtime_priority);
+        }
+        if (!is_started)
+        {
+            m_is_running = false;
+            m_thread.join();
+            return false;
+        }
+        TRANSBOT_LOG(INFO, "Control loop started. Period: {} us, Priority: {}, Cpu: {}",
+                     std::chrono::duration_cast<std::chrono::microseconds>(options.period).count(),
+                     options.realtime_priority, options.cpu);
+        return true;
+    }
+
+    void ControlLoop::stop()
+    {
+        m_is_running = false;
+        if (m_thread.joinable() && m_thread.get_id() != std::this_thread::get_id())
+        {
+            m_thread.join();
+        }
+    }
+
+    bool ControlLoop::is_running() const
+    {
+        return m_is_running;
+    }
+
+    ControlLoopStats ControlLoop::get_stats() const
+    {
+        ControlLoopStats stats{};
+        stats.ticks = m_ticks.load(std::memory_order_relaxed);
+        stats.missed_deadlines = m_missed_deadlines.load(std::memory_order_relaxed);
+        stats.wakeup_jitter = m_wakeup_jitter.get_stats();
+        stats.callback_time = m_callback_time.get_stats();
+        return stats;
+    }
+
+    bool ControlLoop::configure_thread(const ControlLoopOptions &options)
+    {
+        if (options.cpu >= 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(options.cpu, &cpus);
+            int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (error != 0)
+            {
+                TRANSBOT_LOG(ERROR, "Pin control loop to cpu {} failed: {}", options.cpu, strerror(error));
+                return false;
+            }
+        }
+        if (options.realtime_priority > 0)
+        {
+            sched_param param{};
+            param.sched_priority = options.realtime_priority;
+            int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (error != 0)
+            {
+                TRANSBOT_LOG(ERROR, "Set control loop priority {} failed: {}", options.realtime_priority,
+                             strerror(error));
+                return false;
+            }
+        }
+        if (options.lock_memory)
+        {
+            prefault_stack();
+        }
+        return true;
+    }
+
+    void ControlLoop::loop_thread(ControlLoopOptions options, Callback callback)
+    {
+        ControlTick tick{0, {}, {}, m_telemetry()};
+        tick.deadline = std::chrono::steady_clock::now() + options.period;
+        while (true)
+        {
+            sleep_until(tick.deadline);
+            if (!m_is_running.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+            tick.woke_at = std::chrono::steady_clock::now();
+            m_wakeup_jitter.record(tick.woke_at - tick.deadline);
+            tick.motion_info = m_telemetry();
+            callback(tick);
+            auto done = std::chrono::steady_clock::now();
+            m_callback_time.record(done - tick.woke_at);
+            m_ticks.fetch_add(1, std::memory_order_relaxed);
+
+            tick.index++;
+            tick.deadline += options.period;
+            if (tick.deadline <= done)
+            {
+                // Overran the next deadline, skip the ticks missed rather than running them late back to back
+                auto missed = (done - tick.deadline) / options.period + 1;
+                tick.index += missed;
+                tick.deadline += missed * options.period;
+                m_missed_deadlines.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+            }
+        }
+    }
+} // transbot_sdk
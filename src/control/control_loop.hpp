@@ -0,0 +1,129 @@
+#ifndef TRANSBOT_SDK_CONTROL_LOOP_HPP
+#define TRANSBOT_SDK_CONTROL_LOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include "transbot_sdk/data.hpp"
+#include "../protocol/latency_histogram.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief How a control loop runs
+     */
+    typedef struct _control_loop_options
+    {
+        //! time between the starts of two callbacks
+        std::chrono::nanoseconds period = std::chrono::milliseconds(10);
+        //! SCHED_FIFO priority 1-99 of the loop and the transmit thread, 0 for the default scheduler
+        int realtime_priority = 0;
+        //! cpu the loop runs on, -1 for any
+        int cpu = -1;
+        //! lock every page of the process into memory, so the loop never waits for a page fault
+        bool lock_memory = false;
+    } ControlLoopOptions;
+
+    /**
+     * @brief What a control callback is passed at each tick
+     */
+    typedef struct _control_tick
+    {
+        //! number of the tick, from 0, ticks skipped after a missed deadline are counted
+        uint64_t index;
+        //! time the callback should have started
+        std::chrono::steady_clock::time_point deadline;
+        //! time the loop woke up for the callback
+        std::chrono::steady_clock::time_point woke_at;
+        //! latest motion info reported when the loop woke up
+        Telemetry<Motion_Info> motion_info;
+    } ControlTick;
+
+    /**
+     * @brief Timing of a control loop, a snapshot taken while it runs
+     */
+    typedef struct _control_loop_stats
+    {
+        //! callbacks run
+        uint64_t ticks;
+        //! ticks skipped because a callback returned after the deadline of the next one
+        uint64_t missed_deadlines;
+        //! time from a deadline until the loop woke up
+        LatencyStats wakeup_jitter;
+        //! time a callback ran
+        LatencyStats callback_time;
+    } ControlLoopStats;
+
+    /**
+     * @brief Runs a callback at a fixed period on a dedicated thread, for closed-loop control
+     * @details The thread sleeps with clock_nanosleep() until absolute deadlines on CLOCK_MONOTONIC, so the period does
+     * not drift with the time the callback takes. It can run with SCHED_FIFO, pinned to a cpu and with the memory of
+     * the process locked. When a callback overruns the next deadline, the ticks it overran are skipped and counted
+     * rather than run back to back. Every callback is passed the latest motion info, read without waiting.
+     */
+    class ControlLoop
+    {
+    public:
+        typedef std::function<void(const ControlTick &tick)> Callback;
+        //! reads the latest motion info, called on the loop thread
+        typedef std::function<Telemetry<Motion_Info>()> TelemetrySource;
+        //! applies realtime_priority to the threads the callback's commands go through, called on start()
+        typedef std::function<bool(int priority)> PrioritySetter;
+
+        ControlLoop(TelemetrySource telemetry, PrioritySetter set_priority);
+
+        ~ControlLoop();
+
+        ControlLoop(const ControlLoop &) = delete;
+
+        ControlLoop &operator=(const ControlLoop &) = delete;
+
+        /**
+         * @brief Start running a callback, the first tick is one period from now
+         * @param options Period and real-time settings
+         * @param callback Called at each tick on the loop thread, should not block
+         * @return false if the loop is running already, an option is out of range or the process may not apply it
+         */
+        bool start(const ControlLoopOptions &options, Callback callback);
+
+        /**
+         * @brief Stop the loop after the running callback, if any
+         */
+        void stop();
+
+        /**
+         * @brief Check if the loop is running
+         * @return true between start() and stop()
+         */
+        bool is_running() const;
+
+        /**
+         * @brief Get the timing of the loop since it was constructed
+         * @return The timing
+         */
+        ControlLoopStats get_stats() const;
+
+    private:
+        /**
+         * @brief Apply the scheduler and affinity options to the calling thread
+         * @param options The options
+         * @return false if an option cannot be applied
+         */
+        static bool configure_thread(const ControlLoopOptions &options);
+
+        void loop_thread(ControlLoopOptions options, Callback callback);
+
+        TelemetrySource m_telemetry;
+        PrioritySetter m_set_priority;
+        std::atomic<bool> m_is_running;
+        std::thread m_thread;
+        std::atomic<uint64_t> m_ticks;
+        std::atomic<uint64_t> m_missed_deadlines;
+        LatencyHistogram m_wakeup_jitter;
+        LatencyHistogram m_callback_time;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_CONTROL_LOOP_HPP
@@ -0,0 +1,461 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include "firmware_emulator.hpp"
+#include "log/async_log.hpp"
+#include "protocol/codec.hpp"
+#include "transbot_sdk/data.hpp"
+
+namespace transbot_sdk
+{
+    FirmwareEmulator::FirmwareEmulator(double report_rate)
+    {
+        m_report_rate = report_rate;
+        m_master_fd = -1;
+        m_slave_fd = -1;
+        m_wakeup_fd = -1;
+        m_is_running = false;
+        m_received_frames = 0;
+        m_sent_frames = 0;
+
+        m_auto_report = report_rate > 0;
+        m_gyro_assist = false;
+        m_linear_velocity = 0;
+        m_angular_velocity = 0;
+        m_yaw = 0;
+        // Factory PID, 1000 times of the real value
+        m_pid[0] = 1000;
+        m_pid[1] = 100;
+        m_pid[2] = 0;
+        for (auto &position: m_servo_position)
+        {
+            position = 2000;
+        }
+    }
+
+    FirmwareEmulator::~FirmwareEmulator()
+    {
+        stop();
+        // Close the SDK side before the master so that it does not see a hang up first
+        m_device.reset();
+        if (m_slave_fd >= 0)
+        {
+            close(m_slave_fd);
+        }
+        if (m_master_fd >= 0)
+        {
+            close(m_master_fd);
+        }
+        if (m_wakeup_fd >= 0)
+        {
+            close(m_wakeup_fd);
+        }
+    }
+
+    bool FirmwareEmulator::start()
+    {
+        if (m_is_running)
+        {
+            return true;
+        }
+        if (m_master_fd < 0)
+        {
+            m_master_fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+            if (m_master_fd < 0 || grantpt(m_master_fd) != 0 || unlockpt(m_master_fd) != 0)
+            {
+                TRANSBOT_LOG(ERROR, "Open pseudo-terminal failed, errno: {}", errno);
+                return false;
+            }
+            m_slave_path = ptsname(m_master_fd);
+
+            // Put the slave in raw mode right away, otherwise the line discipline echoes frames back to the master
+            // until the SDK configures the port
+            m_slave_fd = open(m_slave_path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+            if (m_slave_fd < 0)
+            {
+                TRANSBOT_LOG(ERROR, "Open pseudo-terminal slave {} failed, errno: {}", m_slave_path, errno);
+                return false;
+            }
+            struct termios settings = {};
+            tcgetattr(m_slave_fd, &settings);
+            cfmakeraw(&settings);
+            tcsetattr(m_slave_fd, TCSANOW, &settings);
+        }
+        if (m_wakeup_fd < 0)
+        {
+            m_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (m_wakeup_fd < 0)
+            {
+                TRANSBOT_LOG(ERROR, "Create wakeup event failed, errno: {}", errno);
+                return false;
+            }
+        }
+        else
+        {
+            // Restarted, the thread may have stopped before it read the wakeup of stop()
+            uint64_t count;
+            if (read(m_wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            {
+                TRANSBOT_LOG(ERROR, "Read wakeup event failed, errno: {}", errno);
+            }
+        }
+
+        m_is_running = true;
+        m_firmware_thread = std::thread(&FirmwareEmulator::firmware_thread, this);
+        TRANSBOT_LOG(INFO, "Firmware emulator started on {}.", m_slave_path);
+        return true;
+    }
+
+    void FirmwareEmulator::stop()
+    {
+        if (!m_is_running)
+        {
+            return;
+        }
+        m_is_running = false;
+        uint64_t count = 1;
+        if (write(m_wakeup_fd, &count, sizeof(count)) < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Write wakeup event failed, errno: {}", errno);
+        }
+        if (m_firmware_thread.joinable())
+        {
+            m_firmware_thread.join();
+        }
+    }
+
+    std::string FirmwareEmulator::get_slave_path() const
+    {
+        return m_slave_path;
+    }
+
+    uint64_t FirmwareEmulator::get_received_frames() const
+    {
+        return m_received_frames;
+    }
+
+    uint64_t FirmwareEmulator::get_sent_frames() const
+    {
+        return m_sent_frames;
+    }
+
+    void FirmwareEmulator::set_frame_observer(FrameObserver observer)
+    {
+        m_frame_observer = std::move(observer);
+    }
+
+    bool FirmwareEmulator::init()
+    {
+        if (!start())
+        {
+            return false;
+        }
+        if (!m_device)
+        {
+            m_device.reset(new SerialDevice(m_slave_path));
+        }
+        return m_device->init();
+    }
+
+    size_t FirmwareEmulator::receive(uint8_t *buffer, size_t max_length)
+    {
+        return m_device->receive(buffer, max_length);
+    }
+
+    size_t FirmwareEmulator::send(const uint8_t *buffer, size_t length)
+    {
+        return m_device->send(buffer, length);
+    }
+
+    bool FirmwareEmulator::wait_for_data(int timeout_ms)
+    {
+        return m_device->wait_for_data(timeout_ms);
+    }
+
+    void FirmwareEmulator::interrupt()
+    {
+        if (m_device)
+        {
+            m_device->interrupt();
+        }
+    }
+
+    int FirmwareEmulator::get_event_file_descriptor() const
+    {
+        return m_device ? m_device->get_event_file_descriptor() : -1;
+    }
+
+    void FirmwareEmulator::firmware_thread()
+    {
+        using clock = std::chrono::steady_clock;
+        const auto report_period = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(m_report_rate > 0 ? 1.0 / m_report_rate : 1.0));
+        auto next_report = clock::now() + report_period;
+
+        uint8_t staging[512];
+        size_t staged = 0;
+
+        while (m_is_running)
+        {
+            struct pollfd fds[2] = {};
+            fds[0].fd = m_master_fd;
+            fds[0].events = POLLIN;
+            fds[1].fd = m_wakeup_fd;
+            fds[1].events = POLLIN;
+
+            bool reporting = m_auto_report && m_report_rate > 0;
+            struct timespec timeout = {};
+            if (reporting)
+            {
+                auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(next_report - clock::now());
+                if (remaining.count() > 0)
+                {
+                    timeout.tv_sec = static_cast<time_t>(remaining.count() / 1000000000);
+                    timeout.tv_nsec = static_cast<long>(remaining.count() % 1000000000);
+                }
+            }
+            int ready = ppoll(fds, 2, reporting ? &timeout : nullptr, nullptr);
+            if (ready < 0 && errno != EINTR)
+            {
+                TRANSBOT_LOG(ERROR, "Poll pseudo-terminal failed, errno: {}", errno);
+                break;
+            }
+
+            if (ready > 0 && (fds[1].revents & POLLIN))
+            {
+                // Reset the event, a restarted thread would otherwise find it set and never sleep
+                uint64_t count;
+                if (read(m_wakeup_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                {
+                    TRANSBOT_LOG(ERROR, "Read wakeup event failed, errno: {}", errno);
+                }
+            }
+
+            if (ready > 0 && (fds[0].revents & POLLIN))
+            {
+                ssize_t received = read(m_master_fd, staging + staged, sizeof(staging) - staged);
+                auto received_at = clock::now();
+                if (received > 0)
+                {
+                    staged += received;
+                }
+
+                // Cut out every complete frame: 0xFF 0xFE length function payload checksum
+                size_t begin = 0;
+                while (staged - begin >= 4)
+                {
+                    const uint8_t *frame = staging + begin;
+                    if (frame[0] != 0xFF || frame[1] != SEND || frame[2] < 3 || frame[2] > MAX_PACKAGE_LEN)
+                    {
+                        begin++;
+                        continue;
+                    }
+                    size_t frame_length = frame[2] + 2;
+                    if (staged - begin < frame_length)
+                    {
+                        break;
+                    }
+                    uint8_t checksum = 0;
+                    for (size_t i = 2; i < frame_length - 1; i++)
+                    {
+                        checksum += frame[i];
+                    }
+                    if (checksum != frame[frame_length - 1])
+                    {
+                        TRANSBOT_LOG(WARNING, "Firmware emulator dropped a frame with wrong checksum.");
+                        begin++;
+                        continue;
+                    }
+                    if (m_frame_observer)
+                    {
+                        m_frame_observer(frame, received_at);
+                    }
+                    handle_frame(frame);
+                    begin += frame_length;
+                }
+                memmove(staging, staging + begin, staged - begin);
+                staged -= begin;
+                if (staged == sizeof(staging))
+                {
+                    // Nothing but garbage, start over
+                    staged = 0;
+                }
+            }
+
+            if (m_auto_report && m_report_rate > 0 && clock::now() >= next_report)
+            {
+                send_motion_status();
+                next_report += report_period;
+                if (next_report < clock::now())
+                {
+                    // Fell behind, do not try to catch up with a burst
+                    next_report = clock::now() + report_period;
+                }
+            }
+        }
+    }
+
+    void FirmwareEmulator::handle_frame(const uint8_t *frame)
+    {
+        // The parameters are cast in place, a frame of another length would read bytes past them
+        if (frame[2] != send_package_len(frame[3]))
+        {
+            TRANSBOT_LOG(WARNING, "Firmware emulator dropped a frame of function {} with length {}.",
+                         frame[3], frame[2]);
+            return;
+        }
+        m_received_frames++;
+        // The parameters are read through the same wire layouts the SDK encodes them with
+        const uint8_t *payload = frame + 4;
+        switch (frame[3])
+        {
+            case SEND_FUNCTION::SET_PID:
+            {
+                auto pid = reinterpret_cast<const PID_Adjust *>(payload);
+                m_pid[0] = pid->P;
+                m_pid[1] = pid->I;
+                m_pid[2] = pid->D;
+                break;
+            }
+            case SEND_FUNCTION::SET_CHASSIS_MOTION:
+            {
+                auto motion = reinterpret_cast<const Move_Control *>(payload);
+                m_linear_velocity = motion->linear_velocity;
+                m_angular_velocity = motion->angular_velocity;
+                break;
+            }
+            case SEND_FUNCTION::SET_AUTO_REPORT_DATA:
+                m_auto_report = reinterpret_cast<const Auto_Msg_Sending *>(payload)->enable != 0;
+                break;
+            case SEND_FUNCTION::SET_GYRO_ENABLE:
+                m_gyro_assist = reinterpret_cast<const Gyro_Direction *>(payload)->enable != 0;
+                break;
+            case SEND_FUNCTION::SET_MOTOR_FORWARD:
+                m_linear_velocity = reinterpret_cast<const Forward *>(payload)->velocity;
+                m_angular_velocity = 0;
+                break;
+            case SEND_FUNCTION::SET_ARM_SERVO:
+            {
+                auto servo = reinterpret_cast<const Servo_Control *>(payload);
+                m_servo_position[servo->servo_id] = servo->target_position;
+                break;
+            }
+            case SEND_FUNCTION::SET_ARM_MOTION:
+            {
+                auto arm = reinterpret_cast<const Control_Arm_Joint_Position *>(payload);
+                m_servo_position[JOINT1] = arm->joint1;
+                m_servo_position[JOINT2] = arm->joint2;
+                m_servo_position[JOINT3] = arm->joint3;
+                break;
+            }
+            case SEND_FUNCTION::SEND_REQUEST:
+            {
+                auto request = reinterpret_cast<const Read_Data_Request *>(payload);
+                handle_request(request->data_type, request->param);
+                break;
+            }
+            default:
+                // Every other function is accepted without any visible effect
+                break;
+        }
+    }
+
+    void FirmwareEmulator::handle_request(uint8_t data_type, uint8_t param)
+    {
+        switch (data_type)
+        {
+            case RECEIVE_FUNCTION::FIRMWARE_VERSION:
+            {
+                Firmware_Version_Response version;
+                version.major = 1;
+                version.minor = 5;
+                send_message(version);
+                break;
+            }
+            case RECEIVE_FUNCTION::YAW_ANGLE:
+            {
+                Yaw_Response yaw;
+                yaw.yaw = m_yaw;
+                send_message(yaw);
+                break;
+            }
+            case RECEIVE_FUNCTION::ARM_SERVO_POSITION:
+            {
+                Servo_Position_Response servo;
+                servo.servo_id = param;
+                servo.position = m_servo_position[param];
+                send_message(servo);
+                break;
+            }
+            case RECEIVE_FUNCTION::PID_PARAM:
+            {
+                PID_Parameters_Response pid;
+                pid.P = m_pid[0];
+                pid.I = m_pid[1];
+                pid.D = m_pid[2];
+                send_message(pid);
+                break;
+            }
+            case RECEIVE_FUNCTION::GYRO_ASSIST_ENABLED:
+            {
+                Gyro_Assist_Response gyro_assist;
+                gyro_assist.gyro_assist = m_gyro_assist ? 1 : 0;
+                send_message(gyro_assist);
+                break;
+            }
+            case RECEIVE_FUNCTION::MOTION_STATUS:
+                send_motion_status();
+                break;
+            default:
+                TRANSBOT_LOG(WARNING, "Firmware emulator got a request for unknown data type: {}",
+                             static_cast<int>(data_type));
+                break;
+        }
+    }
+
+    void FirmwareEmulator::send_frame(uint8_t function, const uint8_t *payload, uint8_t payload_length)
+    {
+        uint8_t frame[MAX_PACKAGE_LEN + 2];
+        frame[0] = 0xFF;
+        frame[1] = RECEIVE;
+        frame[2] = static_cast<uint8_t>(payload_length + 3);
+        frame[3] = function;
+        memcpy(frame + 4, payload, payload_length);
+        uint8_t checksum = 0;
+        for (int i = 2; i < payload_length + 4; i++)
+        {
+            checksum += frame[i];
+        }
+        frame[payload_length + 4] = checksum;
+
+        size_t length = payload_length + 5;
+        if (write(m_master_fd, frame, length) != static_cast<ssize_t>(length))
+        {
+            TRANSBOT_LOG(WARNING, "Firmware emulator could not write a complete frame, errno: {}", errno);
+            return;
+        }
+        m_sent_frames++;
+    }
+
+    void FirmwareEmulator::send_motion_status()
+    {
+        Movement_Status_Response status;
+        status.linear_velocity = m_linear_velocity;
+        status.angular_velocity = m_angular_velocity;
+        // Accelerometer at rest reads 1g on z, 16384 per g
+        status.acceleration[0] = 0;
+        status.acceleration[1] = 0;
+        status.acceleration[2] = 16384;
+        status.gyro[0] = 0;
+        status.gyro[1] = 0;
+        status.gyro[2] = static_cast<int16_t>(m_angular_velocity * 65.5 * 180 / 3.1415926 / 100);
+        // 12.0V, 10 times of the real value
+        status.battery_voltage = 120;
+        send_message(status);
+    }
+} // transbot_sdk
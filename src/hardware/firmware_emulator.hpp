@@ -0,0 +1,160 @@
+#ifndef TRANSBOT_SDK_FIRMWARE_EMULATOR_HPP
+#define TRANSBOT_SDK_FIRMWARE_EMULATOR_HPP
+
+#include "hardware_interface.hpp"
+#include "serial_device.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Emulator of the Transbot MCU firmware on a pseudo-terminal
+     * @details The emulator opens a pty pair and runs the firmware side on the master: it answers every SEND_REQUEST
+     * data type, accepts every SEND_FUNCTION and reports MOTION_STATUS at a configurable rate. The SDK side is the
+     * slave, which can be opened by path like a real serial port (see get_slave_path()), or used through this class
+     * directly as a HardwareInterface.
+     */
+    class FirmwareEmulator : public HardwareInterface
+    {
+    public:
+        /**
+         * @brief Called by the firmware thread with every valid frame it receives from the SDK
+         * @param frame Frame data, including header and checksum
+         * @param received_at Time the firmware read the bytes of the frame from the pty
+         */
+        typedef std::function<void(const uint8_t *frame, std::chrono::steady_clock::time_point received_at)>
+                FrameObserver;
+
+        /**
+         * @brief Constructor of the firmware emulator
+         * @param report_rate MOTION_STATUS frames per second, 0 to disable auto report
+         */
+        explicit FirmwareEmulator(double report_rate = 20.0);
+
+        ~FirmwareEmulator() override;
+
+        /**
+         * @brief Open the pty pair and start the firmware thread
+         * @return true if success
+         */
+        bool start();
+
+        /**
+         * @brief Stop the firmware thread, the pty pair stays open
+         */
+        void stop();
+
+        /**
+         * @brief Get the path of the pty slave, which can be passed to SerialDevice or Transbot
+         * @return Path of the pty slave, empty before start()
+         */
+        std::string get_slave_path() const;
+
+        /**
+         * @brief Get the number of valid frames the firmware has received
+         * @return Number of received frames
+         */
+        uint64_t get_received_frames() const;
+
+        /**
+         * @brief Get the number of frames the firmware has sent
+         * @return Number of sent frames
+         */
+        uint64_t get_sent_frames() const;
+
+        /**
+         * @brief Observe every frame the firmware receives, e.g. to measure when the bytes left the SDK
+         * @note Call this before start() or init(), the observer runs on the firmware thread and must not block
+         * @param observer The observer, empty to remove it
+         */
+        void set_frame_observer(FrameObserver observer);
+
+        /**
+         * @brief Start the emulator if needed and open the pty slave
+         * @return true if success
+         */
+        bool init() override;
+
+        size_t receive(uint8_t *buffer, size_t max_length) override;
+
+        size_t send(const uint8_t *buffer, size_t length) override;
+
+        bool wait_for_data(int timeout_ms) override;
+
+        void interrupt() override;
+
+        int get_event_file_descriptor() const override;
+
+    private:
+        void firmware_thread();
+
+        /**
+         * @brief Handle a complete frame sent by the SDK
+         * @param frame Frame data, including header and checksum
+         */
+        void handle_frame(const uint8_t *frame);
+
+        /**
+         * @brief Handle a SEND_REQUEST frame and send the response
+         * @param data_type Requested data type
+         * @param param Parameter of the request
+         */
+        void handle_request(uint8_t data_type, uint8_t param);
+
+        /**
+         * @brief Build a frame to the SDK and write it to the pty master
+         * @param function Receive function of the frame
+         * @param payload Payload between function byte and checksum
+         * @param payload_length Length of the payload
+         */
+        void send_frame(uint8_t function, const uint8_t *payload, uint8_t payload_length);
+
+        /**
+         * @brief Send a receive message of the codec as a frame to the SDK
+         * @param message The parameters of the frame
+         */
+        template<class Message>
+        void send_message(const Message &message)
+        {
+            send_frame(Message::FUNCTION, reinterpret_cast<const uint8_t *>(&message), sizeof(Message));
+        }
+
+        void send_motion_status();
+
+        //! MOTION_STATUS frames per second
+        double m_report_rate;
+        //! pty master, the firmware side
+        int m_master_fd;
+        //! pty slave kept open so that the master never reads EIO while the SDK reconnects
+        int m_slave_fd;
+        //! eventfd to stop the firmware thread
+        int m_wakeup_fd;
+        std::string m_slave_path;
+        std::atomic<bool> m_is_running;
+        std::thread m_firmware_thread;
+        //! the SDK side of the pty, used when the emulator is used as a HardwareInterface
+        std::unique_ptr<SerialDevice> m_device;
+
+        FrameObserver m_frame_observer;
+
+        std::atomic<uint64_t> m_received_frames;
+        std::atomic<uint64_t> m_sent_frames;
+
+        // Firmware state, only touched by the firmware thread
+        bool m_auto_report;
+        bool m_gyro_assist;
+        int8_t m_linear_velocity;
+        int16_t m_angular_velocity;
+        uint16_t m_yaw;
+        uint16_t m_pid[3];
+        //! position of bus servos, indexed by servo id
+        uint16_t m_servo_position[256];
+    };
+} // transbot_sdk
+
+#endif //TRANSBOT_SDK_FIRMWARE_EMULATOR_HPP
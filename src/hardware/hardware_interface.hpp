@@ -5,6 +5,7 @@
 #ifndef TRANSBOT_SDK_HARDWARE_INTERFACE_HPP
 #define TRANSBOT_SDK_HARDWARE_INTERFACE_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -32,13 +33,50 @@ namespace transbot_sdk
          * @param length length of the buffer
          * @return Length of the sent data
          */
-        virtual size_t send(uint8_t *buffer, size_t length) = 0;
+        virtual size_t send(const uint8_t *buffer, size_t length) = 0;
 
         /**
          * @brief Initialize hardware
          * @return true if success
          */
         virtual bool init() = 0;
+
+        /**
+         * @brief Wait until data is available to receive
+         * @details Hardware that cannot be waited on returns immediately, and receive() is expected to block or poll.
+         * @param timeout_ms Max time to wait in milliseconds, -1 to wait forever
+         * @return true if data is available, false on timeout or if woken up by interrupt()
+         */
+        virtual bool wait_for_data(int timeout_ms)
+        {
+            (void) timeout_ms;
+            return true;
+        }
+
+        /**
+         * @brief Wake up a thread blocked in wait_for_data() or receive()
+         */
+        virtual void interrupt()
+        {}
+
+        /**
+         * @brief Get a descriptor which is readable whenever wait_for_data(0) would return true or has been
+         * interrupted, so that an IoLoop can wait on the hardware instead of a receive thread of its own
+         * @return The descriptor, valid after init(), -1 if the hardware can only be waited on by wait_for_data()
+         */
+        virtual int get_event_file_descriptor() const
+        {
+            return -1;
+        }
+
+        /**
+         * @brief Get the baud rate, used to pace the frames sent to the firmware
+         * @return Baud rate in bits per second
+         */
+        virtual int get_baud_rate() const
+        {
+            return 115200;
+        }
     };
 
 } // transbot_sdk
@@ -0,0 +1,192 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include "io_loop.hpp"
+#include "log/async_log.hpp"
+
+namespace transbot_sdk
+{
+    IoLoop::IoLoop()
+    {
+        m_epoll_file_descriptor = -1;
+        m_wakeup_file_descriptor = -1;
+        m_next_id = 1;
+        m_is_running = false;
+    }
+
+    IoLoop::~IoLoop()
+    {
+        m_is_running = false;
+        if (m_thread.joinable())
+        {
+            wake_up();
+            m_thread.join();
+        }
+        if (m_epoll_file_descriptor >= 0)
+        {
+            close(m_epoll_file_descriptor);
+        }
+        if (m_wakeup_file_descriptor >= 0)
+        {
+            close(m_wakeup_file_descriptor);
+        }
+    }
+
+    bool IoLoop::start()
+    {
+        if (m_epoll_file_descriptor >= 0)
+        {
+            // A previous start() failed half way
+            close(m_epoll_file_descriptor);
+        }
+        m_epoll_file_descriptor = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_file_descriptor < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Create epoll instance failed, errno: {}", errno);
+            return false;
+        }
+        if (m_wakeup_file_descriptor < 0)
+        {
+            m_wakeup_file_descriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        }
+        if (m_wakeup_file_descriptor < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Create wakeup event failed, errno: {}", errno);
+            return false;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = 0;
+        if (epoll_ctl(m_epoll_file_descriptor, EPOLL_CTL_ADD, m_wakeup_file_descriptor, &event) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Watch wakeup event failed, errno: {}", errno);
+            return false;
+        }
+        m_is_running = true;
+        TRANSBOT_LOG(INFO, "Start io loop thread.");
+        m_thread = std::thread(&IoLoop::loop_thread, this);
+        return true;
+    }
+
+    uint64_t IoLoop::add(int file_descriptor, Handler handler)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_is_running && !start())
+        {
+            return 0;
+        }
+        uint64_t id = m_next_id++;
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        if (epoll_ctl(m_epoll_file_descriptor, EPOLL_CTL_ADD, file_descriptor, &event) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Watch descriptor {} failed, errno: {}", file_descriptor, errno);
+            return 0;
+        }
+        // Called right away, so that it can report its first deadline
+        m_registrations[id] = Registration{file_descriptor, std::move(handler), std::chrono::steady_clock::now()};
+        lock.unlock();
+        wake_up();
+        return id;
+    }
+
+    void IoLoop::remove(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_registrations.find(id);
+        if (it == m_registrations.end())
+        {
+            return;
+        }
+        // Events of the descriptor already taken from epoll are dropped, their id is not found anymore
+        epoll_ctl(m_epoll_file_descriptor, EPOLL_CTL_DEL, it->second.file_descriptor, nullptr);
+        m_registrations.erase(it);
+    }
+
+    size_t IoLoop::size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_registrations.size();
+    }
+
+    void IoLoop::wake_up()
+    {
+        uint64_t count = 1;
+        if (write(m_wakeup_file_descriptor, &count, sizeof(count)) < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Write wakeup event failed, errno: {}", errno);
+        }
+    }
+
+    void IoLoop::call(Registration &registration, std::chrono::steady_clock::time_point now)
+    {
+        int timeout_ms = registration.handler();
+        registration.next_call = timeout_ms < 0 ? std::chrono::steady_clock::time_point::max()
+                                                : now + std::chrono::milliseconds(timeout_ms);
+    }
+
+    void IoLoop::loop_thread()
+    {
+        TRANSBOT_LOG(INFO, "Io loop thread started.");
+        struct epoll_event events[MAX_EVENTS];
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_is_running)
+        {
+            // Sleep until a descriptor is readable or the earliest handler asked to be called
+            auto next_call = std::chrono::steady_clock::time_point::max();
+            for (const auto &registration: m_registrations)
+            {
+                next_call = std::min(next_call, registration.second.next_call);
+            }
+            int timeout_ms = -1;
+            if (next_call != std::chrono::steady_clock::time_point::max())
+            {
+                auto remaining = next_call - std::chrono::steady_clock::now();
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(remaining);
+                if (wait < remaining)
+                {
+                    // Round up, waking up early would only call nothing and wait again
+                    wait += std::chrono::milliseconds(1);
+                }
+                timeout_ms = static_cast<int>(std::max<int64_t>(wait.count(), 0));
+            }
+            lock.unlock();
+            int ready = epoll_wait(m_epoll_file_descriptor, events, MAX_EVENTS, timeout_ms);
+            if (ready < 0 && errno != EINTR)
+            {
+                TRANSBOT_LOG(ERROR, "Wait in io loop failed, errno: {}", errno);
+            }
+            auto now = std::chrono::steady_clock::now();
+            lock.lock();
+
+            for (int i = 0; i < ready; i++)
+            {
+                if (events[i].data.u64 == 0)
+                {
+                    uint64_t count;
+                    if (read(m_wakeup_file_descriptor, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    {
+                        TRANSBOT_LOG(ERROR, "Read wakeup event failed, errno: {}", errno);
+                    }
+                    continue;
+                }
+                auto it = m_registrations.find(events[i].data.u64);
+                if (it != m_registrations.end())
+                {
+                    call(it->second, now);
+                }
+            }
+            for (auto &registration: m_registrations)
+            {
+                if (registration.second.next_call <= now)
+                {
+                    call(registration.second, now);
+                }
+            }
+        }
+        TRANSBOT_LOG(INFO, "Io loop thread stopped.");
+    }
+} // transbot_sdk
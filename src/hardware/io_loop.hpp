@@ -0,0 +1,108 @@
+#ifndef TRANSBOT_SDK_IO_LOOP_HPP
+#define TRANSBOT_SDK_IO_LOOP_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace transbot_sdk
+{
+    /**
+     * @brief A single thread waiting in epoll on the hardware of many robots, instead of a receive thread per robot
+     * @details Protocols constructed with the loop register the descriptor of their hardware (see
+     * HardwareInterface::get_event_file_descriptor()) and a handler. The thread calls the handler when the descriptor
+     * is readable, or when the time the handler asked to be called again has come, e.g. the deadline of a request. A
+     * handler must not block, it holds up every other robot of the loop. To spread many robots over several cpus, create
+     * a few loops and give each a share of the robots.
+     */
+    class IoLoop
+    {
+    public:
+        /**
+         * @brief Services a registered descriptor, called on the thread of the loop
+         * @return Milliseconds until the handler must be called again even if the descriptor is not readable, -1 for
+         * only when it is readable
+         */
+        typedef std::function<int()> Handler;
+
+        IoLoop();
+
+        ~IoLoop();
+
+        IoLoop(const IoLoop &) = delete;
+
+        IoLoop &operator=(const IoLoop &) = delete;
+
+        /**
+         * @brief Watch a descriptor, the thread of the loop is started on the first call
+         * @param file_descriptor Descriptor to wait for, level-triggered
+         * @param handler Called when the descriptor is readable, and once right away
+         * @return Id of the registration, 0 if the descriptor cannot be watched
+         */
+        uint64_t add(int file_descriptor, Handler handler);
+
+        /**
+         * @brief Stop watching a descriptor, returns once its handler is not running anymore
+         * @note Must not be called from a handler
+         * @param id Id returned by add()
+         */
+        void remove(uint64_t id);
+
+        /**
+         * @brief Get the number of descriptors watched
+         * @return Number of registrations
+         */
+        size_t size() const;
+
+    private:
+        /**
+         * @brief A watched descriptor
+         */
+        typedef struct _registration
+        {
+            int file_descriptor;
+            Handler handler;
+            //! time the handler asked to be called again, max if only when the descriptor is readable
+            std::chrono::steady_clock::time_point next_call;
+        } Registration;
+
+        //! most events taken from epoll at once
+        static const int MAX_EVENTS = 64;
+
+        /**
+         * @brief Create the epoll instance and the wakeup event, and start the thread
+         * @return false if the epoll instance or the event cannot be created
+         */
+        bool start();
+
+        /**
+         * @brief Wake up the thread, to pick up a new registration or to stop
+         */
+        void wake_up();
+
+        /**
+         * @brief Call a handler and store when it must be called again
+         * @param registration The registration
+         * @param now Time the loop woke up
+         */
+        static void call(Registration &registration, std::chrono::steady_clock::time_point now);
+
+        void loop_thread();
+
+        int m_epoll_file_descriptor;
+        //! eventfd written to wake up the thread, watched with id 0
+        int m_wakeup_file_descriptor;
+        //! held while handlers run, so that remove() waits for a running handler
+        mutable std::mutex m_mutex;
+        std::unordered_map<uint64_t, Registration> m_registrations;
+        uint64_t m_next_id;
+        std::atomic<bool> m_is_running;
+        std::thread m_thread;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_IO_LOOP_HPP
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include "replay_device.hpp"
+#include "log/async_log.hpp"
+#include "protocol/flight_recorder.hpp"
+
+namespace transbot_sdk
+{
+    const uint64_t ReplayDevice::MAX_RECORDING_GAP_NS;
+
+    ReplayDevice::ReplayDevice(double speed, int baud_rate)
+    {
+        m_speed = speed;
+        m_baud_rate = baud_rate;
+        m_next_chunk = 0;
+        m_position = 0;
+        m_sent_bytes = 0;
+        m_interrupted = false;
+    }
+
+    bool ReplayDevice::load_recording(const std::string &path)
+    {
+        std::vector<FlightRecord> records;
+        if (!FlightRecorder::load(path, records))
+        {
+            return false;
+        }
+        m_bytes.clear();
+        m_chunks.clear();
+        uint64_t time = 0;
+        const FlightRecord *previous = nullptr;
+        for (const auto &record: records)
+        {
+            if (record.direction != RECEIVE)
+            {
+                continue;
+            }
+            if (previous != nullptr)
+            {
+                // Timestamps of different sessions cannot be compared, the steady clock may have started over
+                uint64_t gap = record.session == previous->session ? record.timestamp - previous->timestamp
+                                                                    : MAX_RECORDING_GAP_NS;
+                time += std::min(gap, MAX_RECORDING_GAP_NS);
+            }
+            previous = &record;
+            m_bytes.insert(m_bytes.end(), record.frame.begin(), record.frame.begin() + record.length);
+            m_chunks.push_back(Chunk{time, m_bytes.size()});
+        }
+        TRANSBOT_LOG(INFO, "Loaded {} received frames from {}", m_chunks.size(), path);
+        return true;
+    }
+
+    bool ReplayDevice::load_dump(const std::string &path)
+    {
+        std::ifstream dump(path, std::ios::binary);
+        if (!dump)
+        {
+            TRANSBOT_LOG(ERROR, "Open dump {} failed.", path);
+            return false;
+        }
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(dump)), std::istreambuf_iterator<char>());
+        load_bytes(bytes.data(), bytes.size());
+        TRANSBOT_LOG(INFO, "Loaded {} bytes from {}", bytes.size(), path);
+        return true;
+    }
+
+    void ReplayDevice::load_bytes(const uint8_t *bytes, size_t length)
+    {
+        m_bytes.assign(bytes, bytes + length);
+        m_chunks.clear();
+        // A start bit, 8 data bits and a stop bit per byte, a chunk is available once its last byte has arrived
+        const uint64_t byte_time = 10 * 1000000000ULL / m_baud_rate;
+        for (size_t begin = 0; begin < length; begin += DUMP_CHUNK_SIZE)
+        {
+            size_t end = std::min(begin + DUMP_CHUNK_SIZE, length);
+            m_chunks.push_back(Chunk{end * byte_time, end});
+        }
+    }
+
+    bool ReplayDevice::init()
+    {
+        if (m_chunks.empty())
+        {
+            TRANSBOT_LOG(ERROR, "Nothing to replay.");
+            return false;
+        }
+        m_next_chunk = 0;
+        m_position = 0;
+        m_start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point ReplayDevice::due_time(size_t chunk) const
+    {
+        if (m_speed <= 0)
+        {
+            return m_start;
+        }
+        auto time = std::chrono::nanoseconds(static_cast<int64_t>(m_chunks[chunk].time / m_speed));
+        return m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(time);
+    }
+
+    size_t ReplayDevice::receive(uint8_t *buffer, size_t max_length)
+    {
+        auto now = std::chrono::steady_clock::now();
+        size_t position = m_position.load(std::memory_order_relaxed);
+        size_t length = 0;
+        // Everything due so far, a chunk which does not fit is continued by the next call
+        while (m_next_chunk < m_chunks.size() && due_time(m_next_chunk) <= now)
+        {
+            size_t end = m_chunks[m_next_chunk].end;
+            if (end - position > max_length)
+            {
+                length = max_length;
+                break;
+            }
+            length = end - position;
+            m_next_chunk++;
+        }
+        std::copy(m_bytes.begin() + position, m_bytes.begin() + position + length, buffer);
+        m_position.store(position + length, std::memory_order_relaxed);
+        return length;
+    }
+
+    size_t ReplayDevice::send(const uint8_t *buffer, size_t length)
+    {
+        (void) buffer;
+        m_sent_bytes.fetch_add(length, std::memory_order_relaxed);
+        return length;
+    }
+
+    bool ReplayDevice::wait_for_data(int timeout_ms)
+    {
+        auto deadline = timeout_ms < 0 ? std::chrono::steady_clock::time_point::max()
+                                       : std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        bool finished = m_next_chunk >= m_chunks.size();
+        auto due = finished ? std::chrono::steady_clock::time_point::max() : due_time(m_next_chunk);
+
+        auto wake_time = std::min(due, deadline);
+        auto is_interrupted = [this]
+        {
+            return m_interrupted;
+        };
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool interrupted;
+        if (wake_time == std::chrono::steady_clock::time_point::max())
+        {
+            // Nothing left to replay and no timeout
+            m_condition.wait(lock, is_interrupted);
+            interrupted = true;
+        }
+        else
+        {
+            interrupted = m_condition.wait_until(lock, wake_time, is_interrupted);
+        }
+        if (interrupted)
+        {
+            m_interrupted = false;
+            return false;
+        }
+        // Woken up by the time, either the bytes are due or the timeout has expired
+        return !finished && due <= std::chrono::steady_clock::now();
+    }
+
+    void ReplayDevice::interrupt()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_interrupted = true;
+        m_condition.notify_all();
+    }
+
+    int ReplayDevice::get_baud_rate() const
+    {
+        return m_baud_rate;
+    }
+
+    bool ReplayDevice::is_finished() const
+    {
+        return m_position.load(std::memory_order_relaxed) >= m_bytes.size();
+    }
+
+    uint64_t ReplayDevice::get_replayed_bytes() const
+    {
+        return m_position.load(std::memory_order_relaxed);
+    }
+
+    uint64_t ReplayDevice::get_sent_bytes() const
+    {
+        return m_sent_bytes.load(std::memory_order_relaxed);
+    }
+} // transbot_sdk
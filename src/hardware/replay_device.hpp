@@ -0,0 +1,149 @@
+#ifndef TRANSBOT_SDK_REPLAY_DEVICE_HPP
+#define TRANSBOT_SDK_REPLAY_DEVICE_HPP
+
+#include "hardware_interface.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Hardware replaying captured traffic from the robot, e.g. to measure the parser or reproduce a field failure
+     * @details The capture is a file of FlightRecorder, whose received frames are replayed at the time they were
+     * recorded, or a raw dump of the serial port, e.g. by `cat /dev/ttyTHS1 > dump`, whose bytes are replayed at the baud
+     * rate. Bytes are replayed as they are, so corrupted bursts reach the parser like they did on the wire. The replay
+     * starts with init(), and frames sent to it are discarded.
+     */
+    class ReplayDevice : public HardwareInterface
+    {
+    public:
+        /**
+         * @brief Constructor of the replay device
+         * @param speed 1 for the original timing, 2 for twice as fast, etc., 0 for as fast as receive() is called
+         * @param baud_rate Baud rate giving the timing of raw dumps
+         */
+        explicit ReplayDevice(double speed = 1.0, int baud_rate = 115200);
+
+        ~ReplayDevice() override = default;
+
+        /**
+         * @brief Load the received frames of a FlightRecorder file, replacing what has been loaded
+         * @details Frames are replayed in the order of the recorder, pauses longer than MAX_RECORDING_GAP_NS are cut,
+         * and the sessions of a resumed file follow each other after that pause.
+         * @param path Path of the file
+         * @return false if the file cannot be read
+         */
+        bool load_recording(const std::string &path);
+
+        /**
+         * @brief Load a raw dump of the serial port, replacing what has been loaded
+         * @param path Path of the dump
+         * @return false if the file cannot be read
+         */
+        bool load_dump(const std::string &path);
+
+        /**
+         * @brief Load bytes to replay at the baud rate, replacing what has been loaded
+         * @param bytes The bytes
+         * @param length Number of bytes
+         */
+        void load_bytes(const uint8_t *bytes, size_t length);
+
+        /**
+         * @brief Start the replay
+         * @return false if nothing has been loaded
+         */
+        bool init() override;
+
+        /**
+         * @brief Copy the bytes whose time has come
+         * @param buffer A created buffer to store the bytes
+         * @param max_length Max length of the buffer
+         * @return Number of bytes copied, 0 before the next bytes are due or when the replay is finished
+         */
+        size_t receive(uint8_t *buffer, size_t max_length) override;
+
+        /**
+         * @brief Discard bytes sent to the robot
+         * @return length, the bytes are counted by get_sent_bytes()
+         */
+        size_t send(const uint8_t *buffer, size_t length) override;
+
+        /**
+         * @brief Sleep until the next bytes are due, the timeout expires or interrupt() is called
+         * @param timeout_ms Max time to wait in milliseconds, -1 to wait forever
+         * @return true if bytes are due
+         */
+        bool wait_for_data(int timeout_ms) override;
+
+        void interrupt() override;
+
+        int get_baud_rate() const override;
+
+        /**
+         * @brief Decide whether every byte loaded has been received
+         * @return true once the replay is finished
+         */
+        bool is_finished() const;
+
+        /**
+         * @brief Get the number of bytes received from the replay so far
+         * @return Number of bytes
+         */
+        uint64_t get_replayed_bytes() const;
+
+        /**
+         * @brief Get the number of bytes sent to the replay and discarded so far
+         * @return Number of bytes
+         */
+        uint64_t get_sent_bytes() const;
+
+    private:
+        /**
+         * @brief Bytes which became available at the same time
+         */
+        typedef struct _chunk
+        {
+            //! time since the start of the capture, in nanoseconds
+            uint64_t time;
+            //! end of the bytes in m_bytes, the chunk starts at the end of the previous one
+            size_t end;
+        } Chunk;
+
+        //! bytes of a raw dump made available together, like the receive FIFO of a UART
+        static const size_t DUMP_CHUNK_SIZE = 16;
+        //! longest pause replayed between two frames of a recording, e.g. the downtime between two sessions is cut to it
+        static const uint64_t MAX_RECORDING_GAP_NS = 1000000000;
+
+        /**
+         * @brief Get the time a chunk is due
+         * @param chunk Index of the chunk
+         * @return Time the chunk is due on the steady clock
+         */
+        std::chrono::steady_clock::time_point due_time(size_t chunk) const;
+
+        double m_speed;
+        int m_baud_rate;
+        //! every byte of the capture
+        std::vector<uint8_t> m_bytes;
+        //! chunks of m_bytes in order of time
+        std::vector<Chunk> m_chunks;
+        std::chrono::steady_clock::time_point m_start;
+        //! next chunk to receive, only touched by the receive thread
+        size_t m_next_chunk;
+        //! position of the next byte to receive, only written by the receive thread
+        std::atomic<size_t> m_position;
+        std::atomic<uint64_t> m_sent_bytes;
+        //! mutex wait_for_data() sleeps on
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        //! set by interrupt() and cleared by the wait it ends
+        bool m_interrupted;
+    };
+} // transbot_sdk
+
+#endif //TRANSBOT_SDK_REPLAY_DEVICE_HPP
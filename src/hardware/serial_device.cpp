@@ -1,30 +1,256 @@
-#include <glog/logging.h>
 #include <termios.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <cerrno>
 #include "serial_device.hpp"
+#include "log/async_log.hpp"
 
 namespace transbot_sdk
 {
+    namespace
+    {
+        /**
+         * @brief Map a baud rate to the termios speed constant
+         * @param baud_rate Baud rate in bits per second
+         * @param speed Set to the constant
+         * @return false if termios has no constant for the baud rate
+         */
+        bool to_speed(int baud_rate, speed_t &speed)
+        {
+            switch (baud_rate)
+            {
+                case 9600: speed = B9600; return true;
+                case 19200: speed = B19200; return true;
+                case 38400: speed = B38400; return true;
+                case 57600: speed = B57600; return true;
+                case 115200: speed = B115200; return true;
+                case 230400: speed = B230400; return true;
+                case 460800: speed = B460800; return true;
+                case 500000: speed = B500000; return true;
+                case 576000: speed = B576000; return true;
+                case 921600: speed = B921600; return true;
+                case 1000000: speed = B1000000; return true;
+                case 1152000: speed = B1152000; return true;
+                case 1500000: speed = B1500000; return true;
+                case 2000000: speed = B2000000; return true;
+                default: return false;
+            }
+        }
+    }
+
     bool SerialDevice::init()
     {
-        if (open_device())
+        // The transmit pacing trusts get_baud_rate(), so the line must run at exactly that rate
+        speed_t speed;
+        if (!to_speed(this->baud_rate, speed))
         {
-            LOG(INFO) << "Open serial device " << this->port_name << " successfully.";
-        } else
+            TRANSBOT_LOG(FATAL, "Baud rate {} is not supported.", this->baud_rate);
+            return false;
+        }
+        if (!reopen())
         {
-            LOG(FATAL) << "Open serial device " << this->port_name << " failed.";
+            TRANSBOT_LOG(FATAL, "Initialize serial device {} failed.", this->port_name);
             return false;
         }
+        return true;
+    }
 
+    bool SerialDevice::reopen()
+    {
+        if (!open_device())
+        {
+            return false;
+        }
+        if (!open_event_loop())
+        {
+            TRANSBOT_LOG(ERROR, "Create event loop for serial device {} failed.", this->port_name);
+            return false;
+        }
+        if (!configure_device())
+        {
+            return false;
+        }
+        TRANSBOT_LOG(INFO, "Open serial device {} successfully.", this->port_name);
+        return true;
+    }
+
+    bool SerialDevice::open_device()
+    {
+        if (serial_file_descriptor >= 0)
+        {
+            // Reconnecting, the old port keeps reporting its hang up until it is not watched anymore
+            epoll_ctl(epoll_file_descriptor, EPOLL_CTL_DEL, serial_file_descriptor, nullptr);
+        }
+        int file_descriptor = open(this->port_name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+        if (file_descriptor < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Open serial device {} failed.", this->port_name);
+            return false;
+        }
+        if (serial_file_descriptor < 0)
+        {
+            serial_file_descriptor = file_descriptor;
+            return true;
+        }
+        // The transmit thread may be writing to the old port. Closing it would free its number for the port of
+        // another robot, so the new port takes over the number instead, and send() only ever writes to this port.
+        if (dup2(file_descriptor, serial_file_descriptor) < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Replace descriptor of serial device {} failed, errno: {}", this->port_name, errno);
+            close(file_descriptor);
+            return false;
+        }
+        close(file_descriptor);
+        return true;
+    }
+
+    bool SerialDevice::open_event_loop()
+    {
+        if (epoll_file_descriptor < 0)
+        {
+            epoll_file_descriptor = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_file_descriptor < 0)
+            {
+                TRANSBOT_LOG(ERROR, "Create epoll instance failed, errno: {}", errno);
+                return false;
+            }
+        }
+        if (wakeup_file_descriptor < 0)
+        {
+            wakeup_file_descriptor = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (wakeup_file_descriptor < 0)
+            {
+                TRANSBOT_LOG(ERROR, "Create wakeup event failed, errno: {}", errno);
+                return false;
+            }
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = wakeup_file_descriptor;
+            if (epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, wakeup_file_descriptor, &event) != 0)
+            {
+                TRANSBOT_LOG(ERROR, "Watch wakeup event failed, errno: {}", errno);
+                return false;
+            }
+        }
+        if (reconnect_file_descriptor < 0)
+        {
+            reconnect_file_descriptor = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+            if (reconnect_file_descriptor < 0)
+            {
+                TRANSBOT_LOG(ERROR, "Create reconnect timer failed, errno: {}", errno);
+                return false;
+            }
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = reconnect_file_descriptor;
+            if (epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, reconnect_file_descriptor, &event) != 0)
+            {
+                TRANSBOT_LOG(ERROR, "Watch reconnect timer failed, errno: {}", errno);
+                return false;
+            }
+        }
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = serial_file_descriptor;
+        if (epoll_ctl(epoll_file_descriptor, EPOLL_CTL_ADD, serial_file_descriptor, &event) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Watch serial device {} failed, errno: {}", this->port_name, errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool SerialDevice::wait_for_data(int timeout_ms)
+    {
+        struct epoll_event events[2];
+        int ready = epoll_wait(epoll_file_descriptor, events, 2, timeout_ms);
+        bool readable = false;
+        for (int i = 0; i < ready; i++)
+        {
+            if (events[i].data.fd == wakeup_file_descriptor)
+            {
+                // Woken up by interrupt(), let the caller check whether it should stop
+                uint64_t count;
+                if (read(wakeup_file_descriptor, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                {
+                    TRANSBOT_LOG(ERROR, "Read wakeup event failed, errno: {}", errno);
+                }
+                return false;
+            }
+            if (events[i].data.fd == reconnect_file_descriptor)
+            {
+                // The next reconnect attempt is due, receive() makes it
+                uint64_t expirations;
+                if (read(reconnect_file_descriptor, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+                {
+                    TRANSBOT_LOG(ERROR, "Read reconnect timer failed, errno: {}", errno);
+                }
+                readable = true;
+                continue;
+            }
+            // Hang up and errors are reported as readable too, receive() reconnects on them
+            if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR))
+            {
+                connection_lost = true;
+            }
+            readable = true;
+        }
+        return readable;
+    }
+
+    void SerialDevice::interrupt()
+    {
+        if (wakeup_file_descriptor < 0)
+        {
+            // Not initialized, nobody can be waiting
+            return;
+        }
+        uint64_t count = 1;
+        if (write(wakeup_file_descriptor, &count, sizeof(count)) < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Write wakeup event failed, errno: {}", errno);
+        }
+    }
+
+    int SerialDevice::get_baud_rate() const
+    {
+        return baud_rate;
+    }
+
+    int SerialDevice::get_event_file_descriptor() const
+    {
+        return epoll_file_descriptor;
+    }
+
+    void SerialDevice::schedule_reconnect()
+    {
+        struct itimerspec timer = {};
+        timer.it_value.tv_sec = RECONNECT_INTERVAL_MS / 1000;
+        timer.it_value.tv_nsec = (RECONNECT_INTERVAL_MS % 1000) * 1000000L;
+        if (timerfd_settime(reconnect_file_descriptor, 0, &timer, nullptr) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Schedule reconnect failed, errno: {}", errno);
+        }
+    }
+
+    bool SerialDevice::configure_device()
+    {
         if (tcgetattr(serial_file_descriptor, &serial_port_settings) != 0)
         {
-            LOG(FATAL) << "Get serial port settings failed.";
+            TRANSBOT_LOG(ERROR, "Get serial port settings failed, errno: {}", errno);
             return false;
         }
 
-        // Set baud rate to 115200
-        cfsetispeed(&serial_port_settings, B115200);
-        cfsetospeed(&serial_port_settings, B115200);
+        // Checked by init()
+        speed_t speed = B115200;
+        to_speed(this->baud_rate, speed);
+        cfsetispeed(&serial_port_settings, speed);
+        cfsetospeed(&serial_port_settings, speed);
 
         // Set data bits to 8
         serial_port_settings.c_cflag &= ~CSIZE;
@@ -36,9 +262,8 @@ namespace transbot_sdk
         // Set stop bits to 1
         serial_port_settings.c_cflag &= ~CSTOPB;
 
-        // Set wait time to 30ms
-        serial_port_settings.c_cc[VTIME] = 3;
-        // Set minimum receive bytes to 4
+        // Never block in read(), the receive thread waits in epoll until bytes arrive
+        serial_port_settings.c_cc[VTIME] = 0;
         serial_port_settings.c_cc[VMIN] = 0;
 
         // Using raw mode
@@ -54,30 +279,7 @@ namespace transbot_sdk
         // Set the new options for the port
         if (tcsetattr(serial_file_descriptor, TCSANOW, &serial_port_settings) != 0)
         {
-            LOG(FATAL) << "Set serial port settings failed.";
-            return false;
-        }
-        
-        return true;
-    }
-
-    bool SerialDevice::open_device()
-    {
-        serial_file_descriptor = open(this->port_name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
-
-        if (serial_file_descriptor < 0)
-        {
-            LOG(ERROR) << "Open serial device " << this->port_name << " failed.";
-            return false;
-        }
-        return true;
-    }
-
-    bool SerialDevice::configure_device()
-    {
-        if (tcgetattr(serial_file_descriptor, &this->serial_port_settings) != 0)
-        {
-            LOG(FATAL) << "Get serial port settings failed.";
+            TRANSBOT_LOG(ERROR, "Set serial port settings failed, errno: {}", errno);
             return false;
         }
         return true;
@@ -89,6 +291,10 @@ namespace transbot_sdk
         this->port_name = port_name;
         this->baud_rate = baud_rate;
         this->serial_file_descriptor = -1;
+        this->epoll_file_descriptor = -1;
+        this->wakeup_file_descriptor = -1;
+        this->reconnect_file_descriptor = -1;
+        this->connection_lost = false;
         this->serial_port_settings = {};
         max_retry_times = 5;
     }
@@ -97,23 +303,39 @@ namespace transbot_sdk
     {
         if (buffer == nullptr)
         {
-            LOG(ERROR) << "Buffer is nullptr.";
+            TRANSBOT_LOG(ERROR, "Buffer is nullptr.");
             return -1;
         }
-        size_t read_bytes = read(serial_file_descriptor, buffer, max_length);
-        while (read_bytes==0){
-            LOG(WARNING) << "Connection lost. Try to reconnect.";
-            while (!init()){
-                LOG(WARNING) << "Reconnect failed. Try again.";
-                usleep(1000000);
-            }
-            LOG(INFO) << "Reconnect successfully.";
-            read_bytes = read(serial_file_descriptor, buffer, max_length);
+        ssize_t read_bytes = read(serial_file_descriptor, buffer, max_length);
+        if (read_bytes > 0)
+        {
+            return read_bytes;
+        }
+        // With VMIN=0 and VTIME=0 an empty port also reads 0 bytes, only trust it as a hang up if epoll reported one
+        if (!connection_lost && (read_bytes == 0 || errno == EAGAIN || errno == EINTR))
+        {
+            return 0;
+        }
+        if (read_bytes < 0 && errno != EIO && !connection_lost)
+        {
+            TRANSBOT_LOG(ERROR, "Read serial device {} failed, errno: {}", this->port_name, errno);
+            return -1;
         }
-        return read_bytes;
+
+        TRANSBOT_LOG(WARNING, "Connection lost. Try to reconnect.");
+        if (!reopen())
+        {
+            // Not fatal unlike init(), try again when the timer makes the port readable, the waiting thread may serve other robots meanwhile
+            TRANSBOT_LOG(WARNING, "Reconnect failed. Try again in {} ms.", static_cast<int>(RECONNECT_INTERVAL_MS));
+            schedule_reconnect();
+            return 0;
+        }
+        connection_lost = false;
+        TRANSBOT_LOG(INFO, "Reconnect successfully.");
+        return 0;
     }
 
-    size_t SerialDevice::send(uint8_t *buffer, size_t length)
+    size_t SerialDevice::send(const uint8_t *buffer, size_t length)
     {
         return write(serial_file_descriptor, buffer, length);
     }
@@ -121,6 +343,18 @@ namespace transbot_sdk
     SerialDevice::~SerialDevice()
     {
         close(serial_file_descriptor);
+        if (epoll_file_descriptor >= 0)
+        {
+            close(epoll_file_descriptor);
+        }
+        if (wakeup_file_descriptor >= 0)
+        {
+            close(wakeup_file_descriptor);
+        }
+        if (reconnect_file_descriptor >= 0)
+        {
+            close(reconnect_file_descriptor);
+        }
     }
 
 
@@ -11,6 +11,11 @@ namespace transbot_sdk
     class SerialDevice : public HardwareInterface
     {
     public:
+        /**
+         * @brief Constructor of the serial device
+         * @param port_name Path of the serial port
+         * @param baud_rate Baud rate the port is configured at, one of the standard termios rates, init() fails otherwise
+         */
         explicit SerialDevice(const std::string &port_name = "/dev/ttyTHS1", int baud_rate = 115200);
 
         ~SerialDevice() override;
@@ -19,17 +24,64 @@ namespace transbot_sdk
 
         size_t receive(uint8_t* buffer, size_t max_length)  override;
 
-        size_t send(uint8_t* buffer, size_t length) override;
+        size_t send(const uint8_t* buffer, size_t length) override;
+
+        /**
+         * @brief Block in epoll until the serial port is readable or interrupt() is called
+         * @param timeout_ms Max time to wait in milliseconds, -1 to wait forever
+         * @return true if the serial port is readable or has hung up
+         */
+        bool wait_for_data(int timeout_ms) override;
+
+        void interrupt() override;
+
+        /**
+         * @brief Get the epoll instance watching the serial port, the wakeup event and the reconnect timer
+         * @details It stays the same when the serial port is reopened after the connection was lost.
+         * @return The epoll descriptor, -1 before init()
+         */
+        int get_event_file_descriptor() const override;
+
+        int get_baud_rate() const override;
 
     private:
+        //! time between attempts to reopen a serial port whose connection was lost
+        static const int RECONNECT_INTERVAL_MS = 1000;
+
         std::string port_name;
         int baud_rate;
+        //! set once by init(), a reconnect puts the new port under the same number with dup2()
         int serial_file_descriptor;
+        //! epoll instance watching the serial port and the wakeup event
+        int epoll_file_descriptor;
+        //! eventfd written by interrupt() to wake up the waiting thread
+        int wakeup_file_descriptor;
+        //! timerfd which makes the port readable when the next reconnect attempt is due
+        int reconnect_file_descriptor;
         struct termios serial_port_settings;
         int max_retry_times;
+        //! set when epoll reports a hang up or an error on the serial port
+        bool connection_lost;
+
+        /**
+         * @brief Open and configure the serial port, used by init() and to reconnect
+         * @return false if the port cannot be opened or configured, logged as an error only
+         */
+        bool reopen();
 
         bool open_device();
 
+        bool open_event_loop();
+
+        /**
+         * @brief Schedule the next reconnect attempt, so that a lost connection never blocks the waiting thread
+         */
+        void schedule_reconnect();
+
+        /**
+         * @brief Configure the opened serial port at the baud rate, raw and non-blocking
+         * @return false if the settings cannot be read or applied
+         */
         bool configure_device();
     };
 } // transbot_sdk
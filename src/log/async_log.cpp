@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "async_log.hpp"
+
+namespace transbot_sdk
+{
+    AsyncLog &AsyncLog::instance()
+    {
+        // Never destroyed, objects destroyed at exit may log after any static object of the sdk is gone
+        static AsyncLog *sink = []
+        {
+            auto created = new AsyncLog();
+            std::atexit([]
+                        {
+                            AsyncLog::instance().stop();
+                        });
+            return created;
+        }();
+        return *sink;
+    }
+
+    AsyncLog::AsyncLog() : m_queue(QUEUE_SIZE)
+    {
+        m_is_running = true;
+        m_drain_waiting = false;
+        m_dropped_messages = 0;
+        m_reported_drops = 0;
+        m_flush_requested = 0;
+        m_flush_completed = 0;
+        m_drain_thread = std::thread(&AsyncLog::drain_thread, this);
+    }
+
+    void AsyncLog::add_argument(Record &record, bool value)
+    {
+        LogArgument &argument = record.arguments[record.argument_count++];
+        argument.type = LogArgument::BOOLEAN;
+        argument.boolean_value = value;
+    }
+
+    void AsyncLog::add_argument(Record &record, const char *value)
+    {
+        add_text(record, value == nullptr ? "(null)" : value, value == nullptr ? 6 : strlen(value));
+    }
+
+    void AsyncLog::add_argument(Record &record, const std::string &value)
+    {
+        add_text(record, value.data(), value.size());
+    }
+
+    void AsyncLog::add_text(Record &record, const char *value, size_t length)
+    {
+        LogArgument &argument = record.arguments[record.argument_count++];
+        argument.type = LogArgument::TEXT;
+        size_t copied = std::min(length, TEXT_SIZE - record.text_length);
+        memcpy(record.text + record.text_length, value, copied);
+        argument.text.offset = record.text_length;
+        argument.text.length = static_cast<uint16_t>(copied);
+        record.text_length += static_cast<uint16_t>(copied);
+    }
+
+    void AsyncLog::submit(const Record &record)
+    {
+        if (record.severity == LOG_SEVERITY_FATAL)
+        {
+            // Everything logged before explains the failure, write it before glog aborts
+            flush();
+            write(record);
+            return;
+        }
+        if (!m_is_running.load(std::memory_order_relaxed))
+        {
+            write(record);
+            return;
+        }
+        if (!m_queue.try_push(record))
+        {
+            m_dropped_messages.fetch_add(1, std::memory_order_relaxed);
+        }
+        // A dropped message wakes the thread too, so that the drop is reported
+        wake_drain_thread();
+    }
+
+    void AsyncLog::wake_drain_thread()
+    {
+        // Pairs with the fence in drain_thread(): either the thread sees the record before it sleeps, or we see that
+        // it is about to sleep and wake it up
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_drain_waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_drain_condition.notify_one();
+        }
+    }
+
+    void AsyncLog::write(const Record &record)
+    {
+        std::string message;
+        message.reserve(128);
+        int next_argument = 0;
+        for (const char *c = record.format; *c != '\0'; c++)
+        {
+            if (c[0] != '{' || c[1] != '}' || next_argument >= record.argument_count)
+            {
+                message.push_back(*c);
+                continue;
+            }
+            c++;
+            const LogArgument &argument = record.arguments[next_argument++];
+            char number[32];
+            switch (argument.type)
+            {
+                case LogArgument::SIGNED:
+                    snprintf(number, sizeof(number), "%lld", static_cast<long long>(argument.signed_value));
+                    message += number;
+                    break;
+                case LogArgument::UNSIGNED:
+                    snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(argument.unsigned_value));
+                    message += number;
+                    break;
+                case LogArgument::FLOATING:
+                    snprintf(number, sizeof(number), "%g", argument.floating_value);
+                    message += number;
+                    break;
+                case LogArgument::BOOLEAN:
+                    message += argument.boolean_value ? "true" : "false";
+                    break;
+                case LogArgument::TEXT:
+                    message.append(record.text + argument.text.offset, argument.text.length);
+                    break;
+            }
+        }
+        google::LogMessage(record.file, record.line, static_cast<google::LogSeverity>(record.severity)).stream()
+                << message;
+    }
+
+    void AsyncLog::drain()
+    {
+        Record record;
+        while (m_queue.try_pop(record))
+        {
+            write(record);
+        }
+        uint64_t dropped = m_dropped_messages.load(std::memory_order_relaxed);
+        if (dropped != m_reported_drops)
+        {
+            LOG(WARNING) << "Log queue was full, " << dropped - m_reported_drops << " messages dropped.";
+            m_reported_drops = dropped;
+        }
+    }
+
+    void AsyncLog::drain_thread()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            // Every message queued before these flush requests is in the queue now
+            uint64_t requested = m_flush_requested;
+            lock.unlock();
+            drain();
+            lock.lock();
+            m_flush_completed = requested;
+            m_flushed_condition.notify_all();
+            if (!m_is_running)
+            {
+                break;
+            }
+            // Sleep without a timeout, an idle robot is not woken up for nothing
+            m_drain_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_drain_condition.wait(lock, [this, requested]
+            {
+                return !m_queue.is_empty() || m_dropped_messages.load(std::memory_order_relaxed) != m_reported_drops ||
+                       m_flush_requested != requested || !m_is_running;
+            });
+            m_drain_waiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void AsyncLog::flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        uint64_t ticket = ++m_flush_requested;
+        m_drain_condition.notify_one();
+        // Once stopped, the background thread drains the queue a last time before it exits
+        m_flushed_condition.wait(lock, [this, ticket]
+        {
+            return m_flush_completed >= ticket || !m_is_running;
+        });
+    }
+
+    uint64_t AsyncLog::get_dropped_messages() const
+    {
+        return m_dropped_messages.load(std::memory_order_relaxed);
+    }
+
+    void AsyncLog::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_is_running)
+            {
+                return;
+            }
+            m_is_running = false;
+            m_drain_condition.notify_one();
+            m_flushed_condition.notify_all();
+        }
+        m_drain_thread.join();
+        // Messages queued while the thread stopped, later ones are written by their caller
+        drain();
+    }
+} // transbot_sdk
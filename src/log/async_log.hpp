@@ -0,0 +1,254 @@
+#ifndef TRANSBOT_SDK_ASYNC_LOG_HPP
+#define TRANSBOT_SDK_ASYNC_LOG_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include "glog/logging.h"
+#include "protocol/mpsc_queue.hpp"
+
+/**
+ * Lowest severity compiled into the sdk: 0 INFO, 1 WARNING, 2 ERROR, 3 FATAL. Messages below it are removed by the
+ * compiler together with the evaluation of their arguments. FATAL is never removed.
+ */
+#ifndef TRANSBOT_SDK_MIN_LOG_LEVEL
+#define TRANSBOT_SDK_MIN_LOG_LEVEL 0
+#endif
+
+/**
+ * @brief Log a message of the sdk without formatting it on the calling thread
+ * @details The format is a string literal where each {} is replaced by the next argument, e.g.
+ * TRANSBOT_LOG(ERROR, "Angle out of range: {}", angle). Integers, floating point numbers, bools, enums and strings can be
+ * passed, strings are copied and truncated to AsyncLog::TEXT_SIZE bytes in total.
+ * @param severity INFO, WARNING, ERROR or FATAL
+ */
+#define TRANSBOT_LOG(severity, ...) \
+    do \
+    { \
+        if (transbot_sdk::LOG_SEVERITY_##severity >= TRANSBOT_SDK_MIN_LOG_LEVEL || \
+            transbot_sdk::LOG_SEVERITY_##severity == transbot_sdk::LOG_SEVERITY_FATAL) \
+        { \
+            transbot_sdk::AsyncLog::instance().log(transbot_sdk::LOG_SEVERITY_##severity, __FILE__, __LINE__, \
+                                                   __VA_ARGS__); \
+        } \
+    } while (false)
+
+namespace transbot_sdk
+{
+    //! severities of the log, the same as those of glog
+    enum LogSeverity : int
+    {
+        LOG_SEVERITY_INFO = 0,
+        LOG_SEVERITY_WARNING = 1,
+        LOG_SEVERITY_ERROR = 2,
+        LOG_SEVERITY_FATAL = 3
+    };
+
+    /**
+     * @brief An argument of a log message, stored as it was passed
+     */
+    typedef struct _log_argument
+    {
+        enum Type : uint8_t
+        {
+            SIGNED,
+            UNSIGNED,
+            FLOATING,
+            BOOLEAN,
+            //! characters copied into the text of the record
+            TEXT
+        } type;
+        union
+        {
+            int64_t signed_value;
+            uint64_t unsigned_value;
+            double floating_value;
+            bool boolean_value;
+            struct
+            {
+                uint16_t offset;
+                uint16_t length;
+            } text;
+        };
+    } LogArgument;
+
+    /**
+     * @brief Log sink of the sdk, formatting and writing messages to glog on a background thread
+     * @details The calling thread only copies the format, which is a string literal, and the arguments into a record
+     * of a preallocated lock-free queue. A background thread sleeps until messages are queued, formats the records and
+     * writes them to glog, so a message costs the caller tens of nanoseconds instead of the microseconds of formatting
+     * and writing it. When the queue is full, messages are dropped and counted rather than blocking the caller. FATAL
+     * messages are written synchronously, after everything queued before them.
+     */
+    class AsyncLog
+    {
+    public:
+        //! most arguments of a message
+        static const int MAX_ARGUMENTS = 8;
+        //! bytes of the string arguments of a message
+        static const size_t TEXT_SIZE = 96;
+        //! messages waiting to be written
+        static const size_t QUEUE_SIZE = 2048;
+
+        /**
+         * @brief Get the log of the sdk, created with its background thread on first use
+         * @details The log lives until the process exits, so objects destroyed at exit can still log.
+         * @return The log
+         */
+        static AsyncLog &instance();
+
+        /**
+         * @brief Queue a message, safe to call from any thread, use TRANSBOT_LOG() rather than calling this
+         * @param severity Severity of the message
+         * @param file Source file of the message
+         * @param line Source line of the message
+         * @param format String literal, each {} is replaced by the next argument
+         * @param arguments Arguments of the message
+         */
+        template<class... Arguments>
+        void log(LogSeverity severity, const char *file, int line, const char *format, const Arguments &... arguments)
+        {
+            static_assert(sizeof...(arguments) <= MAX_ARGUMENTS, "Too many arguments of a log message");
+            if (severity < FLAGS_minloglevel && severity != LOG_SEVERITY_FATAL)
+            {
+                return;
+            }
+            Record record;
+            record.severity = severity;
+            record.file = file;
+            record.line = line;
+            record.format = format;
+            int expand[] = {0, (add_argument(record, arguments), 0)...};
+            (void) expand;
+            submit(record);
+        }
+
+        /**
+         * @brief Wait until every message queued before has been written
+         */
+        void flush();
+
+        /**
+         * @brief Get the number of messages dropped because the queue was full
+         * @return Number of dropped messages
+         */
+        uint64_t get_dropped_messages() const;
+
+    private:
+        /**
+         * @brief A message waiting in the queue
+         */
+        typedef struct _record
+        {
+            LogSeverity severity = LOG_SEVERITY_INFO;
+            int line = 0;
+            const char *file = nullptr;
+            const char *format = nullptr;
+            uint8_t argument_count = 0;
+            uint16_t text_length = 0;
+            LogArgument arguments[MAX_ARGUMENTS];
+            char text[TEXT_SIZE];
+        } Record;
+
+        AsyncLog();
+
+        template<class T>
+        static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+        add_argument(Record &record, const T &value)
+        {
+            LogArgument &argument = record.arguments[record.argument_count++];
+            argument.type = LogArgument::SIGNED;
+            argument.signed_value = value;
+        }
+
+        template<class T>
+        static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+        add_argument(Record &record, const T &value)
+        {
+            LogArgument &argument = record.arguments[record.argument_count++];
+            argument.type = LogArgument::UNSIGNED;
+            argument.unsigned_value = value;
+        }
+
+        template<class T>
+        static typename std::enable_if<std::is_enum<T>::value>::type add_argument(Record &record, const T &value)
+        {
+            add_argument(record, static_cast<typename std::underlying_type<T>::type>(value));
+        }
+
+        template<class T>
+        static typename std::enable_if<std::is_floating_point<T>::value>::type
+        add_argument(Record &record, const T &value)
+        {
+            LogArgument &argument = record.arguments[record.argument_count++];
+            argument.type = LogArgument::FLOATING;
+            argument.floating_value = value;
+        }
+
+        static void add_argument(Record &record, bool value);
+
+        static void add_argument(Record &record, const char *value);
+
+        static void add_argument(Record &record, const std::string &value);
+
+        /**
+         * @brief Copy characters into the text of a record as its next argument
+         * @param record The record
+         * @param value Characters to copy, truncated to the space left
+         * @param length Number of characters
+         */
+        static void add_text(Record &record, const char *value, size_t length);
+
+        /**
+         * @brief Queue a record, or write it at once if it is FATAL or the background thread has stopped
+         * @param record The record
+         */
+        void submit(const Record &record);
+
+        /**
+         * @brief Wake up the background thread if it sleeps, after a record has been queued
+         */
+        void wake_drain_thread();
+
+        /**
+         * @brief Format a record and write it to glog
+         * @param record The record
+         */
+        static void write(const Record &record);
+
+        /**
+         * @brief Write every queued record, only called by the consumer of the queue
+         */
+        void drain();
+
+        void drain_thread();
+
+        /**
+         * @brief Write what is queued and stop the background thread, called at exit
+         */
+        void stop();
+
+        MpscQueue<Record> m_queue;
+        std::atomic<bool> m_is_running;
+        std::atomic<uint64_t> m_dropped_messages;
+        //! dropped messages already reported in the log
+        uint64_t m_reported_drops;
+        //! mutex of the flush requests, the background thread sleeps on it
+        std::mutex m_mutex;
+        //! set while the background thread sleeps, so that only then a message wakes it up
+        std::atomic<bool> m_drain_waiting;
+        std::condition_variable m_drain_condition;
+        std::condition_variable m_flushed_condition;
+        //! number of flush() calls so far
+        uint64_t m_flush_requested;
+        //! flush() calls whose messages have all been written
+        uint64_t m_flush_completed;
+        std::thread m_drain_thread;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_ASYNC_LOG_HPP
@@ -1,79 +1,145 @@
 #ifndef TRANSBOT_SDK_CIRCULAR_BUFFER_HPP
 #define TRANSBOT_SDK_CIRCULAR_BUFFER_HPP
 
+#include <atomic>
 #include <memory>
-#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
 /**
- * @brief CircularBuffer for certain command
+ * @brief Lock-free CircularBuffer for certain command
+ * @details One thread pushes, one thread (or several with MultiConsumer) pops. Each slot carries a sequence number: it
+ * equals the position for a free slot, position + 1 for a slot holding the item of that position, and is advanced by
+ * the capacity once the item has been taken. When the buffer is full and overwriting is enabled, the producer claims
+ * the oldest item the same way a consumer does and writes over it.
  * @tparam T Certain Data type in_use in the buffer
+ * @tparam MultiConsumer True if several threads pop from the buffer
  */
-template<class T>
+template<class T, bool MultiConsumer = false>
 class CircularBuffer
 {
 public:
     /**
      * @brief Constructor of circular buffer
-     * @param size
+     * @param size Capacity, rounded up to a power of two
+     * @param overwrite True to drop the oldest item when pushing into a full buffer, false to reject the new item
      */
-    explicit CircularBuffer(size_t size) :
-            buffer(std::unique_ptr<T[]>(new T[size])),
-            head(0),
-            tail(0),
-            max_size(size),
-            full(false)
-    {}
+    explicit CircularBuffer(size_t size, bool overwrite = true) :
+            overwrite(overwrite)
+    {
+        max_size = 1;
+        while (max_size < size)
+        {
+            max_size <<= 1;
+        }
+        mask = max_size - 1;
+        buffer = std::unique_ptr<Slot[]>(new Slot[max_size]);
+        for (size_t i = 0; i < max_size; i++)
+        {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
 
     /**
-     * @brief push the data into the buffer
+     * @brief push the data into the buffer, only the producer thread may call this
      * @param item Item to be pushed into the buffer
+     * @return false if the buffer is full and overwriting is disabled
      */
-    void push(T item)
+    bool push(T item)
     {
-        std::lock_guard<std::mutex> lock(mutex);
-
-        buffer[head] = item;
-
-        if (full)
+        size_t position = head.load(std::memory_order_relaxed);
+        Slot &slot = buffer[position & mask];
+        while (true)
         {
-            tail = (tail + 1) % max_size;
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                // Free slot
+                break;
+            }
+            if (!overwrite)
+            {
+                return false;
+            }
+            // Full: the slot holds the oldest item, take it away from the consumers before writing over it
+            size_t oldest = position - max_size;
+            if (sequence == oldest + 1 &&
+                tail.compare_exchange_strong(oldest, oldest + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+            // A consumer has just claimed the oldest item and frees the slot as soon as it has read it
+            std::this_thread::yield();
         }
 
-        head = (head + 1) % max_size;
+        slot.item = std::move(item);
+        slot.sequence.store(position + 1, std::memory_order_release);
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
 
-        full = head == tail;
+    /**
+     * @brief pop the oldest data from the buffer
+     * @param item Set to the popped item
+     * @return True if buffer is not empty
+     */
+    bool try_pop(T &item)
+    {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot &slot = buffer[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (claim(position))
+                {
+                    item = std::move(slot.item);
+                    slot.item = T();
+                    slot.sequence.store(position + max_size, std::memory_order_release);
+                    return true;
+                }
+                // Lost the item to another consumer or to the producer, position has been reloaded
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                // The item has been overwritten or taken, catch up
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
     }
 
     /**
      * @brief pop the data from the buffer and get the popped item
-     * @param item Item to be popped from the buffer
-     * @return True if buffer is not empty
+     * @return The popped item
+     * @throw std::length_error if the buffer is empty
      */
     T pop()
     {
-        std::lock_guard<std::mutex> lock(mutex);
-
-        if (is_empty())
+        T item;
+        if (!try_pop(item))
         {
             throw std::length_error("Buffer is empty");
         }
-
-        //Read data and advance the tail (we now have a free space)
-        auto item = buffer[tail];
-        full = false;
-        tail = (tail + 1) % max_size;
-
         return item;
     }
 
     /**
-     * @brief reset the buffer
+     * @brief reset the buffer, only a consumer thread may call this
      */
     void reset()
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        head = tail;
-        full = false;
+        T item;
+        while (try_pop(item))
+        {}
     }
 
     /**
@@ -82,8 +148,7 @@ public:
      */
     bool is_empty() const
     {
-        //if head and tail are equal, we are empty
-        return (!full && (head == tail));
+        return size() == 0;
     }
 
     /**
@@ -92,8 +157,7 @@ public:
      */
     bool is_full() const
     {
-        //If tail is ahead the head by 1, we are full
-        return full;
+        return size() == max_size;
     }
 
     /**
@@ -106,41 +170,60 @@ public:
     }
 
     /**
-     * @brief Get the current size of the buffer
+     * @brief Get the current size of the buffer, a snapshot while other threads push or pop
      * @return The current size of the buffer
      */
     size_t size() const
     {
-        size_t size = max_size;
-
-        if (!full)
+        size_t current_tail = tail.load(std::memory_order_acquire);
+        size_t current_head = head.load(std::memory_order_acquire);
+        if (current_head <= current_tail)
         {
-            if (head >= tail)
-            {
-                size = head - tail;
-            }
-            else
-            {
-                size = max_size + head - tail;
-            }
+            return 0;
         }
-
-        return size;
+        return current_head - current_tail < max_size ? current_head - current_tail : max_size;
     }
 
 private:
-    //! mutex of the buffer
-    std::mutex mutex;
-    //! buffer pointer
-    std::unique_ptr<T[]> buffer;
-    //! buffer head
-    size_t head;
-    //! buffer tail
-    size_t tail;
-    //! buffer capacity
+    typedef struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    } Slot;
+
+    /**
+     * @brief Take the item at a position for this consumer
+     * @param position Position of the item, reloaded if the claim fails
+     * @return True if the item belongs to this consumer
+     */
+    bool claim(size_t &position)
+    {
+        if (!MultiConsumer && !overwrite)
+        {
+            // Nobody else moves the tail
+            tail.store(position + 1, std::memory_order_relaxed);
+            return true;
+        }
+        return tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed);
+    }
+
+    //! buffer slots
+    std::unique_ptr<Slot[]> buffer;
+    //! buffer capacity, a power of two
     size_t max_size;
-    //! flag of full buffer
-    bool full;
+    //! buffer capacity - 1, to map positions to slots
+    size_t mask;
+    //! flag of dropping the oldest item when full
+    bool overwrite;
+    //! keep the positions off the cache line of the read-only members
+    char padding_0[64];
+    //! buffer head, next position to push
+    std::atomic<size_t> head;
+    //! keep the producer and the consumers on different cache lines
+    char padding_1[64 - sizeof(std::atomic<size_t>)];
+    //! buffer tail, next position to pop
+    std::atomic<size_t> tail;
+    char padding_2[64 - sizeof(std::atomic<size_t>)];
 };
 
 #endif //TRANSBOT_SDK_CIRCULAR_BUFFER_HPP
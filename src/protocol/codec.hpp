@@ -0,0 +1,443 @@
+#ifndef TRANSBOT_SDK_CODEC_HPP
+#define TRANSBOT_SDK_CODEC_HPP
+
+#include <cstdint>
+#include <type_traits>
+#include "package.hpp"
+
+/*
+ * Wire layout of the parameters of every frame, between the function byte and the checksum.
+ *
+ * Each message is a struct of single byte fields and the 16 bit wrappers below, so it has no padding and an alignment
+ * of 1, and its bytes are exactly the bytes on the wire. A send message declares its SEND_FUNCTION and is turned into
+ * a Package by encode(), a receive message declares its RECEIVE_FUNCTION and is read in place from a received Package
+ * by decode(). The size of every message is checked against the protocol table at compile time.
+ */
+namespace transbot_sdk
+{
+    /**
+     * @brief 16 bit value stored little-endian, low byte first
+     * @tparam T uint16_t or int16_t
+     */
+    template<class T>
+    struct LE16
+    {
+        uint8_t bytes[2];
+
+        LE16() : bytes{0, 0}
+        {}
+
+        LE16(T value) : bytes{static_cast<uint8_t>(static_cast<uint16_t>(value) & 0xFF),
+                              static_cast<uint8_t>(static_cast<uint16_t>(value) >> 8)}
+        {}
+
+        operator T() const
+        {
+            return static_cast<T>(static_cast<uint16_t>(bytes[0] | bytes[1] << 8));
+        }
+    };
+
+    /**
+     * @brief 16 bit value stored big-endian, high byte first
+     * @tparam T uint16_t or int16_t
+     */
+    template<class T>
+    struct BE16
+    {
+        uint8_t bytes[2];
+
+        BE16() : bytes{0, 0}
+        {}
+
+        BE16(T value) : bytes{static_cast<uint8_t>(static_cast<uint16_t>(value) >> 8),
+                              static_cast<uint8_t>(static_cast<uint16_t>(value) & 0xFF)}
+        {}
+
+        operator T() const
+        {
+            return static_cast<T>(static_cast<uint16_t>(bytes[0] << 8 | bytes[1]));
+        }
+    };
+
+    /**
+     * @brief Check the layout of a message against the length of its frames
+     * @tparam Message Send message
+     * @return True if the message has no padding and as many bytes as the parameters of its frames
+     */
+    template<class Message>
+    constexpr bool is_send_layout()
+    {
+        return std::is_standard_layout<Message>::value && alignof(Message) == 1 &&
+               sizeof(Message) + 3 == send_package_len(Message::FUNCTION);
+    }
+
+    /**
+     * @brief Check the layout of a message against the length of its frames
+     * @tparam Message Receive message
+     * @return True if the message has no padding and as many bytes as the parameters of its frames
+     */
+    template<class Message>
+    constexpr bool is_receive_layout()
+    {
+        return std::is_standard_layout<Message>::value && alignof(Message) == 1 &&
+               sizeof(Message) + 3 == receive_package_len(Message::FUNCTION);
+    }
+
+    // Send messages
+
+    /**
+     * @brief Adjusting the PID. For member P, I and D, they has been scale 1000 times as they are all decimal. The real
+     * range is 0-10. This is a package to send.
+     */
+    typedef struct _pid_adjust
+    {
+        static const SEND_FUNCTION FUNCTION = SET_PID;
+        BE16<uint16_t> P;
+        BE16<uint16_t> I;
+        BE16<uint16_t> D;
+        // TRANSBOT_PERMANENT_SAVE
+        uint8_t save;
+        _pid_adjust(double P, double I, double D, uint8_t save)
+                : P(static_cast<uint16_t>(P * 1000)), I(static_cast<uint16_t>(I * 1000)),
+                  D(static_cast<uint16_t>(D * 1000)), save(save)
+        {}
+    } PID_Adjust;
+    static_assert(is_send_layout<PID_Adjust>(), "PID_Adjust does not match SET_PID frames");
+
+    /**
+     * @brief Control bot moving. Linear and angular velocity are scale 100 times when transmit as they are decimal.
+     * When angular velocity is 0, linear velocity > 0 means go straight, <0 means go back, = 0 means stop;
+     * When linear velocity is 0, angular velocity > 0 turn left, < 0  turn right, =0 stop;
+     * when linear and angular velocity are not 0, turn when moving;
+     * This is a package to send;
+     */
+    typedef struct _move_control
+    {
+        static const SEND_FUNCTION FUNCTION = SET_CHASSIS_MOTION;
+        int8_t linear_velocity;
+        LE16<int16_t> angular_velocity;
+        _move_control(int8_t linear_velocity, int16_t angular_velocity)
+                : linear_velocity(linear_velocity), angular_velocity(angular_velocity)
+        {}
+    } Move_Control;
+    static_assert(is_send_layout<Move_Control>(), "Move_Control does not match SET_CHASSIS_MOTION frames");
+
+    typedef struct _pwm_servo_control
+    {
+        static const SEND_FUNCTION FUNCTION = SET_PWM_SERVO;
+        uint8_t servo_id;
+        uint8_t angle; //< When using depth camara, the angle is limited in [50-130], otherwise [0-180]
+        _pwm_servo_control(uint8_t servo_id, uint8_t angle)
+                : servo_id(servo_id), angle(angle)
+        {}
+    } PWM_Servo_Control;
+    static_assert(is_send_layout<PWM_Servo_Control>(), "PWM_Servo_Control does not match SET_PWM_SERVO frames");
+
+    typedef struct _rgb_control
+    {
+        static const SEND_FUNCTION FUNCTION = SET_LED_STRIP;
+        // 0-16 or 0xff (for all)
+        uint8_t rgb_id;
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+        _rgb_control(uint8_t rgb_id, uint8_t r, uint8_t g, uint8_t b)
+                : rgb_id(rgb_id), r(r), g(g), b(b)
+        {}
+    } RGB_Control;
+    static_assert(is_send_layout<RGB_Control>(), "RGB_Control does not match SET_LED_STRIP frames");
+
+    typedef struct _rgb_effect
+    {
+        static const SEND_FUNCTION FUNCTION = SET_STRIP_EFFECT;
+        // Range: 0-6;
+        uint8_t effect_type;
+        // Range: 1-10; Set to 0xff to ignore.
+        uint8_t frequency;
+        // Range: 0-6; Set to 0xff to ignore.
+        uint8_t param;
+        _rgb_effect(uint8_t effect_type, uint8_t frequency, uint8_t param)
+                : effect_type(effect_type), frequency(frequency), param(param)
+        {}
+    } RGB_Effect;
+    static_assert(is_send_layout<RGB_Effect>(), "RGB_Effect does not match SET_STRIP_EFFECT frames");
+
+    typedef struct _buzzer
+    {
+        static const SEND_FUNCTION FUNCTION = SET_BEEP;
+        // 0: OFF
+        // 1: ON
+        // >=10 (10 * n) OFF after xx ms
+        BE16<uint16_t> time;
+        explicit _buzzer(uint16_t time)
+                : time(time)
+        {}
+    } Buzzer;
+    static_assert(is_send_layout<Buzzer>(), "Buzzer does not match SET_BEEP frames");
+
+    typedef struct _led_light
+    {
+        static const SEND_FUNCTION FUNCTION = SET_LIGHT;
+        // How light it is 0-100
+        uint8_t light;
+        explicit _led_light(uint8_t light)
+                : light(light)
+        {}
+    } LED_Light;
+    static_assert(is_send_layout<LED_Light>(), "LED_Light does not match SET_LIGHT frames");
+
+    typedef struct _auto_msg_setting
+    {
+        static const SEND_FUNCTION FUNCTION = SET_AUTO_REPORT_DATA;
+        // 0x00: OFF
+        // 0x01: ON
+        uint8_t enable;
+        explicit _auto_msg_setting(uint8_t enable)
+                : enable(enable)
+        {}
+    } Auto_Msg_Sending;
+    static_assert(is_send_layout<Auto_Msg_Sending>(), "Auto_Msg_Sending does not match SET_AUTO_REPORT_DATA frames");
+
+    // For test moto ok
+    typedef struct _pwm_velocity
+    {
+        static const SEND_FUNCTION FUNCTION = SET_PWM_MOTOR;
+        uint8_t moto_id; // 0x01 or 0x02;
+        BE16<int16_t> pwm;     // -100 - +100
+        _pwm_velocity(uint8_t moto_id, int16_t pwm)
+                : moto_id(moto_id), pwm(pwm)
+        {}
+    } PWM_Velocity;
+    static_assert(is_send_layout<PWM_Velocity>(), "PWM_Velocity does not match SET_PWM_MOTOR frames");
+
+    typedef struct _min_velocity_limit
+    {
+        static const SEND_FUNCTION FUNCTION = SET_MIN_VELOCITY;
+        // 0-20
+        uint8_t min_linear_velocity;
+        // 0-100
+        uint8_t min_angular_velocity;
+        // TRANSBOT_PERMANENT_SAVE
+        uint8_t save;
+        _min_velocity_limit(uint8_t min_linear_velocity, uint8_t min_angular_velocity, uint8_t save)
+                : min_linear_velocity(min_linear_velocity), min_angular_velocity(min_angular_velocity), save(save)
+        {}
+    } Min_Velocity_Limit;
+    static_assert(is_send_layout<Min_Velocity_Limit>(), "Min_Velocity_Limit does not match SET_MIN_VELOCITY frames");
+
+    typedef struct _gyro_direction
+    {
+        static const SEND_FUNCTION FUNCTION = SET_GYRO_ENABLE;
+        // On: 0x01;
+        // OFF: 0x00;
+        uint8_t enable;
+        // TRANSBOT_PERMANENT_SAVE, not saved by default
+        uint8_t save;
+        explicit _gyro_direction(uint8_t enable, uint8_t save = 0x00)
+                : enable(enable), save(save)
+        {}
+    } Gyro_Direction;
+    static_assert(is_send_layout<Gyro_Direction>(), "Gyro_Direction does not match SET_GYRO_ENABLE frames");
+
+    typedef struct _forward
+    {
+        static const SEND_FUNCTION FUNCTION = SET_MOTOR_FORWARD;
+        // -45- +45
+        int8_t velocity;
+        explicit _forward(int8_t velocity)
+                : velocity(velocity)
+        {}
+    } Forward;
+    static_assert(is_send_layout<Forward>(), "Forward does not match SET_MOTOR_FORWARD frames");
+
+    typedef struct _servo_control
+    {
+        static const SEND_FUNCTION FUNCTION = SET_ARM_SERVO;
+        // 1-250 or 0xfe(all servo)
+        uint8_t servo_id;
+        // 96-4000
+        BE16<uint16_t> target_position;
+        // 0-2000
+        BE16<uint16_t> time;
+        _servo_control(uint8_t servo_id, uint16_t target_position, uint16_t time)
+                : servo_id(servo_id), target_position(target_position), time(time)
+        {}
+    } Servo_Control;
+    static_assert(is_send_layout<Servo_Control>(), "Servo_Control does not match SET_ARM_SERVO frames");
+
+    typedef struct _set_servo_bus_id
+    {
+        static const SEND_FUNCTION FUNCTION = SET_SERVO_ID;
+        // 0-250
+        uint8_t servo_id;
+        explicit _set_servo_bus_id(uint8_t servo_id)
+                : servo_id(servo_id)
+        {}
+    } Set_Servo_Bus_Id;
+    static_assert(is_send_layout<Set_Servo_Bus_Id>(), "Set_Servo_Bus_Id does not match SET_SERVO_ID frames");
+
+    /**
+     * Enable servo torque(扭矩) on bus or not
+     */
+    typedef struct _enable_servo_torque
+    {
+        static const SEND_FUNCTION FUNCTION = SET_ARM_SERVO_TORQUE;
+        // 0: OFF
+        // 1: ON
+        uint8_t enable;
+        explicit _enable_servo_torque(uint8_t enable)
+                : enable(enable)
+        {}
+    } Enable_Servo_Torque;
+    static_assert(is_send_layout<Enable_Servo_Torque>(),
+                  "Enable_Servo_Torque does not match SET_ARM_SERVO_TORQUE frames");
+
+    /**
+     * @brief Move the three joints of the arm at once, the frame carries no moving time
+     */
+    typedef struct _control_arm_joint_position
+    {
+        static const SEND_FUNCTION FUNCTION = SET_ARM_MOTION;
+        // Fist joint, ID = 7, 96-4000
+        BE16<uint16_t> joint1;
+        // Second joint, ID = 8, 96-4000
+        BE16<uint16_t> joint2;
+        // Third joint, ID = 9, 96-4000
+        BE16<uint16_t> joint3;
+        _control_arm_joint_position(uint16_t joint1, uint16_t joint2, uint16_t joint3)
+                : joint1(joint1), joint2(joint2), joint3(joint3)
+        {}
+    } Control_Arm_Joint_Position;
+    static_assert(is_send_layout<Control_Arm_Joint_Position>(),
+                  "Control_Arm_Joint_Position does not match SET_ARM_MOTION frames");
+
+    typedef struct _clear_flash_data
+    {
+        static const SEND_FUNCTION FUNCTION = CLEAR_FLASH;
+        uint8_t confirm;
+        _clear_flash_data()
+                : confirm(0x5F)
+        {}
+    } Clear_Flash_Data;
+    static_assert(is_send_layout<Clear_Flash_Data>(), "Clear_Flash_Data does not match CLEAR_FLASH frames");
+
+    /**
+     * @brief Request data from the robot, the response has the requested data type as its function
+     */
+    typedef struct _read_data_request
+    {
+        static const SEND_FUNCTION FUNCTION = SEND_REQUEST;
+        // RECEIVE_FUNCTION of the response
+        uint8_t data_type;
+        // servo id for ARM_SERVO_POSITION, 0 otherwise
+        uint8_t param;
+        explicit _read_data_request(RECEIVE_FUNCTION data_type, uint8_t param = 0)
+                : data_type(data_type), param(param)
+        {}
+    } Read_Data_Request;
+    static_assert(is_send_layout<Read_Data_Request>(), "Read_Data_Request does not match SEND_REQUEST frames");
+
+    // Receive messages, read in place from the received frame
+
+    typedef struct _firmware_version_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = FIRMWARE_VERSION;
+        uint8_t major;
+        uint8_t minor;
+    } Firmware_Version_Response;
+    static_assert(is_receive_layout<Firmware_Version_Response>(),
+                  "Firmware_Version_Response does not match FIRMWARE_VERSION frames");
+
+    typedef struct _yaw_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = YAW_ANGLE;
+        // Unit is radian and has been scaled to 1000 times, divide by 1000 to get the real value
+        // then times 57.29 to get the degree
+        LE16<int16_t> yaw;
+    } Yaw_Response;
+    static_assert(is_receive_layout<Yaw_Response>(), "Yaw_Response does not match YAW_ANGLE frames");
+
+    typedef struct _servo_position_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = ARM_SERVO_POSITION;
+        // 1-250
+        uint8_t servo_id;
+        // 96-4000
+        LE16<uint16_t> position;
+    } Servo_Position_Response;
+    static_assert(is_receive_layout<Servo_Position_Response>(),
+                  "Servo_Position_Response does not match ARM_SERVO_POSITION frames");
+
+    typedef struct _movement_status_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = MOTION_STATUS;
+        // -45-45, 100 times of the real value
+        int8_t linear_velocity;
+        // -200-200, 100 times of the real value
+        LE16<int16_t> angular_velocity;
+        // 16384 per g
+        LE16<int16_t> acceleration[3];
+        // 65.5 per degree per second
+        LE16<int16_t> gyro[3];
+        // 10 times of the real value
+        uint8_t battery_voltage;
+    } Movement_Status_Response;
+    static_assert(is_receive_layout<Movement_Status_Response>(),
+                  "Movement_Status_Response does not match MOTION_STATUS frames");
+
+    typedef struct _pid_parameters_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = PID_PARAM;
+        // 0-10000
+        // 1000 times of the real value
+        LE16<uint16_t> P;
+        LE16<uint16_t> I;
+        LE16<uint16_t> D;
+    } PID_Parameters_Response;
+    static_assert(is_receive_layout<PID_Parameters_Response>(), "PID_Parameters_Response does not match PID_PARAM frames");
+
+    typedef struct _gyro_assist_response
+    {
+        static const RECEIVE_FUNCTION FUNCTION = GYRO_ASSIST_ENABLED;
+        // 0 or 1
+        uint8_t gyro_assist;
+    } Gyro_Assist_Response;
+    static_assert(is_receive_layout<Gyro_Assist_Response>(),
+                  "Gyro_Assist_Response does not match GYRO_ASSIST_ENABLED frames");
+
+    /**
+     * @brief Build a package to send from a message
+     * @tparam Message Send message
+     * @param message The parameters of the package
+     * @return Package with header, parameters and checksum set
+     */
+    template<class Message>
+    Package encode(const Message &message)
+    {
+        static_assert(is_send_layout<Message>(), "Message does not match the frames of its function");
+        Package package(Message::FUNCTION);
+        package.set_payload(&message, sizeof(Message));
+        return package;
+    }
+
+    /**
+     * @brief Read the parameters of a received package in place
+     * @tparam Message Receive message
+     * @param package Received package
+     * @return Pointer into the package, valid as long as the package, nullptr if the package is not a frame of the
+     * function of the message
+     */
+    template<class Message>
+    const Message *decode(const Package &package)
+    {
+        static_assert(is_receive_layout<Message>(), "Message does not match the frames of its function");
+        if (!package.is_data_set() || package.get_direction() != RECEIVE ||
+            package.get_function().receive_function != Message::FUNCTION)
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<const Message *>(package.get_data_ptr() + 4);
+    }
+} // transbot_sdk
+
+#endif //TRANSBOT_SDK_CODEC_HPP
@@ -0,0 +1,244 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <utility>
+#include "flight_recorder.hpp"
+#include "log/async_log.hpp"
+
+namespace transbot_sdk
+{
+    namespace
+    {
+        const char FLIGHT_RECORDER_MAGIC[8] = {'T', 'B', 'F', 'L', 'I', 'G', 'H', 'T'};
+    }
+
+    FlightRecorder::FlightRecorder(std::string path, size_t capacity) : m_path(std::move(path))
+    {
+        m_capacity = 1;
+        while (m_capacity < capacity)
+        {
+            m_capacity <<= 1;
+        }
+        m_mask = m_capacity - 1;
+        m_file_size = HEADER_SIZE + m_capacity * sizeof(StoredRecord);
+        m_file_descriptor = -1;
+        m_mapping = nullptr;
+        m_header = nullptr;
+        m_records = nullptr;
+        m_session = 0;
+    }
+
+    FlightRecorder::~FlightRecorder()
+    {
+        // The page cache writes the mapping back to the file, also if the process dies before getting here
+        if (m_mapping != nullptr)
+        {
+            munmap(m_mapping, m_file_size);
+        }
+        if (m_file_descriptor >= 0)
+        {
+            close(m_file_descriptor);
+        }
+    }
+
+    bool FlightRecorder::is_valid_header(const FileHeader *header, uint64_t capacity)
+    {
+        return memcmp(header->magic, FLIGHT_RECORDER_MAGIC, sizeof(header->magic)) == 0 &&
+               header->version == VERSION &&
+               header->record_size == sizeof(StoredRecord) &&
+               header->capacity != 0 && (header->capacity & (header->capacity - 1)) == 0 &&
+               (capacity == 0 || header->capacity == capacity);
+    }
+
+    void FlightRecorder::close_file()
+    {
+        if (m_mapping != nullptr)
+        {
+            munmap(m_mapping, m_file_size);
+            m_mapping = nullptr;
+            m_header = nullptr;
+            m_records = nullptr;
+        }
+        if (m_file_descriptor >= 0)
+        {
+            close(m_file_descriptor);
+            m_file_descriptor = -1;
+        }
+    }
+
+    bool FlightRecorder::open()
+    {
+        if (m_mapping != nullptr)
+        {
+            return true;
+        }
+        m_file_descriptor = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_file_descriptor < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Open flight recorder file {} failed: {}", m_path, strerror(errno));
+            return false;
+        }
+        struct stat file_status{};
+        if (fstat(m_file_descriptor, &file_status) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Stat flight recorder file {} failed: {}", m_path, strerror(errno));
+            close_file();
+            return false;
+        }
+        bool same_size = static_cast<size_t>(file_status.st_size) == m_file_size;
+        if (!same_size && ftruncate(m_file_descriptor, static_cast<off_t>(m_file_size)) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Resize flight recorder file {} failed: {}", m_path, strerror(errno));
+            close_file();
+            return false;
+        }
+        // Reserve the blocks now, a full disk would otherwise kill the process with SIGBUS in record()
+        int error = posix_fallocate(m_file_descriptor, 0, static_cast<off_t>(m_file_size));
+        if (error != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Allocate flight recorder file {} failed: {}", m_path, strerror(error));
+            close_file();
+            return false;
+        }
+        // Fault every page in now rather than on the first frames recorded
+        void *mapping = mmap(nullptr, m_file_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             m_file_descriptor, 0);
+        if (mapping == MAP_FAILED)
+        {
+            TRANSBOT_LOG(ERROR, "Map flight recorder file {} failed: {}", m_path, strerror(errno));
+            close_file();
+            return false;
+        }
+        m_mapping = static_cast<uint8_t *>(mapping);
+        m_header = reinterpret_cast<FileHeader *>(m_mapping);
+        m_records = reinterpret_cast<StoredRecord *>(m_mapping + HEADER_SIZE);
+
+        if (same_size && is_valid_header(m_header, m_capacity))
+        {
+            m_session = ++m_header->session;
+            TRANSBOT_LOG(INFO, "Continue flight recorder file {} after {} frames, session {}.",
+                         m_path, m_header->count.load(std::memory_order_relaxed), m_session);
+            return true;
+        }
+
+        // A new file, or one of another layout, start over. The magic goes last so that a file is never valid before
+        // it is completely initialized.
+        memset(m_mapping, 0, m_file_size);
+        m_header->version = VERSION;
+        m_header->record_size = sizeof(StoredRecord);
+        m_header->capacity = m_capacity;
+        m_header->session = m_session = 1;
+        new(&m_header->count) std::atomic<uint64_t>(0);
+        for (size_t i = 0; i < m_capacity; i++)
+        {
+            new(&m_records[i].sequence) std::atomic<uint64_t>(0);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(m_header->magic, FLIGHT_RECORDER_MAGIC, sizeof(m_header->magic));
+        TRANSBOT_LOG(INFO, "Created flight recorder file {} for {} frames.", m_path, m_capacity);
+        return true;
+    }
+
+    void FlightRecorder::record(Direction direction, const uint8_t *frame, size_t length,
+                                std::chrono::steady_clock::time_point time)
+    {
+        if (m_records == nullptr)
+        {
+            return;
+        }
+        uint64_t index = m_header->count.fetch_add(1, std::memory_order_relaxed);
+        StoredRecord &record = m_records[index & m_mask];
+        // Mark the record as being written, a crash before the end leaves it marked and load() skips it
+        record.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.timestamp = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+        record.session = m_session;
+        record.direction = direction;
+        record.length = static_cast<uint8_t>(std::min<size_t>(length, MAX_FRAME_LEN));
+        memcpy(record.frame, frame, record.length);
+        record.sequence.store(index + 1, std::memory_order_release);
+    }
+
+    bool FlightRecorder::flush()
+    {
+        if (m_mapping == nullptr)
+        {
+            return false;
+        }
+        if (msync(m_mapping, m_file_size, MS_SYNC) != 0)
+        {
+            TRANSBOT_LOG(ERROR, "Flush flight recorder file {} failed: {}", m_path, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool FlightRecorder::load(const std::string &path, std::vector<FlightRecord> &records)
+    {
+        records.clear();
+        int file_descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file_descriptor < 0)
+        {
+            TRANSBOT_LOG(ERROR, "Open flight recorder file {} failed: {}", path, strerror(errno));
+            return false;
+        }
+        struct stat file_status{};
+        if (fstat(file_descriptor, &file_status) != 0 || static_cast<size_t>(file_status.st_size) < HEADER_SIZE)
+        {
+            TRANSBOT_LOG(ERROR, "Flight recorder file {} is too short.", path);
+            close(file_descriptor);
+            return false;
+        }
+        auto file_size = static_cast<size_t>(file_status.st_size);
+        void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        close(file_descriptor);
+        if (mapping == MAP_FAILED)
+        {
+            TRANSBOT_LOG(ERROR, "Map flight recorder file {} failed: {}", path, strerror(errno));
+            return false;
+        }
+
+        auto header = static_cast<const FileHeader *>(mapping);
+        if (!is_valid_header(header, 0) || file_size != HEADER_SIZE + header->capacity * sizeof(StoredRecord))
+        {
+            TRANSBOT_LOG(ERROR, "{} is not a flight recorder file.", path);
+            munmap(mapping, file_size);
+            return false;
+        }
+        auto stored = reinterpret_cast<const StoredRecord *>(static_cast<const uint8_t *>(mapping) + HEADER_SIZE);
+        uint64_t capacity = header->capacity;
+        uint64_t count = header->count.load(std::memory_order_acquire);
+        uint64_t first = count > capacity ? count - capacity : 0;
+        records.reserve(static_cast<size_t>(count - first));
+        for (uint64_t index = first; index < count; index++)
+        {
+            const StoredRecord &record = stored[index & (capacity - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != index + 1 || record.length > MAX_FRAME_LEN)
+            {
+                // Being written when the recording process died
+                continue;
+            }
+            FlightRecord flight_record{};
+            flight_record.timestamp = record.timestamp;
+            flight_record.session = record.session;
+            flight_record.direction = static_cast<Direction>(record.direction);
+            flight_record.length = record.length;
+            memcpy(flight_record.frame.data(), record.frame, record.length);
+            records.push_back(flight_record);
+        }
+        munmap(mapping, file_size);
+        // The transmit and receive threads claim records in the order they finish their frames, not by time. Sessions
+        // follow each other in the ring, but the steady clock may have started over between them, e.g. after a reboot.
+        std::stable_sort(records.begin(), records.end(), [](const FlightRecord &a, const FlightRecord &b)
+        {
+            return a.session != b.session ? a.session < b.session : a.timestamp < b.timestamp;
+        });
+        return true;
+    }
+} // transbot_sdk
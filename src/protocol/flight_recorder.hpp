@@ -0,0 +1,156 @@
+#ifndef TRANSBOT_SDK_FLIGHT_RECORDER_HPP
+#define TRANSBOT_SDK_FLIGHT_RECORDER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "package.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief A frame read back from a flight recorder file
+     */
+    typedef struct _flight_record
+    {
+        //! time the frame was written to or read from the hardware, in nanoseconds of the steady clock
+        uint64_t timestamp;
+        //! number of the open() which recorded the frame, timestamps of different sessions cannot be compared
+        uint32_t session;
+        //! SEND for frames sent to the robot, RECEIVE for frames received from it
+        Direction direction;
+        //! length of the frame
+        uint8_t length;
+        //! the frame, including header and checksum
+        std::array<uint8_t, MAX_FRAME_LEN> frame;
+    } FlightRecord;
+
+    /**
+     * @brief Always-on recorder of every frame sent and received, into a memory-mapped ring file
+     * @details The file is allocated to its full size when it is opened and mapped shared, so recording a frame is a
+     * memcpy into the page cache without any system call, and whatever has been recorded is in the file even if the
+     * process crashes. When the ring is full the oldest frames are overwritten. A file of the same capacity is kept on
+     * open and recording continues after its newest frame, so the frames before a crash survive the restart. Every
+     * open() starts a new session, since the steady clock of the next process may start over, e.g. after a reboot.
+     *
+     * File layout, in host byte order: a header of HEADER_SIZE bytes holding the magic "TBFLIGHT", the format version,
+     * the record size, the capacity, the number of frames recorded so far and the current session, followed by capacity
+     * records. Each record holds the number of frames recorded up to and including it, the timestamp, the session, the
+     * direction, the length and the frame.
+     * A record whose number does not match its position was being written when the process died and is skipped.
+     */
+    class FlightRecorder
+    {
+    public:
+        /**
+         * @brief Constructor of the recorder, the file is opened by open()
+         * @param path Path of the ring file, created if it does not exist
+         * @param capacity Number of frames kept, rounded up to a power of two
+         */
+        FlightRecorder(std::string path, size_t capacity);
+
+        ~FlightRecorder();
+
+        FlightRecorder(const FlightRecorder &) = delete;
+
+        FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+        /**
+         * @brief Create or reopen the ring file and map it
+         * @return false if the file cannot be created, allocated or mapped
+         */
+        bool open();
+
+        /**
+         * @brief Append a frame, safe to call from any thread
+         * @param direction SEND or RECEIVE
+         * @param frame The frame, including header and checksum
+         * @param length Length of the frame, longer frames are cut to MAX_FRAME_LEN
+         * @param time Time the frame went over the wire
+         */
+        void record(Direction direction, const uint8_t *frame, size_t length,
+                    std::chrono::steady_clock::time_point time);
+
+        /**
+         * @brief Write the recorded frames to the disk, only needed to survive a power loss
+         * @return false if the file is not open or the write failed
+         */
+        bool flush();
+
+        /**
+         * @brief Read every frame kept in a ring file, e.g. after a crash
+         * @param path Path of the ring file
+         * @param records Set to the frames, by session in the order they were recorded and by timestamp within a session
+         * @return false if the file cannot be read or is not a flight recorder file
+         */
+        static bool load(const std::string &path, std::vector<FlightRecord> &records);
+
+    private:
+        //! size of the file header, the records start right after it
+        static const size_t HEADER_SIZE = 64;
+        //! version of the file layout
+        static const uint32_t VERSION = 2;
+
+        /**
+         * @brief Header at the beginning of the file
+         */
+        typedef struct _file_header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t record_size;
+            uint64_t capacity;
+            //! number of frames recorded so far, the next frame goes to record (count % capacity)
+            std::atomic<uint64_t> count;
+            //! number of open() calls on the file, the session of the frames recorded now
+            uint32_t session;
+        } FileHeader;
+
+        /**
+         * @brief A frame in the file
+         */
+        typedef struct _stored_record
+        {
+            //! number of frames recorded up to and including this one, 0 while it is written
+            std::atomic<uint64_t> sequence;
+            uint64_t timestamp;
+            uint32_t session;
+            uint8_t direction;
+            uint8_t length;
+            uint8_t frame[MAX_FRAME_LEN];
+        } StoredRecord;
+
+        static_assert(sizeof(FileHeader) <= HEADER_SIZE, "The file header does not fit into HEADER_SIZE");
+
+        /**
+         * @brief Check the header of a mapped file
+         * @param header The header
+         * @param capacity Capacity expected, 0 for any
+         * @return true if the file is a flight recorder file of the capacity
+         */
+        static bool is_valid_header(const FileHeader *header, uint64_t capacity);
+
+        /**
+         * @brief Close the file after open() failed half way, so that open() can be retried
+         */
+        void close_file();
+
+        std::string m_path;
+        size_t m_capacity;
+        size_t m_mask;
+        size_t m_file_size;
+        int m_file_descriptor;
+        //! the mapped file
+        uint8_t *m_mapping;
+        FileHeader *m_header;
+        StoredRecord *m_records;
+        //! session of the frames recorded by this recorder
+        uint32_t m_session;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_FLIGHT_RECORDER_HPP
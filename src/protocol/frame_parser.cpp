@@ -0,0 +1,132 @@
+#include <cstring>
+#include "frame_parser.hpp"
+
+namespace transbot_sdk
+{
+    FrameParser::FrameParser()
+    {
+        m_begin = 0;
+        m_end = 0;
+        m_accepted_frames = 0;
+        m_rejected_checksums = 0;
+        m_rejected_headers = 0;
+        m_skipped_bytes = 0;
+    }
+
+    uint8_t *FrameParser::write_ptr()
+    {
+        if (m_begin == m_end)
+        {
+            // Everything has been parsed, start over at the beginning of the staging buffer
+            m_begin = 0;
+            m_end = 0;
+        }
+        else if (STAGING_SIZE - m_end < static_cast<size_t>(MAX_FRAME_LEN))
+        {
+            // Move the partial frame left over to the front, it is never longer than a single frame
+            memmove(m_staging, m_staging + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        return m_staging + m_end;
+    }
+
+    size_t FrameParser::writable() const
+    {
+        return STAGING_SIZE - m_end;
+    }
+
+    void FrameParser::commit(size_t length)
+    {
+        if (length > STAGING_SIZE - m_end)
+        {
+            length = STAGING_SIZE - m_end;
+        }
+        m_end += length;
+    }
+
+    bool FrameParser::next_frame(const uint8_t *&frame, uint8_t &length)
+    {
+        while (m_end - m_begin >= 2)
+        {
+            const uint8_t *data = m_staging + m_begin;
+            if (data[0] != 0xFF || data[1] != RECEIVE)
+            {
+                // Not a header, skip to the next 0xFF at once
+                resync(m_begin + 1);
+                continue;
+            }
+            if (m_end - m_begin < 4)
+            {
+                // Wait for the length and function byte
+                return false;
+            }
+
+            // A header followed by an unknown function or an unexpected length is garbage which happens to contain
+            // 0xFF 0xFD, drop the first byte only so that a real header right behind it is not lost. The length of an
+            // unknown function is 0, which is never a valid length byte.
+            if (receive_package_len(data[3]) != data[2])
+            {
+                m_rejected_headers.store(m_rejected_headers.load(std::memory_order_relaxed) + 1,
+                                         std::memory_order_relaxed);
+                resync(m_begin + 1);
+                continue;
+            }
+
+            size_t frame_length = data[2] + 2;
+            if (m_end - m_begin < frame_length)
+            {
+                // Partial frame, keep it for the next read
+                return false;
+            }
+
+            // The checksum is the sum of the bytes from the length byte up to the checksum
+            uint8_t checksum = 0;
+            for (size_t i = 2; i < frame_length - 1; i++)
+            {
+                checksum += data[i];
+            }
+            if (checksum != data[frame_length - 1])
+            {
+                // A corrupted frame, or a header inside garbage which happens to look valid
+                m_rejected_checksums.store(m_rejected_checksums.load(std::memory_order_relaxed) + 1,
+                                           std::memory_order_relaxed);
+                resync(m_begin + 1);
+                continue;
+            }
+
+            frame = data;
+            length = static_cast<uint8_t>(frame_length);
+            m_begin += frame_length;
+            m_accepted_frames.store(m_accepted_frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void FrameParser::resync(size_t from)
+    {
+        // memchr is vectorized by the C library, much faster than testing byte by byte through a noisy stretch
+        const void *found = memchr(m_staging + from, 0xFF, m_end - from);
+        size_t next = found == nullptr ? m_end : static_cast<const uint8_t *>(found) - m_staging;
+        m_skipped_bytes.store(m_skipped_bytes.load(std::memory_order_relaxed) + (next - m_begin),
+                              std::memory_order_relaxed);
+        m_begin = next;
+    }
+
+    FrameParserStats FrameParser::get_stats() const
+    {
+        FrameParserStats stats;
+        stats.accepted_frames = m_accepted_frames.load(std::memory_order_relaxed);
+        stats.rejected_checksums = m_rejected_checksums.load(std::memory_order_relaxed);
+        stats.rejected_headers = m_rejected_headers.load(std::memory_order_relaxed);
+        stats.skipped_bytes = m_skipped_bytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void FrameParser::reset()
+    {
+        m_begin = 0;
+        m_end = 0;
+    }
+} // transbot_sdk
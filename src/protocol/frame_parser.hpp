@@ -0,0 +1,101 @@
+#ifndef TRANSBOT_SDK_FRAME_PARSER_HPP
+#define TRANSBOT_SDK_FRAME_PARSER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "package.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Counters of the frame parser, a snapshot while the receive thread parses
+     */
+    typedef struct _frame_parser_stats
+    {
+        //! frames with a valid header, length and checksum
+        uint64_t accepted_frames;
+        //! frames dropped because of a wrong checksum
+        uint64_t rejected_checksums;
+        //! headers dropped because of an unknown function or a wrong length
+        uint64_t rejected_headers;
+        //! bytes dropped while searching for the next header, including those of rejected frames
+        uint64_t skipped_bytes;
+    } FrameParserStats;
+
+    /**
+     * @brief Streaming parser for frames coming from the hardware
+     * @details Whatever the hardware has is read in bulk into a staging buffer. Complete frames are cut out of it by the
+     * length byte at offset 2, and an incomplete frame at the end of the buffer is carried over to the next read. When
+     * the bytes at the read position do not form a valid frame header, or the frame has a wrong checksum, the parser
+     * drops a single byte and searches for the next header, so a burst of garbage never swallows the frames that
+     * follow it.
+     */
+    class FrameParser
+    {
+    public:
+        FrameParser();
+
+        /**
+         * @brief Get the position where the next bytes read from the hardware should be stored
+         * @note Frames returned by next_frame() before this call are no longer valid after it
+         * @return Pointer into the staging buffer
+         */
+        uint8_t *write_ptr();
+
+        /**
+         * @brief Get the number of bytes that can be stored at write_ptr()
+         * @return Free space of the staging buffer
+         */
+        size_t writable() const;
+
+        /**
+         * @brief Mark bytes stored at write_ptr() as received
+         * @param length Number of bytes stored
+         */
+        void commit(size_t length);
+
+        /**
+         * @brief Extract the next complete frame from the staging buffer
+         * @param frame Set to the first byte of the frame, valid until the next call of write_ptr()
+         * @param length Set to the length of the frame, including header and checksum
+         * @return True if a complete frame was found, false if more bytes are needed
+         */
+        bool next_frame(const uint8_t *&frame, uint8_t &length);
+
+        /**
+         * @brief Drop all buffered bytes
+         */
+        void reset();
+
+        /**
+         * @brief Get the counters of accepted and rejected frames, safe to call from any thread
+         * @return Counters since the parser was created
+         */
+        FrameParserStats get_stats() const;
+
+    private:
+        /**
+         * @brief Drop bytes up to the next 0xFF at or after a position
+         * @param from Position to start searching from
+         */
+        void resync(size_t from);
+
+        //! Size of the staging buffer, large enough for several reads at the auto report rate
+        static const size_t STAGING_SIZE = 512;
+
+        //! staging buffer
+        uint8_t m_staging[STAGING_SIZE];
+        //! position of the first unparsed byte
+        size_t m_begin;
+        //! position after the last received byte
+        size_t m_end;
+        // Counters, only written by the parsing thread
+        std::atomic<uint64_t> m_accepted_frames;
+        std::atomic<uint64_t> m_rejected_checksums;
+        std::atomic<uint64_t> m_rejected_headers;
+        std::atomic<uint64_t> m_skipped_bytes;
+    };
+} // transbot_sdk
+
+#endif //TRANSBOT_SDK_FRAME_PARSER_HPP
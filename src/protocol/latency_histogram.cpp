@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "latency_histogram.hpp"
+
+namespace transbot_sdk
+{
+    LatencyHistogram::LatencyHistogram()
+    {
+        for (auto &bucket: m_buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+        m_total.store(0, std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+    }
+
+    size_t LatencyHistogram::bucket_of(uint64_t nanoseconds)
+    {
+        if (nanoseconds < 2 * SUB_BUCKETS)
+        {
+            // The first two powers of two are counted exactly
+            return static_cast<size_t>(nanoseconds);
+        }
+        if (nanoseconds >= (1ULL << MAX_EXPONENT))
+        {
+            return BUCKETS - 1;
+        }
+        int exponent = 63 - __builtin_clzll(nanoseconds);
+        int shift = exponent - SUB_BUCKET_BITS;
+        // The bits below the leading one, shifted to SUB_BUCKET_BITS of them, select the linear bucket
+        uint64_t sub_bucket = (nanoseconds >> shift) - SUB_BUCKETS;
+        return static_cast<size_t>((shift + 1) * SUB_BUCKETS + sub_bucket);
+    }
+
+    uint64_t LatencyHistogram::upper_bound_of(size_t bucket)
+    {
+        if (bucket < 2 * SUB_BUCKETS)
+        {
+            return bucket;
+        }
+        int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+        uint64_t lower_bound = (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return lower_bound + (1ULL << shift) - 1;
+    }
+
+    void LatencyHistogram::record(std::chrono::nanoseconds latency)
+    {
+        uint64_t nanoseconds = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+        m_buckets[bucket_of(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    LatencyStats LatencyHistogram::get_stats() const
+    {
+        LatencyStats stats{};
+        // Count from the buckets themselves, so that the percentiles add up while latencies are recorded
+        uint64_t counts[BUCKETS];
+        uint64_t count = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+            count += counts[i];
+        }
+        if (count == 0)
+        {
+            return stats;
+        }
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        stats.count = count;
+        stats.mean = std::chrono::nanoseconds(m_total.load(std::memory_order_relaxed) /
+                                              std::max<uint64_t>(m_count.load(std::memory_order_relaxed), 1));
+        stats.max = std::chrono::nanoseconds(max);
+
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        std::chrono::nanoseconds *results[] = {&stats.p50, &stats.p90, &stats.p99, &stats.p999};
+        size_t bucket = 0;
+        uint64_t below = counts[0];
+        for (int i = 0; i < 4; i++)
+        {
+            // Rank of the quantile, rounded up so that p999 of a few latencies is the largest of them
+            double exact_rank = quantiles[i] * count;
+            auto rank = static_cast<uint64_t>(exact_rank);
+            if (rank < exact_rank || rank == 0)
+            {
+                rank++;
+            }
+            while (below < rank && bucket + 1 < BUCKETS)
+            {
+                below += counts[++bucket];
+            }
+            uint64_t upper_bound = upper_bound_of(bucket);
+            *results[i] = std::chrono::nanoseconds(upper_bound < max ? upper_bound : max);
+        }
+        return stats;
+    }
+} // transbot_sdk
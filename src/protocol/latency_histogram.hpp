@@ -0,0 +1,80 @@
+#ifndef TRANSBOT_SDK_LATENCY_HISTOGRAM_HPP
+#define TRANSBOT_SDK_LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Summary of a latency histogram, a snapshot while latencies are recorded
+     * @details Percentiles are the upper bound of the bucket they fall into, within about 3% of the exact value.
+     */
+    typedef struct _latency_stats
+    {
+        //! number of latencies recorded
+        uint64_t count;
+        std::chrono::nanoseconds mean;
+        std::chrono::nanoseconds p50;
+        std::chrono::nanoseconds p90;
+        std::chrono::nanoseconds p99;
+        std::chrono::nanoseconds p999;
+        //! exact largest latency recorded
+        std::chrono::nanoseconds max;
+    } LatencyStats;
+
+    /**
+     * @brief Lock-free latency histogram with logarithmic buckets, in the manner of HdrHistogram
+     * @details Every power of two of nanoseconds is split into SUB_BUCKETS linear buckets, so the relative error is the
+     * same from nanoseconds to a minute, and a latency is recorded by a few relaxed atomic increments. Any number of
+     * threads can record and take snapshots at the same time.
+     */
+    class LatencyHistogram
+    {
+    public:
+        //! linear buckets per power of two
+        static const int SUB_BUCKET_BITS = 5;
+        static const uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        //! latencies from 2^MAX_EXPONENT ns, about 68 seconds, are counted in the last bucket
+        static const int MAX_EXPONENT = 36;
+        static const size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        LatencyHistogram();
+
+        /**
+         * @brief Record a latency, safe to call from any thread
+         * @param latency The latency, negative latencies are recorded as 0
+         */
+        void record(std::chrono::nanoseconds latency);
+
+        /**
+         * @brief Get the count, mean, percentiles and maximum of the latencies recorded so far
+         * @return The summary, all zeros if nothing has been recorded
+         */
+        LatencyStats get_stats() const;
+
+    private:
+        /**
+         * @brief Get the bucket of a latency
+         * @param nanoseconds The latency
+         * @return Index of the bucket
+         */
+        static size_t bucket_of(uint64_t nanoseconds);
+
+        /**
+         * @brief Get the largest latency counted in a bucket
+         * @param bucket Index of the bucket
+         * @return Upper bound of the bucket in nanoseconds
+         */
+        static uint64_t upper_bound_of(size_t bucket);
+
+        std::atomic<uint64_t> m_buckets[BUCKETS];
+        std::atomic<uint64_t> m_count;
+        std::atomic<uint64_t> m_total;
+        std::atomic<uint64_t> m_max;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_LATENCY_HISTOGRAM_HPP
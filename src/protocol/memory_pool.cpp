@@ -1,195 +1,218 @@
 #include "memory_pool.hpp"
-#include "glog/logging.h"
-
-#include <cstring>
+#include "log/async_log.hpp"
 
 #include <algorithm>
-void MemoryPool::free(MemoryBlock *memory_block)
+
+MemoryPool::MemoryPool(size_t max_block_size, size_t memory_size, size_t memory_table_num)
 {
-    if (memory_block == (MemoryBlock *) nullptr || !memory_block->in_use || memory_block->memory_ptr == nullptr)
+    // Block indexes are stored in 16 bits, byte offsets in 32 bits
+    blocks_nums_in_table = std::min<size_t>(std::max<size_t>(memory_table_num, 1), 0xFFFF);
+    pool_memory_size = std::min<size_t>(memory_size, 0xFFFFFFFF) / MIN_BLOCK_SIZE * MIN_BLOCK_SIZE;
+    block_max_size = std::max<size_t>(max_block_size, MIN_BLOCK_SIZE);
+    number_of_size_classes = 0;
+    while ((MIN_BLOCK_SIZE << number_of_size_classes) < block_max_size)
     {
-        // The memory block is not in use
-        return;
+        number_of_size_classes++;
     }
-    if (memory_block->index_in_pool == 0 ||
-        memory_block->index_in_pool == (blocks_nums_in_table - 1))
+    number_of_size_classes++;
+
+    blocks_table = new MemoryBlock[blocks_nums_in_table];
+    // operator new returns memory aligned for any fundamental type, which MIN_BLOCK_SIZE is a multiple of
+    pool_memory_ptr = static_cast<uint8_t *>(::operator new(pool_memory_size));
+    owner_of_unit = std::unique_ptr<uint16_t[]>(new uint16_t[pool_memory_size / MIN_BLOCK_SIZE]);
+    next_free_block = std::unique_ptr<std::atomic<uint32_t>[]>(new std::atomic<uint32_t>[blocks_nums_in_table]);
+    free_list_head = std::unique_ptr<std::atomic<uint64_t>[]>(new std::atomic<uint64_t>[number_of_size_classes]);
+
+    for (size_t i = 0; i < blocks_nums_in_table; ++i)
     {
-        // The first block and the last block is always in use and should not be freed
-        return;
+        // Memory is assigned when the block is carved out of the pool
+        blocks_table[i].memory_ptr = nullptr;
+        blocks_table[i].index_in_pool = static_cast<uint16_t>(i);
+        blocks_table[i].size_class = 0;
+        blocks_table[i].memory_size = 0;
+        blocks_table[i].in_use = false;
+        next_free_block[i].store(NO_BLOCK, std::memory_order_relaxed);
     }
-    memory_block->in_use = false;
+    for (uint8_t i = 0; i < number_of_size_classes; ++i)
+    {
+        free_list_head[i].store(NO_BLOCK, std::memory_order_relaxed);
+    }
+    carved.store(0, std::memory_order_relaxed);
+    blocks_in_use.store(0, std::memory_order_relaxed);
+    bytes_in_use.store(0, std::memory_order_relaxed);
+    blocks_high_water.store(0, std::memory_order_relaxed);
+    bytes_high_water.store(0, std::memory_order_relaxed);
+    allocations.store(0, std::memory_order_relaxed);
+    failures.store(0, std::memory_order_relaxed);
 }
 
-MemoryBlock *MemoryPool::alloc(uint16_t size)
+MemoryPool::~MemoryPool()
 {
+    ::operator delete(pool_memory_ptr);
+    delete[] blocks_table;
+}
 
-    // If size is larger than memory size or max size for pool, allocate failed
-    if (size > block_max_size || size > pool_memory_size)
+uint8_t MemoryPool::size_class_of(size_t size) const
+{
+    if (size > block_max_size)
     {
-        LOG(ERROR) << "Memory size is too large, memory size: " << size
-                   << ", max memory size: " << block_max_size
-                   << ", memory pool size: " << pool_memory_size;
-        return nullptr;
+        return number_of_size_classes;
+    }
+    uint8_t size_class = 0;
+    while ((MIN_BLOCK_SIZE << size_class) < size)
+    {
+        size_class++;
     }
+    return size_class;
+}
 
-    // Calculate the in_use memory size and get the in_use index array
-    uint16_t memory_size_in_use = 0;
-    uint16_t in_use_blocks_num = 0;
-    uint16_t* index_of_blocks_in_use = new uint16_t[blocks_nums_in_table];
-    for (uint16_t i = 0; i < blocks_nums_in_table; i++)
+MemoryBlock *MemoryPool::pop_free_block(uint8_t size_class)
+{
+    std::atomic<uint64_t> &head = free_list_head[size_class];
+    uint64_t current = head.load(std::memory_order_acquire);
+    while (true)
     {
-        if (blocks_table[i].in_use)
+        auto index = static_cast<uint32_t>(current);
+        if (index == NO_BLOCK)
+        {
+            return nullptr;
+        }
+        // The next index may be stale if another thread pops this block first, the counter makes the CAS fail then
+        uint64_t next = ((current >> 32) + 1) << 32 | next_free_block[index].load(std::memory_order_relaxed);
+        if (head.compare_exchange_weak(current, next, std::memory_order_acquire, std::memory_order_acquire))
         {
-            memory_size_in_use += blocks_table[i].memory_size;
-            index_of_blocks_in_use[in_use_blocks_num++] = blocks_table[i].index_in_pool;
+            return &blocks_table[index];
         }
     }
+}
 
-    // If left size is smaller than needed, allocate failed
-    if (pool_memory_size < (memory_size_in_use + size))
+MemoryBlock *MemoryPool::carve_block(uint8_t size_class)
+{
+    const uint64_t block_size = MIN_BLOCK_SIZE << size_class;
+    uint64_t current = carved.load(std::memory_order_relaxed);
+    uint64_t block_index;
+    uint64_t offset;
+    do
     {
-        LOG(ERROR) << "Memory pool is full, memory size: " << pool_memory_size
-                   << ", memory size in use: " << memory_size_in_use
-                   << ", memory size needed: " << size;
-        return nullptr;
+        block_index = current >> 32;
+        offset = current & 0xFFFFFFFF;
+        if (block_index >= blocks_nums_in_table || offset + block_size > pool_memory_size)
+        {
+            return nullptr;
+        }
+    } while (!carved.compare_exchange_weak(current, (block_index + 1) << 32 | (offset + block_size),
+                                           std::memory_order_relaxed));
+
+    // The block belongs to this thread only until it is returned
+    MemoryBlock &block = blocks_table[block_index];
+    block.memory_ptr = pool_memory_ptr + offset;
+    block.size_class = size_class;
+    for (uint64_t unit = offset / MIN_BLOCK_SIZE; unit < (offset + block_size) / MIN_BLOCK_SIZE; unit++)
+    {
+        owner_of_unit[unit] = static_cast<uint16_t>(block_index);
     }
+    return &block;
+}
+
+void MemoryPool::account_alloc(size_t block_size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t blocks = blocks_in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t bytes = bytes_in_use.fetch_add(block_size, std::memory_order_relaxed) + block_size;
+    size_t high_water = blocks_high_water.load(std::memory_order_relaxed);
+    while (blocks > high_water &&
+           !blocks_high_water.compare_exchange_weak(high_water, blocks, std::memory_order_relaxed))
+    {}
+    high_water = bytes_high_water.load(std::memory_order_relaxed);
+    while (bytes > high_water &&
+           !bytes_high_water.compare_exchange_weak(high_water, bytes, std::memory_order_relaxed))
+    {}
+}
 
-    // Special case: allocate for the first time (Only the first and last block is in use, but their size is
-    // always 0). therefor, if memory_size_in_use == 0, it means the memory pool is empty
-    if (memory_size_in_use == 0)
+MemoryBlock *MemoryPool::alloc(size_t size)
+{
+    uint8_t size_class = size_class_of(size);
+    if (size_class >= number_of_size_classes)
     {
-        blocks_table[1].memory_ptr = blocks_table[0].memory_ptr;
-        blocks_table[1].memory_size = size;
-        blocks_table[1].in_use = true;
-        return &blocks_table[1];
+        failures.fetch_add(1, std::memory_order_relaxed);
+        TRANSBOT_LOG(ERROR, "Memory size is too large, memory size: {}, max memory size: {}", size, block_max_size);
+        return nullptr;
     }
 
-    // memory_table is out of order, memory_table_used_index is ordered by its memory allocation order
-    // TODO: optimize the sort algorithm
-    for (uint16_t i = 0; i < (in_use_blocks_num - 1); i++)
+    // Reuse a freed block of the same size class, or carve a new one while the pool has room
+    MemoryBlock *block = pop_free_block(size_class);
+    if (block == nullptr)
     {
-        for (int j = 0; j < (in_use_blocks_num - i - 1); j++)
-        {
-            if (blocks_table[index_of_blocks_in_use[j]].memory_ptr >
-                blocks_table[index_of_blocks_in_use[j + 1]].memory_ptr)
-            {
-                index_of_blocks_in_use[j + 1] ^= index_of_blocks_in_use[j];
-                index_of_blocks_in_use[j] ^= index_of_blocks_in_use[j + 1];
-                index_of_blocks_in_use[j + 1] ^= index_of_blocks_in_use[j];
-            }
-        }
+        block = carve_block(size_class);
+    }
+    if (block == nullptr)
+    {
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
     }
 
+    block->memory_size = static_cast<uint16_t>(std::min<size_t>(size, 0xFFFF));
+    block->in_use = true;
+    account_alloc(MIN_BLOCK_SIZE << size_class);
+    return block;
+}
 
-    // The current smallest memory space available for the needed size
-    uint16_t smallest_available_memory_space = pool_memory_size;
-    // The index of the in_use block right before the current smallest memory space available for the needed size
-    // Which means the memory space is smallest and enough for the needed size at:
-    // blocks_table[index_of_in_use_block_before_smallest_available_memory_space].memory_ptr +
-    // blocks_table[index_of_in_use_block_before_smallest_available_memory_space].memory_size
-    uint16_t index_of_in_use_block_before_smallest_available_memory_space = blocks_nums_in_table - 1;
-    // The accumulated available memory space
-    uint16_t accumulated_available_memory_space = 0;
-
-    bool free_space_enough_for_needed_size = false;
-    int index_when_free_space_enough_for_needed_size = 0;
-    // Check each space between two in_use blocks, find the smallest available memory space for the needed size,
-    // and the index of the in_use block right before that smallest available memory space.
-    // If there are more than one smallest available memory space, the one with the largest index will be chosen.
-    // Also calculate the accumulated available memory space, if there is no available memory space for the needed
-    // size (which means the smallest_available_memory_space is still pool_memory_size and
-    // the index_of_in_use_block_before_smallest_available_memory_space is still blocks_nums_in_table - 1 after the
-    // loop), but the accumulated available memory space is enough for the needed size, we will "compress" the
-    // memory pool, and allocate the memory block in the compressed memory pool.
-    for (uint16_t i = 0; i < (in_use_blocks_num - 1); i++)
+void MemoryPool::free(MemoryBlock *memory_block)
+{
+    if (memory_block == nullptr || !memory_block->in_use || memory_block->memory_ptr == nullptr)
     {
-        // The memory space between two in_use blocks
-        auto free_memory_space_between_blocks = static_cast<uint32_t>(
-                blocks_table[index_of_blocks_in_use[i + 1]].memory_ptr -
-                blocks_table[index_of_blocks_in_use[i]].memory_ptr);
-
-        // The space between two in_use blocks is enough for the needed size
-        if ((free_memory_space_between_blocks - blocks_table[index_of_blocks_in_use[i]].memory_size) >= size &&
-            smallest_available_memory_space >
-            (free_memory_space_between_blocks - blocks_table[index_of_blocks_in_use[i]].memory_size))
-        {
-            index_of_in_use_block_before_smallest_available_memory_space =
-                    blocks_table[index_of_blocks_in_use[i]].index_in_pool;
-            smallest_available_memory_space =
-                    free_memory_space_between_blocks - blocks_table[index_of_blocks_in_use[i]].memory_size;
-        }
-
-        // accumulate the free memory size for each block
-        accumulated_available_memory_space +=
-                free_memory_space_between_blocks - blocks_table[index_of_blocks_in_use[i]].memory_size;
-        // record the index when accumulate_left_memory_size is larger than needed size for the first time
-        if (accumulated_available_memory_space >= size && !free_space_enough_for_needed_size)
-        {
-            index_when_free_space_enough_for_needed_size = i;
-            free_space_enough_for_needed_size = true;
-        }
+        // The memory block is not in use
+        return;
     }
-
-    // If no single block is available to divide for needed size, then compress the table according to accumulate
-    // memory, and allocate the memory block in the compressed memory pool.
-    if (index_of_in_use_block_before_smallest_available_memory_space == blocks_nums_in_table &&
-        smallest_available_memory_space == pool_memory_size)
+    memory_block->in_use = false;
+    memory_block->memory_size = 0;
+    blocks_in_use.fetch_sub(1, std::memory_order_relaxed);
+    bytes_in_use.fetch_sub(MIN_BLOCK_SIZE << memory_block->size_class, std::memory_order_relaxed);
+
+    // Push the block onto the free list of its size class
+    uint32_t index = memory_block->index_in_pool;
+    std::atomic<uint64_t> &head = free_list_head[memory_block->size_class];
+    uint64_t current = head.load(std::memory_order_relaxed);
+    uint64_t next;
+    do
     {
-        for (int i = 0; i < index_when_free_space_enough_for_needed_size; i++)
-        {
-            if (blocks_table[index_of_blocks_in_use[i + 1]].memory_ptr >
-                (blocks_table[index_of_blocks_in_use[i]].memory_ptr +
-                 blocks_table[index_of_blocks_in_use[i]].memory_size))
-            {
-                // move the memory block to the left, right after the previous block
-                memmove(blocks_table[index_of_blocks_in_use[i]].memory_ptr +
-                        blocks_table[index_of_blocks_in_use[i]].memory_size, // destination
-                        blocks_table[index_of_blocks_in_use[i + 1]].memory_ptr, // source
-                        blocks_table[index_of_blocks_in_use[i + 1]].memory_size); // size
-                // update the memory pointer of the moved block
-                blocks_table[index_of_blocks_in_use[i + 1]].memory_ptr =
-                        blocks_table[index_of_blocks_in_use[i]].memory_ptr +
-                        blocks_table[index_of_blocks_in_use[i]].memory_size;
-            }
-        }
+        next_free_block[index].store(static_cast<uint32_t>(current), std::memory_order_relaxed);
+        next = ((current >> 32) + 1) << 32 | index;
+    } while (!head.compare_exchange_weak(current, next, std::memory_order_release, std::memory_order_relaxed));
+}
 
-        for (uint16_t i = 1; i < (blocks_nums_in_table - 1); i++)
-        {
-            if (!blocks_table[i].in_use)
-            {
-                // Find a free block, and allocate the set the free space as memory of this free block
-                blocks_table[i].memory_ptr =
-                        blocks_table[
-                                index_of_blocks_in_use[index_when_free_space_enough_for_needed_size]
-                        ].memory_ptr +
-                        blocks_table[
-                                index_of_blocks_in_use[index_when_free_space_enough_for_needed_size]
-                        ].memory_size;
-
-                blocks_table[i].memory_size = size;
-                blocks_table[i].in_use = true;
-                return &blocks_table[i];
-            }
-        }
-        delete[] index_of_blocks_in_use;
-        return nullptr;
-    }
+void *MemoryPool::allocate(size_t size)
+{
+    MemoryBlock *block = alloc(size);
+    return block == nullptr ? nullptr : block->memory_ptr;
+}
 
-    //If single block is available to divide for needed size, then divide this block into two
-    for (uint16_t i = 1; i < (blocks_nums_in_table - 1); i++)
+void MemoryPool::deallocate(void *memory)
+{
+    if (!owns(memory))
     {
-        if (!blocks_table[i].in_use)
-        {
-            blocks_table[i].memory_ptr =
-                    blocks_table[index_of_in_use_block_before_smallest_available_memory_space].memory_ptr +
-                    blocks_table[index_of_in_use_block_before_smallest_available_memory_space].memory_size;
-
-            blocks_table[i].memory_size = size;
-            blocks_table[i].in_use = true;
-            return &blocks_table[i];
-        }
+        TRANSBOT_LOG(ERROR, "Memory does not belong to the pool.");
+        return;
     }
+    auto unit = static_cast<size_t>(static_cast<uint8_t *>(memory) - pool_memory_ptr) / MIN_BLOCK_SIZE;
+    free(&blocks_table[owner_of_unit[unit]]);
+}
 
-    return nullptr;
+bool MemoryPool::owns(const void *memory) const
+{
+    auto address = static_cast<const uint8_t *>(memory);
+    return address >= pool_memory_ptr && address < pool_memory_ptr + pool_memory_size;
 }
 
+MemoryPoolStats MemoryPool::get_stats() const
+{
+    MemoryPoolStats stats;
+    stats.blocks_in_use = blocks_in_use.load(std::memory_order_relaxed);
+    stats.bytes_in_use = bytes_in_use.load(std::memory_order_relaxed);
+    stats.blocks_high_water = blocks_high_water.load(std::memory_order_relaxed);
+    stats.bytes_high_water = bytes_high_water.load(std::memory_order_relaxed);
+    stats.bytes_carved = carved.load(std::memory_order_relaxed) & 0xFFFFFFFF;
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.failures = failures.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -1,7 +1,12 @@
 #ifndef TRANSBOT_SDK_MEMORY_POOL_HPP
 #define TRANSBOT_SDK_MEMORY_POOL_HPP
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <mutex>
+#include <memory>
+#include <new>
+#include <utility>
+
 /**
  * @brief Memory block information
  */
@@ -9,66 +14,67 @@ typedef struct MemoryBlock
 {
     //! flag of usage, ture if this block is in use
     bool in_use;
+    //! size class of the block, the block holds (MemoryPool::MIN_BLOCK_SIZE << size_class) bytes
+    uint8_t size_class;
     //! memory block index in the pool
-    uint8_t index_in_pool;
+    uint16_t index_in_pool;
     //! size of in_use memory in this block
     uint16_t memory_size;
     //! memory pointer
     uint8_t *memory_ptr;
 } MemoryBlock;
 
+/**
+ * @brief Usage of a memory pool, a snapshot while other threads allocate and free
+ */
+typedef struct MemoryPoolStats
+{
+    //! number of blocks allocated and not freed yet
+    size_t blocks_in_use;
+    //! bytes of the blocks in use, rounded up to their size class
+    size_t bytes_in_use;
+    //! most blocks in use at the same time
+    size_t blocks_high_water;
+    //! most bytes in use at the same time
+    size_t bytes_high_water;
+    //! bytes of the pool carved into blocks so far, they are never given back
+    size_t bytes_carved;
+    //! number of successful allocations
+    uint64_t allocations;
+    //! number of allocations refused because the pool was exhausted or the size too large
+    uint64_t failures;
+} MemoryPoolStats;
+
 /**
  * @brief Memory pool to manage memory blocks
+ * @details The pool is carved into blocks of power-of-two size classes on demand. A freed block goes to a lock-free
+ * free list of its size class and is handed out again by the next allocation of that class, so allocating and freeing
+ * take constant time and never move memory. All methods are safe to call from any thread.
  */
 class MemoryPool
 {
 public:
+    //! size of the smallest size class, also the alignment of every block
+    static const size_t MIN_BLOCK_SIZE = 16;
+
     /**
      * @brief Constructor of memory pool
      * @param max_block_size Max size for single memory block
      * @param memory_size Max memory size
      * @param memory_table_num Memory block number in the table
      */
-    explicit MemoryPool(uint16_t max_block_size = 1024,
-                        uint16_t memory_size = 1024,
-                        uint16_t memory_table_num = 32) : blocks_nums_in_table(memory_table_num),
-                                                          pool_memory_size(memory_size),
-                                                          block_max_size(max_block_size)
-    {
-        blocks_table = new MemoryBlock[blocks_nums_in_table];
-        pool_memory_ptr = new uint8_t[pool_memory_size];
-
-        // Initialize memory first block in the pool
-        blocks_table[0].memory_ptr = pool_memory_ptr;
-        blocks_table[0].index_in_pool = 0;
-        blocks_table[0].memory_size = 0;
-        blocks_table[0].in_use = true; // The first block is always in use
-        // Initialize memory last block in the pool
-        // The last block memory pointer is point to the end of the pool
-        blocks_table[blocks_nums_in_table - 1].memory_ptr = pool_memory_ptr + pool_memory_size;
-        blocks_table[blocks_nums_in_table - 1].index_in_pool = blocks_nums_in_table - 1;
-        blocks_table[blocks_nums_in_table - 1].memory_size = 0;
-        blocks_table[blocks_nums_in_table - 1].in_use = true; // The last block is always in use
-
-        // Initialize memory other blocks in the pool
-        for (int i = 1; i < (blocks_nums_in_table - 1); ++i)
-        {
-            // Initialize memory pointer with nullptr, will be set when allocate memory
-            blocks_table[i].memory_ptr = nullptr;
-            blocks_table[i].index_in_pool = i;
-            blocks_table[i].memory_size = 0;
-            blocks_table[i].in_use = false;
-        }
-    };
+    explicit MemoryPool(size_t max_block_size = 1024,
+                        size_t memory_size = 1024,
+                        size_t memory_table_num = 32);
 
     /**
      * @brief Destructor of memory pool
      */
-    ~MemoryPool()
-    {
-        delete[] pool_memory_ptr;
-        delete[] blocks_table;
-    }
+    ~MemoryPool();
+
+    MemoryPool(const MemoryPool &) = delete;
+
+    MemoryPool &operator=(const MemoryPool &) = delete;
 
     /**
      * @brief Free certain memory block in the pool
@@ -79,23 +85,154 @@ public:
     /**
      * @brief Allocate a memory block in the pool
      * @param size size of the memory block
-     * @return pointer of memory block
+     * @return pointer of memory block, nullptr if the size is too large or the pool is exhausted
      */
-    MemoryBlock *alloc(uint16_t size);
+    MemoryBlock *alloc(size_t size);
+
+    /**
+     * @brief Allocate memory in the pool without a block handle
+     * @param size Size of the memory
+     * @return Pointer to the memory, aligned to MIN_BLOCK_SIZE, nullptr if the pool cannot serve the size
+     */
+    void *allocate(size_t size);
+
+    /**
+     * @brief Give memory returned by allocate() back to the pool
+     * @param memory Pointer returned by allocate()
+     */
+    void deallocate(void *memory);
+
+    /**
+     * @brief Decide whether memory belongs to the pool
+     * @param memory Any pointer
+     * @return True if the pointer lies in the memory of the pool
+     */
+    bool owns(const void *memory) const;
+
+    /**
+     * @brief Get the usage of the pool
+     * @return Usage statistics
+     */
+    MemoryPoolStats get_stats() const;
 
 private:
-    //! mutex of the memory pool
-    std::mutex mutex;
+    //! marks the end of a free list
+    static const uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+    /**
+     * @brief Get the smallest size class holding a size
+     * @param size Size in bytes
+     * @return Size class, or number_of_size_classes if the size is larger than the max block size
+     */
+    uint8_t size_class_of(size_t size) const;
+
+    /**
+     * @brief Take a free block of a size class from its free list
+     * @param size_class Size class
+     * @return The block, nullptr if the free list is empty
+     */
+    MemoryBlock *pop_free_block(uint8_t size_class);
+
+    /**
+     * @brief Carve a new block of a size class out of the unused part of the pool
+     * @param size_class Size class
+     * @return The block, nullptr if the pool or the block table is exhausted
+     */
+    MemoryBlock *carve_block(uint8_t size_class);
+
+    /**
+     * @brief Count a block as in use and update the high water marks
+     * @param block_size Size of the block
+     */
+    void account_alloc(size_t block_size);
+
     //! number of memory block in the table
-    uint16_t blocks_nums_in_table;
+    size_t blocks_nums_in_table;
     //! max memory size in pool
-    uint16_t pool_memory_size;
+    size_t pool_memory_size;
     //! max size for single memory block
-    uint16_t block_max_size;
+    size_t block_max_size;
+    //! number of size classes, from MIN_BLOCK_SIZE up to block_max_size
+    uint8_t number_of_size_classes;
     //! memory table of blocks in pool
     MemoryBlock *blocks_table;
-    //! memory pointer
+    //! memory pointer, aligned to MIN_BLOCK_SIZE
     uint8_t *pool_memory_ptr;
+    //! index of the block owning each MIN_BLOCK_SIZE unit of the pool memory, to find the block of a pointer
+    std::unique_ptr<uint16_t[]> owner_of_unit;
+    //! next block in the free list of each block
+    std::unique_ptr<std::atomic<uint32_t>[]> next_free_block;
+    //! head of the free list of each size class: a change counter in the high half against ABA, a block index below
+    std::unique_ptr<std::atomic<uint64_t>[]> free_list_head;
+    //! blocks carved so far in the high half, bytes carved so far in the low half, updated together
+    std::atomic<uint64_t> carved;
+
+    std::atomic<size_t> blocks_in_use;
+    std::atomic<size_t> bytes_in_use;
+    std::atomic<size_t> blocks_high_water;
+    std::atomic<size_t> bytes_high_water;
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> failures;
+};
+
+/**
+ * @brief Standard allocator taking memory from a memory pool, and from the heap when the pool is exhausted
+ * @details The allocator shares the ownership of the pool, so memory it handed out stays valid after the owner of the
+ * pool is gone, e.g. a future kept by a caller after the protocol has been destroyed.
+ * @tparam T Type of the objects allocated
+ */
+template<class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit PoolAllocator(std::shared_ptr<MemoryPool> pool) : pool(std::move(pool))
+    {}
+
+    template<class U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool(other.pool)
+    {}
+
+    T *allocate(size_t n)
+    {
+        void *memory = pool->allocate(n * sizeof(T));
+        if (memory == nullptr)
+        {
+            memory = ::operator new(n * sizeof(T));
+        }
+        return static_cast<T *>(memory);
+    }
+
+    void deallocate(T *memory, size_t)
+    {
+        if (pool->owns(memory))
+        {
+            pool->deallocate(memory);
+        }
+        else
+        {
+            ::operator delete(memory);
+        }
+    }
+
+    template<class U>
+    bool operator==(const PoolAllocator<U> &other) const
+    {
+        return pool == other.pool;
+    }
+
+    template<class U>
+    bool operator!=(const PoolAllocator<U> &other) const
+    {
+        return pool != other.pool;
+    }
+
+private:
+    template<class U> friend
+    class PoolAllocator;
+
+    std::shared_ptr<MemoryPool> pool;
 };
 
 #endif // TRANSBOT_SDK_MEMORY_POOL_HPP
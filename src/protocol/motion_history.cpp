@@ -0,0 +1,158 @@
+#include "motion_history.hpp"
+
+namespace transbot_sdk
+{
+    Motion_Info to_motion_info(const Movement_Status_Response &status)
+    {
+        double linear_velocit = status.linear_velocity/100.0;
+        double angular_velocity = static_cast<int16_t>(status.angular_velocity)/100.0;
+
+        double accel_ratio = 16384.0;
+        double acc_x = static_cast<int16_t>(status.acceleration[0])/accel_ratio;
+        double acc_y = static_cast<int16_t>(status.acceleration[1])/accel_ratio;
+        double acc_z = static_cast<int16_t>(status.acceleration[2])/accel_ratio;
+
+        double gyro_ratio = 1 / 65.5 / (180 / 3.1415926);
+        // double gyro_ratio = 1 / 16.4 / (180 / 3.1415926) // ±2
+        // double gyro_ratio = 1 / 32.8 / (180 / 3.1415926)
+
+        double gyro_x = static_cast<int16_t>(status.gyro[0]) * gyro_ratio;
+        double gyro_y = static_cast<int16_t>(status.gyro[1]) * gyro_ratio;
+        double gyro_z = static_cast<int16_t>(status.gyro[2]) * gyro_ratio;
+
+        return Motion_Info(linear_velocit, angular_velocity, acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z,
+                           status.battery_voltage);
+    }
+
+    double Motion_Info::* const MotionHistory::CHANNELS[CHANNEL_COUNT] = {
+            &Motion_Info::linear_velocity,
+            &Motion_Info::angular_velocity,
+            &Motion_Info::x_acceleration,
+            &Motion_Info::y_acceleration,
+            &Motion_Info::z_acceleration,
+            &Motion_Info::x_gyro,
+            &Motion_Info::y_gyro,
+            &Motion_Info::z_gyro,
+            &Motion_Info::battery_voltage,
+    };
+
+    MotionHistory::MotionHistory(size_t size)
+    {
+        // At least two samples, the oldest slot may be being overwritten while readers look at the others
+        capacity = 2;
+        while (capacity < size)
+        {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        m_times = std::unique_ptr<std::atomic<std::chrono::steady_clock::rep>[]>(
+                new std::atomic<std::chrono::steady_clock::rep>[capacity]);
+        for (auto &channel: m_channels)
+        {
+            channel = std::unique_ptr<std::atomic<double>[]>(new std::atomic<double>[capacity]);
+        }
+        for (size_t i = 0; i < capacity; i++)
+        {
+            m_times[i].store(0, std::memory_order_relaxed);
+            for (auto &channel: m_channels)
+            {
+                channel[i].store(0, std::memory_order_relaxed);
+            }
+        }
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+    void MotionHistory::record(const Motion_Info &motion_info, std::chrono::steady_clock::time_point time)
+    {
+        uint64_t count = m_count.load(std::memory_order_relaxed);
+        // Readers seeing any store of this sample also see the count before it, so they know the slot is not stable
+        std::atomic_thread_fence(std::memory_order_release);
+        size_t slot = count & mask;
+        m_times[slot].store(time.time_since_epoch().count(), std::memory_order_relaxed);
+        for (size_t channel = 0; channel < CHANNEL_COUNT; channel++)
+        {
+            m_channels[channel][slot].store(motion_info.*CHANNELS[channel], std::memory_order_relaxed);
+        }
+        m_count.store(count + 1, std::memory_order_release);
+    }
+
+    bool MotionHistory::at(std::chrono::steady_clock::time_point time, Motion_Info &motion_info) const
+    {
+        const auto target = time.time_since_epoch().count();
+        auto time_of = [this](uint64_t index)
+        {
+            return m_times[index & mask].load(std::memory_order_relaxed);
+        };
+
+        while (true)
+        {
+            uint64_t count = m_count.load(std::memory_order_acquire);
+            if (count == 0)
+            {
+                return false;
+            }
+            // The writer may already be overwriting the oldest sample, leave it out
+            uint64_t first = count > capacity - 1 ? count - (capacity - 1) : 0;
+            uint64_t last = count - 1;
+
+            bool found = false;
+            Motion_Info result(0, 0, 0, 0, 0, 0, 0, 0, 0);
+            if (time_of(first) <= target && target <= time_of(last))
+            {
+                // Find the first sample not older than the target
+                uint64_t low = first;
+                uint64_t high = last;
+                while (low < high)
+                {
+                    uint64_t middle = low + (high - low) / 2;
+                    if (time_of(middle) < target)
+                    {
+                        low = middle + 1;
+                    }
+                    else
+                    {
+                        high = middle;
+                    }
+                }
+                size_t after = high & mask;
+                auto after_time = time_of(high);
+                if (after_time == target || high == first)
+                {
+                    for (size_t channel = 0; channel < CHANNEL_COUNT; channel++)
+                    {
+                        result.*CHANNELS[channel] = m_channels[channel][after].load(std::memory_order_relaxed);
+                    }
+                }
+                else
+                {
+                    size_t before = (high - 1) & mask;
+                    auto before_time = time_of(high - 1);
+                    double weight = static_cast<double>(target - before_time) / (after_time - before_time);
+                    for (size_t channel = 0; channel < CHANNEL_COUNT; channel++)
+                    {
+                        double value_before = m_channels[channel][before].load(std::memory_order_relaxed);
+                        double value_after = m_channels[channel][after].load(std::memory_order_relaxed);
+                        result.*CHANNELS[channel] = value_before + (value_after - value_before) * weight;
+                    }
+                }
+                found = true;
+            }
+
+            // Everything read is valid unless the writer has wrapped around onto the oldest sample looked at
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_count.load(std::memory_order_relaxed) - first < capacity)
+            {
+                if (found)
+                {
+                    motion_info = result;
+                }
+                return found;
+            }
+        }
+    }
+
+    uint64_t MotionHistory::size() const
+    {
+        return m_count.load(std::memory_order_acquire);
+    }
+} // transbot_sdk
@@ -0,0 +1,79 @@
+#ifndef TRANSBOT_SDK_MOTION_HISTORY_HPP
+#define TRANSBOT_SDK_MOTION_HISTORY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "codec.hpp"
+#include "transbot_sdk/data.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Convert a motion status frame to real units
+     * @param status Decoded MOTION_STATUS parameters
+     * @return The motion info
+     */
+    Motion_Info to_motion_info(const Movement_Status_Response &status);
+
+    /**
+     * @brief Ring of the latest motion info samples with their arrival time, to look up the motion at a given time
+     * @details The ring is a structure of arrays: the times are contiguous, so a lookup binary searches a few cache lines
+     * and touches the values of two samples only. A single thread records samples, any number of threads look them up
+     * without locks and without allocating. A lookup retries if the samples it has read have been overwritten meanwhile,
+     * which only happens when it is slower than the whole ring to fill.
+     */
+    class MotionHistory
+    {
+    public:
+        /**
+         * @brief Constructor of the history
+         * @param size Number of samples kept, rounded up to a power of two
+         */
+        explicit MotionHistory(size_t size);
+
+        MotionHistory(const MotionHistory &) = delete;
+
+        MotionHistory &operator=(const MotionHistory &) = delete;
+
+        /**
+         * @brief Record a sample, overwriting the oldest when the ring is full, only called on the receive thread
+         * @param motion_info The motion info
+         * @param time Time the motion status was read from the hardware, not older than the previous sample
+         */
+        void record(const Motion_Info &motion_info, std::chrono::steady_clock::time_point time);
+
+        /**
+         * @brief Get the motion info at a time, interpolated linearly between the samples around it
+         * @param time Any time between the oldest and the newest sample kept
+         * @param motion_info Set to the motion info at the time
+         * @return false if the time is before the oldest or after the newest sample kept
+         */
+        bool at(std::chrono::steady_clock::time_point time, Motion_Info &motion_info) const;
+
+        /**
+         * @brief Get the number of samples recorded so far, including those overwritten
+         * @return Number of samples
+         */
+        uint64_t size() const;
+
+    private:
+        //! number of doubles in Motion_Info, each is stored in its own array
+        static const size_t CHANNEL_COUNT = 9;
+        //! the field of Motion_Info stored in each array
+        static double Motion_Info::* const CHANNELS[CHANNEL_COUNT];
+
+        size_t capacity;
+        size_t mask;
+        //! arrival time of each sample, in steady clock ticks
+        std::unique_ptr<std::atomic<std::chrono::steady_clock::rep>[]> m_times;
+        //! value of each channel of each sample
+        std::unique_ptr<std::atomic<double>[]> m_channels[CHANNEL_COUNT];
+        //! number of samples recorded, the next sample goes to (m_count & mask)
+        std::atomic<uint64_t> m_count;
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_MOTION_HISTORY_HPP
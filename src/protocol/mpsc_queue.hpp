@@ -0,0 +1,193 @@
+#ifndef TRANSBOT_SDK_MPSC_QUEUE_HPP
+#define TRANSBOT_SDK_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for many producers and a single consumer
+ * @details Each slot carries a sequence number telling whether it is free for the producer of a position or holds the
+ * item of a position for the consumer. Producers claim a position with a single CAS and never wait for each other.
+ * @tparam T Type of the items in the queue
+ */
+template<class T>
+class MpscQueue
+{
+public:
+    /**
+     * @brief Constructor of the queue
+     * @param size Capacity, rounded up to a power of two
+     */
+    explicit MpscQueue(size_t size)
+    {
+        capacity = 1;
+        while (capacity < size)
+        {
+            capacity <<= 1;
+        }
+        mask = capacity - 1;
+        slots = std::unique_ptr<Slot[]>(new Slot[capacity]);
+        for (size_t i = 0; i < capacity; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_position.store(0, std::memory_order_relaxed);
+        dequeue_position.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Push an item, safe to call from any thread
+     * @param item Item to be pushed into the queue
+     * @return false if the queue is full
+     */
+    bool try_push(T item)
+    {
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot &slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                // The slot is free for this position, claim it
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.item = std::move(item);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                // The consumer has not freed the slot of the previous round yet
+                return false;
+            }
+            else
+            {
+                // Another producer claimed this position
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Push items to consecutive positions with a single CAS, so that the consumer pops them one after the other
+     * @details The consumer may see the first items before the last ones are published, and has to wait for those.
+     * @param count Number of items
+     * @param make Called with the index of each item, returns the item
+     * @return false if the queue has no room for all of them, nothing is pushed then
+     */
+    template<class Make>
+    bool try_push_batch(size_t count, Make make)
+    {
+        if (count == 0)
+        {
+            return true;
+        }
+        if (count > capacity)
+        {
+            return false;
+        }
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot &first = slots[position & mask];
+            size_t sequence = first.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                // The consumer frees slots in order, so if the last slot is free for its position, all before it are
+                Slot &last = slots[(position + count - 1) & mask];
+                if (last.sequence.load(std::memory_order_acquire) != position + count - 1)
+                {
+                    return false;
+                }
+                if (enqueue_position.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+                {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        Slot &slot = slots[(position + i) & mask];
+                        slot.item = make(i);
+                        slot.sequence.store(position + i + 1, std::memory_order_release);
+                    }
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Pop the oldest item, only the consumer thread may call this
+     * @param item Set to the popped item
+     * @return false if the queue is empty
+     */
+    bool try_pop(T &item)
+    {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        Slot &slot = slots[position & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+        {
+            return false;
+        }
+        item = std::move(slot.item);
+        slot.item = T();
+        slot.sequence.store(position + capacity, std::memory_order_release);
+        dequeue_position.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief Decide whether the queue is empty, only meaningful on the consumer thread
+     * @return True if no item is ready to be popped
+     */
+    bool is_empty() const
+    {
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        return slots[position & mask].sequence.load(std::memory_order_acquire) != position + 1;
+    }
+
+    /**
+     * @brief Get the queue capacity
+     * @return The queue capacity
+     */
+    size_t get_capacity() const
+    {
+        return capacity;
+    }
+
+private:
+    typedef struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    } Slot;
+
+    //! slots of the queue
+    std::unique_ptr<Slot[]> slots;
+    //! capacity, a power of two
+    size_t capacity;
+    //! capacity - 1, to map positions to slots
+    size_t mask;
+    //! keep the positions off the cache line of the read-only members
+    char padding_0[64];
+    //! next position to push, shared by the producers
+    std::atomic<size_t> enqueue_position;
+    //! keep the producers and the consumer on different cache lines
+    char padding_1[64 - sizeof(std::atomic<size_t>)];
+    //! next position to pop, owned by the consumer
+    std::atomic<size_t> dequeue_position;
+    char padding_2[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif //TRANSBOT_SDK_MPSC_QUEUE_HPP
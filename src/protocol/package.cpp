@@ -1,10 +1,13 @@
-#include <glog/logging.h>
 #include <mutex>
 #include "package.hpp"
+#include "log/async_log.hpp"
 #include <cstring>
 
 namespace transbot_sdk
 {
+    constexpr LengthTable ProtocolTable::SEND_PACKAGE_LEN;
+    constexpr LengthTable ProtocolTable::RECEIVE_PACKAGE_LEN;
+
     Package::Package()
     {
         m_direction = SEND;
@@ -12,23 +15,22 @@ namespace transbot_sdk
         data_set = false;
         checksum = 0;
         length = 0;
-        data = nullptr;
+        data.fill(0);
     }
     Package::Package(SEND_FUNCTION send_function)
     {
         // Check send_function must be a valid send function
-        if (VALID_SEND_FUNCTION.find(send_function) == VALID_SEND_FUNCTION.end())
+        if (!is_valid_send_function(send_function))
         {
-            LOG(ERROR) << "Invalid send function: " << send_function;
+            TRANSBOT_LOG(ERROR, "Invalid send function: {}", send_function);
             throw std::invalid_argument("Invalid send function.");
         }
         m_direction = SEND;
         m_function.send_function = send_function;
         data_set = false;
         checksum = 0;
-        length = SEND_PACKAGE_LEN.at(send_function)+2;
-        data = new uint8_t[length];
-        memset(data, 0, length);
+        length = send_package_len(send_function) + 2;
+        data.fill(0);
         data[0] = 0xFF;
         data[1] = 0xFE;
         data[2] = length-2;
@@ -39,45 +41,35 @@ namespace transbot_sdk
     Package::Package(RECEIVE_FUNCTION receive_function)
     {
         // Check receive_function must be a valid receive function
-        if (VALID_RECEIVE_FUNCTION.find(receive_function) == VALID_RECEIVE_FUNCTION.end())
+        if (!is_valid_receive_function(receive_function))
         {
-            LOG(ERROR) << "Invalid receive function: " << receive_function;
+            TRANSBOT_LOG(ERROR, "Invalid receive function: {}", receive_function);
             throw std::invalid_argument("Invalid receive function.");
         }
         m_direction = RECEIVE;
         m_function.receive_function = receive_function;
         data_set = false;
         checksum = 0;
-        length = RECEIVE_PACKAGE_LEN.at(receive_function)+2;
-        data = new uint8_t[length];
-        memset(data, 0, length);
+        length = receive_package_len(receive_function) + 2;
+        data.fill(0);
         data[0] = 0xFF; // Header 0
         data[1] = 0xFD; // Header 1
         data[2] = length-2;
         data[3] = static_cast<uint8_t>(receive_function);
     }
 
-    Package::~Package()
-    {
-        // Since c++0x, delete[] nullptr is allowed.
-        if (data != nullptr)
-        {
-            delete[] data;
-        }
-    }
-
-    bool Package::set_data(uint8_t *data_to_set)
+    bool Package::set_data(const uint8_t *data_to_set)
     {
         if (data_set)
         {
-            LOG(ERROR) << "Data has already been set.";
+            TRANSBOT_LOG(ERROR, "Data has already been set.");
             return false;
         }
         if (m_direction == SEND)
         {
             if (data_to_set[3] != static_cast<uint8_t>(m_function.send_function))
             {
-                LOG(ERROR) << "Function mismatch: " << data_to_set[3] << "!=" << m_function.send_function;
+                TRANSBOT_LOG(ERROR, "Function mismatch: {}!={}", data_to_set[3], m_function.send_function);
                 return false;
             }
         }
@@ -85,17 +77,35 @@ namespace transbot_sdk
         {
             if (data_to_set[3] != static_cast<uint8_t>(m_function.receive_function))
             {
-                LOG(ERROR) << "Function mismatch: " << data_to_set[3] << "!=" << m_function.receive_function;
+                TRANSBOT_LOG(ERROR, "Function mismatch: {}!={}", data_to_set[3], m_function.receive_function);
                 return false;
             }
         }
         else
         {
-            LOG(ERROR) << "Invalid direction: " << (int)data_to_set[1] << "!=" << m_direction;
+            TRANSBOT_LOG(ERROR, "Invalid direction: {}!={}", (int)data_to_set[1], m_direction);
             return false;
         }
 
-        memcpy(this->data + 4, data_to_set + 4, length - 4);
+        memcpy(this->data.data() + 4, data_to_set + 4, length - 4);
+        calculate_checksum();
+        data_set = true;
+        return true;
+    }
+
+    bool Package::set_payload(const void *payload, size_t payload_length)
+    {
+        if (data_set)
+        {
+            TRANSBOT_LOG(ERROR, "Data has already been set.");
+            return false;
+        }
+        if (payload_length + 5 != length)
+        {
+            TRANSBOT_LOG(ERROR, "Payload length mismatch: {}!={}", payload_length, length - 5);
+            return false;
+        }
+        memcpy(data.data() + 4, payload, payload_length);
         calculate_checksum();
         data_set = true;
         return true;
@@ -110,11 +120,24 @@ namespace transbot_sdk
     {
         if (data_set)
         {
-            return data;
+            return data.data();
+        }
+        else
+        {
+            TRANSBOT_LOG(ERROR, "Data has not been set.");
+            return nullptr;
+        }
+    }
+
+    const uint8_t *Package::get_data_ptr() const
+    {
+        if (data_set)
+        {
+            return data.data();
         }
         else
         {
-            LOG(ERROR) << "Data has not been set.";
+            TRANSBOT_LOG(ERROR, "Data has not been set.");
             return nullptr;
         }
     }
@@ -1,17 +1,74 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <thread>
+#include <pthread.h>
 #include "protocol.hpp"
-#include "glog/logging.h"
+#include "log/async_log.hpp"
 #include "hardware/serial_device.hpp"
 
-Protocol::Protocol()
+constexpr std::chrono::microseconds Protocol::MAX_COALESCED_GUARD_TIME;
+
+std::chrono::microseconds Protocol::default_guard_time(transbot_sdk::SEND_FUNCTION function)
+{
+    switch (function)
+    {
+        case transbot_sdk::SET_PID:
+        case transbot_sdk::SET_MIN_VELOCITY:
+        case transbot_sdk::SET_SERVO_ID:
+        case transbot_sdk::CLEAR_FLASH:
+            // The firmware writes these to flash
+            return std::chrono::milliseconds(40);
+        case transbot_sdk::SET_ARM_SERVO:
+        case transbot_sdk::SET_ARM_SERVO_TORQUE:
+        case transbot_sdk::SET_ARM_MOTION:
+            // The firmware relays these on the servo bus
+            return std::chrono::milliseconds(10);
+        default:
+            return std::chrono::milliseconds(2);
+    }
+}
+
+Protocol::Protocol(const std::string &port_name, std::shared_ptr<transbot_sdk::IoLoop> io_loop)
+    : Protocol(std::make_shared<transbot_sdk::SerialDevice>(port_name), std::move(io_loop))
+{
+}
+
+Protocol::Protocol(std::shared_ptr<transbot_sdk::HardwareInterface> hardware,
+                   std::shared_ptr<transbot_sdk::IoLoop> io_loop)
+    : m_motion_history(MOTION_HISTORY_SIZE), m_transmit_queue(TRANSMIT_QUEUE_SIZE),
+      m_dispatch_queue(DISPATCH_QUEUE_SIZE)
 {
-    m_hardware = std::make_shared<transbot_sdk::SerialDevice>();
+    m_hardware = std::move(hardware);
+    m_io_loop = std::move(io_loop);
+    m_io_registration = 0;
+    m_transmit_waiting = false;
+    m_dispatch_waiting = false;
+    for (int function = 0; function < 256; function++)
+    {
+        m_guard_time[function] = default_guard_time(static_cast<transbot_sdk::SEND_FUNCTION>(function));
+    }
     m_is_running = false;
-    m_receive_buffer_ptr = new uint8_t[transbot_sdk::MAX_PACKAGE_LEN];
-    m_receive_buffer =
-        std::unordered_map<
-            transbot_sdk::RECEIVE_FUNCTION,
-            std::shared_ptr<CircularBuffer<std::shared_ptr<transbot_sdk::Package>>>>();
+    m_next_request_id = 0;
+    m_next_deadline = std::chrono::steady_clock::time_point::max().time_since_epoch().count();
+    m_memory_pool = std::make_shared<MemoryPool>(REQUEST_BLOCK_SIZE, REQUEST_POOL_SIZE, REQUEST_POOL_BLOCKS);
+    m_pending_requests.reserve(REQUEST_POOL_BLOCKS);
+    // Create every receive buffer and counter up front, the tables are never modified while the threads run
+    for (int function = 0; function < 256; function++)
+    {
+        if (transbot_sdk::is_valid_receive_function(static_cast<uint8_t>(function)))
+        {
+            m_receive_buffer[function] = std::unique_ptr<ReceiveBuffer>(
+                    new ReceiveBuffer(transbot_sdk::CIRCLE_BUFFER_SIZE));
+            m_receive_counters[function] = std::unique_ptr<ReceiveCounters>(new ReceiveCounters());
+        }
+        if (transbot_sdk::is_valid_send_function(static_cast<uint8_t>(function)))
+        {
+            m_send_counters[function] = std::unique_ptr<SendCounters>(new SendCounters());
+        }
+    }
+    m_sent_bytes = 0;
+    m_received_bytes = 0;
 }
 
 bool Protocol::init()
@@ -19,174 +76,735 @@ bool Protocol::init()
     m_is_running = true;
     if (!m_hardware->init())
     {
-        LOG(FATAL) << "Hardware init failed.";
+        TRANSBOT_LOG(FATAL, "Hardware init failed.");
         return false;
     }
-    // Start a thread to receive data from hardware
-    LOG(INFO) << "Start receive thread.";
-    m_receive_thread = std::thread(&Protocol::receive_thread, this);
+    int event_file_descriptor = m_hardware->get_event_file_descriptor();
+    if (m_io_loop && event_file_descriptor >= 0)
+    {
+        // Receive on the shared loop, which waits on the hardware of every robot in one epoll
+        m_io_registration = m_io_loop->add(event_file_descriptor, [this]
+        {
+            return service_receive();
+        });
+        if (m_io_registration == 0)
+        {
+            TRANSBOT_LOG(FATAL, "Register hardware in io loop failed.");
+            return false;
+        }
+        TRANSBOT_LOG(INFO, "Receive on io loop.");
+    }
+    else
+    {
+        if (m_io_loop)
+        {
+            TRANSBOT_LOG(WARNING, "Hardware cannot be waited on by the io loop, start a receive thread of its own.");
+        }
+        // Start a thread to receive data from hardware
+        TRANSBOT_LOG(INFO, "Start receive thread.");
+        m_receive_thread = std::thread(&Protocol::receive_thread, this);
+    }
+    // Start a thread to write queued packages to hardware
+    TRANSBOT_LOG(INFO, "Start transmit thread.");
+    m_transmit_thread = std::thread(&Protocol::transmit_thread, this);
+    // Start a thread to call back subscriptions, so that slow callbacks never hold up the receive thread
+    TRANSBOT_LOG(INFO, "Start dispatch thread.");
+    m_dispatch_thread = std::thread(&Protocol::dispatch_thread, this);
     // m_receive_thread.join();
     return true;
 }
 
-bool Protocol::send(const std::shared_ptr<transbot_sdk::Package> &package)
+bool Protocol::send(transbot_sdk::Package package)
+{
+    if (!is_valid_send_package(package))
+    {
+        return false;
+    }
+    return enqueue(std::move(package));
+}
+
+bool Protocol::is_valid_send_package(const transbot_sdk::Package &package) const
 {
     // Check package is a send package
-    if (package->get_direction() != transbot_sdk::SEND)
+    if (package.get_direction() != transbot_sdk::SEND)
     {
-        LOG(ERROR) << "Package is not a send package.";
+        TRANSBOT_LOG(ERROR, "Package is not a send package.");
         return false;
     }
     // Check package is a valid function
-    if (transbot_sdk::VALID_SEND_FUNCTION.find(package->get_function().send_function) ==
-        transbot_sdk::VALID_SEND_FUNCTION.end())
+    if (!transbot_sdk::is_valid_send_function(package.get_function().function))
     {
-        LOG(ERROR) << "Package is not a valid send package. It has a wrong function.";
+        TRANSBOT_LOG(ERROR, "Package is not a valid send package. It has a wrong function.");
         return false;
     }
     // Check package is a valid length
-    if (transbot_sdk::SEND_PACKAGE_LEN.at(package->get_function().send_function) + 2 != package->get_length())
+    if (transbot_sdk::send_package_len(package.get_function().function) + 2 != package.get_length())
     {
-        LOG(ERROR) << "Package is not a valid send package. It has a wrong length.";
+        TRANSBOT_LOG(ERROR, "Package is not a valid send package. It has a wrong length.");
         return false;
     }
     // Check package data is set
-    if (!package->is_data_set())
+    if (!package.is_data_set())
     {
-        LOG(ERROR) << "Package data is not set.";
+        TRANSBOT_LOG(ERROR, "Package data is not set.");
         return false;
     }
-    size_t sent_bytes = m_hardware->send(package->get_data_ptr(), package->get_length());
+    return true;
+}
 
-    if (sent_bytes <= 0 || sent_bytes != package->get_length())
+bool Protocol::enqueue(transbot_sdk::Package package)
+{
+    auto &counters = *m_send_counters[package.get_function().function];
+    if (!m_is_running)
     {
-        LOG(ERROR) << "Package is not sent completely.";
+        TRANSBOT_LOG(ERROR, "Protocol is not running, package dropped.");
+        counters.dropped_frames.fetch_add(1, std::memory_order_relaxed);
         return false;
     }
-    // delay 40ms to wait for the hardware to process the package
-    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    QueuedPackage queued;
+    queued.package = std::move(package);
+    queued.queued_at = std::chrono::steady_clock::now();
+    queued.batch_remaining = 0;
+    if (!m_transmit_queue.try_push(std::move(queued)))
+    {
+        TRANSBOT_LOG(ERROR, "Transmit queue is full, package dropped.");
+        counters.dropped_frames.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    wake_transmit_thread();
     return true;
 }
 
-std::shared_ptr<transbot_sdk::Package> Protocol::take(transbot_sdk::RECEIVE_FUNCTION receive_function)
+bool Protocol::send_batch(const transbot_sdk::Package *packages, size_t count)
 {
-    // Check receive function is valid
-    if (transbot_sdk::VALID_RECEIVE_FUNCTION.find(receive_function) == transbot_sdk::VALID_RECEIVE_FUNCTION.end())
+    if (count > MAX_BATCH_SIZE)
     {
-        LOG(ERROR) << "Receive function is not valid.";
-        return nullptr;
+        TRANSBOT_LOG(ERROR, "Batch of {} packages is too large, at most {} can be sent together.", count,
+                     static_cast<size_t>(MAX_BATCH_SIZE));
+        return false;
     }
-    // Check receive buffer is empty
-    if (m_receive_buffer.find(receive_function) == m_receive_buffer.end() ||
-        m_receive_buffer.at(receive_function)->is_empty())
+    for (size_t i = 0; i < count; i++)
     {
-        LOG(ERROR) << "Receive buffer is empty.";
-        return nullptr;
+        if (!is_valid_send_package(packages[i]))
+        {
+            return false;
+        }
     }
-    // Get a package from the receive buffer
-    try
+    if (count == 0)
+    {
+        return true;
+    }
+    bool is_queued = false;
+    if (m_is_running)
     {
-        std::shared_ptr<transbot_sdk::Package> package = m_receive_buffer.at(receive_function)->pop();
-        // Check package data is set
-        if (!package->is_data_set())
+        auto queued_at = std::chrono::steady_clock::now();
+        is_queued = m_transmit_queue.try_push_batch(count, [packages, count, queued_at](size_t i)
         {
-            LOG(ERROR) << "Package data is not set.";
-            return nullptr;
+            QueuedPackage queued;
+            queued.package = packages[i];
+            queued.queued_at = queued_at;
+            queued.batch_remaining = count - 1 - i;
+            return queued;
+        });
+    }
+    if (!is_queued)
+    {
+        TRANSBOT_LOG(ERROR, "Protocol is not running or transmit queue is full, batch of {} packages dropped.", count);
+        for (size_t i = 0; i < count; i++)
+        {
+            m_send_counters[packages[i].get_function().function]->dropped_frames.fetch_add(
+                    1, std::memory_order_relaxed);
         }
-        return package;
+        return false;
     }
-    catch (std::out_of_range &e)
+    wake_transmit_thread();
+    return true;
+}
+
+void Protocol::wake_transmit_thread()
+{
+    // Pairs with the fence in transmit_thread(): either the writer sees the package before it sleeps, or we see that
+    // it is about to sleep and wake it up
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_transmit_waiting.load(std::memory_order_relaxed))
     {
-        LOG(ERROR) << "Receive buffer is empty.";
-        return nullptr;
+        std::lock_guard<std::mutex> lock(m_transmit_mutex);
+        m_transmit_condition.notify_one();
     }
 }
 
-Protocol::~Protocol()
+size_t Protocol::transmit(const QueuedPackage *queued, size_t count)
 {
-    m_is_running = false;
-    if (m_receive_thread.joinable())
+    // A single package is written from where it is, a batch is copied back to back into one buffer
+    uint8_t buffer[MAX_BATCH_SIZE * transbot_sdk::MAX_FRAME_LEN];
+    const uint8_t *data = queued[0].package.get_data_ptr();
+    size_t length = queued[0].package.get_length();
+    if (count > 1)
     {
-        LOG(INFO) << "Join receive thread.";
-        m_receive_thread.join();
+        length = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            memcpy(buffer + length, queued[i].package.get_data_ptr(), queued[i].package.get_length());
+            length += queued[i].package.get_length();
+        }
+        data = buffer;
+    }
+
+    // Stamped before writing, a fast response may be parsed before send() returns
+    auto sent_at = std::chrono::steady_clock::now();
+    size_t sent_bytes = m_hardware->send(data, length);
+    auto write_time = std::chrono::steady_clock::now() - sent_at;
+    if (sent_bytes > length)
+    {
+        // The hardware returns -1 on error
+        sent_bytes = 0;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const transbot_sdk::Package &package = queued[i].package;
+        auto &counters = *m_send_counters[package.get_function().function];
+        counters.queue_latency.record(sent_at - queued[i].queued_at);
+        counters.write_latency.record(write_time);
+        offset += package.get_length();
+        if (offset > sent_bytes)
+        {
+            counters.failed_writes.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        counters.sent_frames.fetch_add(1, std::memory_order_relaxed);
+        if (m_flight_recorder)
+        {
+            m_flight_recorder->record(transbot_sdk::SEND, package.get_data_ptr(), package.get_length(), sent_at);
+        }
+    }
+    if (sent_bytes != length)
+    {
+        TRANSBOT_LOG(ERROR, "Package is not sent completely.");
     }
-    LOG(INFO) << "Delete receive buffer.";
-    delete[] m_receive_buffer_ptr;
+    m_sent_bytes.fetch_add(sent_bytes, std::memory_order_relaxed);
+    return sent_bytes;
 }
 
-void Protocol::receive_thread()
+void Protocol::transmit_thread()
 {
-    LOG(INFO) << "Receive thread started.";
-    uint8_t *single_buffer = new uint8_t;
-    while (m_is_running)
+    TRANSBOT_LOG(INFO, "Transmit thread started.");
+    const auto byte_time = get_byte_time();
+    auto next_write = std::chrono::steady_clock::now();
+    QueuedPackage batch[MAX_BATCH_SIZE];
+    while (true)
+    {
+        if (!m_transmit_queue.try_pop(batch[0]))
+        {
+            if (!m_is_running)
+            {
+                // Everything queued before shutdown has been written, e.g. a final stop command
+                break;
+            }
+            std::unique_lock<std::mutex> lock(m_transmit_mutex);
+            m_transmit_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_transmit_condition.wait(lock, [this]
+            {
+                return !m_transmit_queue.is_empty() || !m_is_running;
+            });
+            m_transmit_waiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        // The rest of a batch has been claimed together with its first package, it is published in a moment
+        size_t count = 1;
+        int attempts = 0;
+        while (batch[count - 1].batch_remaining > 0)
+        {
+            if (m_transmit_queue.try_pop(batch[count]))
+            {
+                count++;
+            }
+            else if (++attempts < 64)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                // With SCHED_FIFO a yield never lets a publisher of lower priority run
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+
+        size_t begin = 0;
+        while (begin < count)
+        {
+            // Write back to back up to and including the first package the firmware needs a longer time for
+            size_t end = begin;
+            size_t length = 0;
+            std::chrono::microseconds guard_time(0);
+            do
+            {
+                guard_time = std::max(guard_time, m_guard_time[batch[end].package.get_function().function]);
+                length += batch[end].package.get_length();
+                end++;
+            } while (end < count && guard_time <= MAX_COALESCED_GUARD_TIME);
+
+            // Leave the firmware the time it needs for the previous frames
+            if (next_write > std::chrono::steady_clock::now())
+            {
+                std::this_thread::sleep_until(next_write);
+            }
+            transmit(batch + begin, end - begin);
+            next_write = std::chrono::steady_clock::now() + byte_time * length + guard_time;
+            begin = end;
+        }
+    }
+}
+
+void Protocol::subscribe(transbot_sdk::RECEIVE_FUNCTION function, FrameCallback callback)
+{
+    std::shared_ptr<const FrameCallback> subscription;
+    if (callback)
     {
-        memset(m_receive_buffer_ptr, 0, transbot_sdk::MAX_PACKAGE_LEN);
+        subscription = std::make_shared<const FrameCallback>(std::move(callback));
+    }
+    std::atomic_store(&m_subscriptions[function], subscription);
+}
 
-        int receive = 0;
-        while (true)
+void Protocol::dispatch_thread()
+{
+    TRANSBOT_LOG(INFO, "Dispatch thread started.");
+    transbot_sdk::Package package;
+    while (true)
+    {
+        if (!m_dispatch_queue.try_pop(package))
         {
-            receive = m_hardware->receive(single_buffer, 1);
-            if (receive <= 0)
+            if (!m_is_running)
             {
-                continue;
+                break;
             }
-            if (*single_buffer == (uint8_t)0xFF)
+            std::unique_lock<std::mutex> lock(m_dispatch_mutex);
+            m_dispatch_waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_dispatch_condition.wait(lock, [this]
             {
-                // Find the header
-                m_receive_buffer_ptr[0] = *single_buffer;
-                receive = m_hardware->receive(single_buffer, 1);
-                if (receive <= 0)
-                {
-                    continue;
-                }
+                return !m_dispatch_queue.is_empty() || !m_is_running;
+            });
+            m_dispatch_waiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        // The subscription may have been replaced since the frame was queued, call the current one
+        auto subscription = std::atomic_load(&m_subscriptions[package.get_function().function]);
+        if (subscription)
+        {
+            (*subscription)(package);
+        }
+    }
+}
+
+void Protocol::set_guard_time(transbot_sdk::SEND_FUNCTION function, std::chrono::microseconds guard_time)
+{
+    m_guard_time[function] = guard_time;
+}
+
+std::chrono::nanoseconds Protocol::get_byte_time() const
+{
+    return std::chrono::nanoseconds(10 * 1000000000LL / m_hardware->get_baud_rate());
+}
 
-                if (*single_buffer == (uint8_t)0xFD)
+std::chrono::nanoseconds Protocol::get_send_interval(const transbot_sdk::Package &package) const
+{
+    return get_byte_time() * package.get_length() + m_guard_time[package.get_function().function];
+}
+
+bool Protocol::set_transmit_priority(int priority)
+{
+    if (!m_is_running)
+    {
+        TRANSBOT_LOG(ERROR, "Transmit priority can only be set after init().");
+        return false;
+    }
+    sched_param param{};
+    param.sched_priority = priority;
+    int error = pthread_setschedparam(m_transmit_thread.native_handle(), priority > 0 ? SCHED_FIFO : SCHED_OTHER,
+                                      &param);
+    if (error != 0)
+    {
+        TRANSBOT_LOG(ERROR, "Set transmit thread priority {} failed: {}", priority, strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool Protocol::record_frames(const std::string &path, size_t frames)
+{
+    if (m_is_running)
+    {
+        TRANSBOT_LOG(ERROR, "Frames can only be recorded from before init().");
+        return false;
+    }
+    std::unique_ptr<transbot_sdk::FlightRecorder> flight_recorder(new transbot_sdk::FlightRecorder(path, frames));
+    if (!flight_recorder->open())
+    {
+        return false;
+    }
+    // The threads started by init() see the recorder, it is never replaced while they run
+    m_flight_recorder = std::move(flight_recorder);
+    return true;
+}
+
+std::future<transbot_sdk::Package> Protocol::request(const transbot_sdk::Package &package,
+                                                    std::chrono::milliseconds timeout)
+{
+    // The promise and its shared state live in the memory pool. The callback only carries two pointers, which
+    // std::function stores without allocating, and it is called exactly once, also when the protocol is destroyed.
+    PoolAllocator<std::promise<transbot_sdk::Package>> allocator(m_memory_pool);
+    std::promise<transbot_sdk::Package> *promise = allocator.allocate(1);
+    new(promise) std::promise<transbot_sdk::Package>(std::allocator_arg, allocator);
+    auto future = promise->get_future();
+    request(package, timeout, [this, promise](const transbot_sdk::Package &response)
+    {
+        promise->set_value(response);
+        promise->~promise();
+        PoolAllocator<std::promise<transbot_sdk::Package>>(m_memory_pool).deallocate(promise, 1);
+    });
+    return future;
+}
+
+bool Protocol::request(const transbot_sdk::Package &package, std::chrono::milliseconds timeout,
+                       ResponseCallback callback)
+{
+    if (!m_is_running)
+    {
+        TRANSBOT_LOG(ERROR, "Protocol is not running, request dropped.");
+        callback(transbot_sdk::Package());
+        return false;
+    }
+    if (package.get_function().send_function != transbot_sdk::SEND_REQUEST || !is_valid_send_package(package))
+    {
+        TRANSBOT_LOG(ERROR, "Package is not a request.");
+        callback(transbot_sdk::Package());
+        return false;
+    }
+
+    // The requested data type is the function of the response, a servo position response also carries the servo id
+    const uint8_t *data = package.get_data_ptr();
+    PendingRequest pending;
+    pending.function = static_cast<transbot_sdk::RECEIVE_FUNCTION>(data[4]);
+    pending.key = pending.function == transbot_sdk::ARM_SERVO_POSITION ? data[5] : -1;
+    pending.requested_at = std::chrono::steady_clock::now();
+    pending.deadline = pending.requested_at + timeout;
+    pending.callback = std::move(callback);
+    if (!transbot_sdk::is_valid_receive_function(pending.function))
+    {
+        TRANSBOT_LOG(ERROR, "Request for an unknown data type: {}", static_cast<int>(data[4]));
+        pending.callback(transbot_sdk::Package());
+        return false;
+    }
+
+    // Register before sending, the response may be parsed before enqueue() returns
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        pending.id = m_next_request_id++;
+        m_pending_requests.push_back(pending);
+        if (pending.deadline.time_since_epoch().count() < m_next_deadline)
+        {
+            // The receive thread sleeps past this deadline, wake it up to reschedule
+            m_next_deadline = pending.deadline.time_since_epoch().count();
+            m_hardware->interrupt();
+        }
+    }
+
+    if (!enqueue(package))
+    {
+        // Fail the request now rather than at its deadline, unless it has already been completed
+        ResponseCallback failed;
+        {
+            std::lock_guard<std::mutex> lock(m_pending_mutex);
+            for (auto it = m_pending_requests.begin(); it != m_pending_requests.end(); ++it)
+            {
+                if (it->id == pending.id)
                 {
-                    // Find the second header
-                    m_receive_buffer_ptr[1] = *single_buffer;
+                    failed = std::move(it->callback);
+                    m_pending_requests.erase(it);
                     break;
                 }
-                else
-                {
-                    continue;
-                }
             }
         }
+        if (failed)
+        {
+            failed(transbot_sdk::Package());
+        }
+        return false;
+    }
+    return true;
+}
+
+MemoryPoolStats Protocol::get_memory_pool_stats() const
+{
+    return m_memory_pool->get_stats();
+}
 
-        receive = m_hardware->receive(m_receive_buffer_ptr + 2, transbot_sdk::MAX_PACKAGE_LEN - 2);
-        if (receive >= 0)
+transbot_sdk::FrameParserStats Protocol::get_parser_stats() const
+{
+    return m_parser.get_stats();
+}
+
+transbot_sdk::ProtocolStats Protocol::get_stats() const
+{
+    transbot_sdk::ProtocolStats stats{};
+    for (const auto &description: transbot_sdk::SEND_FUNCTIONS)
+    {
+        const SendCounters &counters = *m_send_counters[description.function];
+        transbot_sdk::SendFunctionStats function_stats{};
+        function_stats.function = static_cast<transbot_sdk::SEND_FUNCTION>(description.function);
+        function_stats.sent_frames = counters.sent_frames.load(std::memory_order_relaxed);
+        function_stats.dropped_frames = counters.dropped_frames.load(std::memory_order_relaxed);
+        function_stats.failed_writes = counters.failed_writes.load(std::memory_order_relaxed);
+        function_stats.queue_latency = counters.queue_latency.get_stats();
+        function_stats.write_latency = counters.write_latency.get_stats();
+        stats.sent_frames += function_stats.sent_frames;
+        stats.send_functions.push_back(function_stats);
+    }
+    for (const auto &description: transbot_sdk::RECEIVE_FUNCTIONS)
+    {
+        const ReceiveCounters &counters = *m_receive_counters[description.function];
+        transbot_sdk::ReceiveFunctionStats function_stats{};
+        function_stats.function = static_cast<transbot_sdk::RECEIVE_FUNCTION>(description.function);
+        function_stats.received_frames = counters.received_frames.load(std::memory_order_relaxed);
+        function_stats.timed_out_requests = counters.timed_out_requests.load(std::memory_order_relaxed);
+        function_stats.response_latency = counters.response_latency.get_stats();
+        stats.received_frames += function_stats.received_frames;
+        stats.receive_functions.push_back(function_stats);
+    }
+    stats.sent_bytes = m_sent_bytes.load(std::memory_order_relaxed);
+    stats.received_bytes = m_received_bytes.load(std::memory_order_relaxed);
+    stats.parser = m_parser.get_stats();
+    stats.memory_pool = m_memory_pool->get_stats();
+    return stats;
+}
+
+transbot_sdk::TelemetryFrame Protocol::latest(transbot_sdk::RECEIVE_FUNCTION function, int key) const
+{
+    return m_telemetry.latest(function, key);
+}
+
+bool Protocol::motion_at(std::chrono::steady_clock::time_point time, transbot_sdk::Motion_Info &motion_info) const
+{
+    return m_motion_history.at(time, motion_info);
+}
+
+bool Protocol::complete_request(const transbot_sdk::Package &package, std::chrono::steady_clock::time_point received_at)
+{
+    auto function = package.get_function().receive_function;
+    int key = function == transbot_sdk::ARM_SERVO_POSITION ? package.get_data_ptr()[4] : -1;
+
+    ResponseCallback callback;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        for (auto it = m_pending_requests.begin(); it != m_pending_requests.end(); ++it)
         {
-            // Get function type from the buffer[3]
-            auto receive_function = static_cast<transbot_sdk::RECEIVE_FUNCTION>(m_receive_buffer_ptr[3]);
-            // Check function type is valid
-            auto it = transbot_sdk::VALID_RECEIVE_FUNCTION.find(receive_function);
-            if (it == transbot_sdk::VALID_RECEIVE_FUNCTION.end())
+            if (it->function == function && (it->key < 0 || it->key == key))
             {
-                LOG(ERROR) << "Receive function is not valid.";
-                continue;
+                m_receive_counters[function]->response_latency.record(received_at - it->requested_at);
+                callback = std::move(it->callback);
+                m_pending_requests.erase(it);
+                break;
             }
-            else
+        }
+    }
+    if (!callback)
+    {
+        return false;
+    }
+    // Call back outside the lock, the callback may issue another request
+    callback(package);
+    return true;
+}
+
+int Protocol::expire_requests()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto next_deadline = std::chrono::steady_clock::time_point::max();
+    std::vector<ResponseCallback> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        for (auto it = m_pending_requests.begin(); it != m_pending_requests.end();)
+        {
+            if (it->deadline <= now)
             {
-                receive_function = *it;
+                m_receive_counters[it->function]->timed_out_requests.fetch_add(1, std::memory_order_relaxed);
+                expired.push_back(std::move(it->callback));
+                it = m_pending_requests.erase(it);
             }
-            // Parse the package
-            std::shared_ptr<transbot_sdk::Package> package = std::make_shared<transbot_sdk::Package>(receive_function);
-            package->set_data(m_receive_buffer_ptr);
-            // Check receive buffer exists, if not, create one
-            auto buffer = m_receive_buffer.find(receive_function);
-            if (buffer == m_receive_buffer.end())
+            else
             {
-                LOG(INFO) << "Create a new receive buffer for function: " << receive_function;
-                buffer = m_receive_buffer.emplace(
-                                             receive_function, std::make_shared<CircularBuffer<std::shared_ptr<transbot_sdk::Package>>>(10))
-                             .first;
+                next_deadline = std::min(next_deadline, it->deadline);
+                ++it;
             }
-            buffer->second->push(package);
         }
-        else
+        m_next_deadline = next_deadline.time_since_epoch().count();
+    }
+    for (auto &callback: expired)
+    {
+        TRANSBOT_LOG(WARNING, "Request timed out.");
+        callback(transbot_sdk::Package());
+    }
+
+    if (next_deadline == std::chrono::steady_clock::time_point::max())
+    {
+        return -1;
+    }
+    // Round up, waking up before the deadline would only loop once more
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(next_deadline - now).count();
+    return static_cast<int>((remaining + 999) / 1000);
+}
+
+bool Protocol::take(transbot_sdk::RECEIVE_FUNCTION receive_function, transbot_sdk::Package &package)
+{
+    // Check receive function is valid
+    if (!transbot_sdk::is_valid_receive_function(receive_function))
+    {
+        TRANSBOT_LOG(ERROR, "Receive function is not valid.");
+        return false;
+    }
+    // Get a package from the receive buffer
+    if (!m_receive_buffer[receive_function]->try_pop(package))
+    {
+        TRANSBOT_LOG(ERROR, "Receive buffer is empty.");
+        return false;
+    }
+    // Check package data is set
+    if (!package.is_data_set())
+    {
+        TRANSBOT_LOG(ERROR, "Package data is not set.");
+        return false;
+    }
+    return true;
+}
+
+Protocol::~Protocol()
+{
+    m_is_running = false;
+    // The transmit thread writes what is still queued before it exits
+    {
+        std::lock_guard<std::mutex> lock(m_transmit_mutex);
+        m_transmit_condition.notify_one();
+    }
+    if (m_transmit_thread.joinable())
+    {
+        TRANSBOT_LOG(INFO, "Join transmit thread.");
+        m_transmit_thread.join();
+    }
+    // Wake up the receive thread blocked in wait_for_data() so that it sees the flag right away
+    m_hardware->interrupt();
+    if (m_receive_thread.joinable())
+    {
+        TRANSBOT_LOG(INFO, "Join receive thread.");
+        m_receive_thread.join();
+    }
+    if (m_io_registration != 0)
+    {
+        // Returns once the loop is not receiving for this protocol anymore
+        m_io_loop->remove(m_io_registration);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+        m_dispatch_condition.notify_one();
+    }
+    if (m_dispatch_thread.joinable())
+    {
+        TRANSBOT_LOG(INFO, "Join dispatch thread.");
+        m_dispatch_thread.join();
+    }
+    // Nobody will answer the requests still pending
+    std::vector<PendingRequest> pending_requests;
+    {
+        std::lock_guard<std::mutex> lock(m_pending_mutex);
+        pending_requests.swap(m_pending_requests);
+    }
+    for (auto &pending: pending_requests)
+    {
+        pending.callback(transbot_sdk::Package());
+    }
+}
+
+void Protocol::receive_thread()
+{
+    TRANSBOT_LOG(INFO, "Receive thread started.");
+    while (m_is_running)
+    {
+        // Sleep until bytes arrive, the next request deadline, or interrupt() is called
+        if (!m_hardware->wait_for_data(expire_requests()))
+        {
+            continue;
+        }
+        receive_available();
+    }
+}
+
+int Protocol::service_receive()
+{
+    // The loop calls back on the deadlines too, when the hardware may have nothing to read
+    if (m_hardware->wait_for_data(0))
+    {
+        receive_available();
+    }
+    return expire_requests();
+}
+
+void Protocol::receive_available()
+{
+    // Read everything the hardware has in one call, the parser keeps partial frames for the next read
+    uint8_t *staging = m_parser.write_ptr();
+    int receive = m_hardware->receive(staging, m_parser.writable());
+    if (receive <= 0)
+    {
+        return;
+    }
+    m_parser.commit(receive);
+    m_received_bytes.fetch_add(receive, std::memory_order_relaxed);
+    auto received_at = std::chrono::steady_clock::now();
+
+    const uint8_t *frame = nullptr;
+    uint8_t length = 0;
+    while (m_parser.next_frame(frame, length))
+    {
+        handle_frame(frame, received_at);
+    }
+}
+
+void Protocol::handle_frame(const uint8_t *frame, std::chrono::steady_clock::time_point received_at)
+{
+    // The parser only returns frames of a valid receive function
+    auto receive_function = static_cast<transbot_sdk::RECEIVE_FUNCTION>(frame[3]);
+    // Parse the package
+    transbot_sdk::Package package(receive_function);
+    package.set_data(frame);
+    m_receive_counters[receive_function]->received_frames.fetch_add(1, std::memory_order_relaxed);
+    // Readers of the latest values see the frame before anybody is called back with it
+    m_telemetry.update(package, received_at);
+    if (m_flight_recorder)
+    {
+        m_flight_recorder->record(transbot_sdk::RECEIVE, frame, package.get_length(), received_at);
+    }
+    if (receive_function == transbot_sdk::MOTION_STATUS)
+    {
+        m_motion_history.record(transbot_sdk::to_motion_info(
+                *transbot_sdk::decode<transbot_sdk::Movement_Status_Response>(package)), received_at);
+    }
+    if (complete_request(package, received_at))
+    {
+        return;
+    }
+    if (std::atomic_load(&m_subscriptions[receive_function]))
+    {
+        m_dispatch_queue.push(package);
+        // Pairs with the fence in dispatch_thread(), like enqueue() does for the transmit thread
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_dispatch_waiting.load(std::memory_order_relaxed))
         {
-            LOG(WARNING) << "Invalid data received from hardware, returned bytes: " << receive << ".";
+            std::lock_guard<std::mutex> lock(m_dispatch_mutex);
+            m_dispatch_condition.notify_one();
         }
     }
-    delete single_buffer;
+    // The oldest package is dropped if nobody has taken it
+    m_receive_buffer[receive_function]->push(std::move(package));
 }
@@ -1,13 +1,27 @@
 #ifndef TRANSBOT_SDK_PROTOCOL_HPP
 #define TRANSBOT_SDK_PROTOCOL_HPP
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <mutex>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 #include "package.hpp"
 #include "../hardware/hardware_interface.hpp"
+#include "../hardware/io_loop.hpp"
 #include "memory_pool.hpp"
 #include "circular_buffer.hpp"
+#include "flight_recorder.hpp"
+#include "frame_parser.hpp"
+#include "motion_history.hpp"
+#include "mpsc_queue.hpp"
+#include "protocol_stats.hpp"
+#include "telemetry_store.hpp"
 
 /**
  * @brief Protocol layer for transbot
@@ -17,25 +31,376 @@
 class Protocol
 {
 public:
-    Protocol();
+    /**
+     * @brief Callback completing a request, called with the response, or with a package without data if the request
+     * failed or timed out
+     * @note The callback is called on the receive thread and must not block
+     */
+    typedef std::function<void(const transbot_sdk::Package &)> ResponseCallback;
+
+    /**
+     * @brief Callback receiving every frame of a receive function
+     * @note The callback is called on the dispatcher thread, a slow callback delays the other subscriptions and makes
+     * the oldest frames waiting for dispatch be dropped
+     */
+    typedef std::function<void(const transbot_sdk::Package &)> FrameCallback;
+
+    /**
+     * @brief Constructor of protocol on a serial port
+     * @param port_name Path of the serial port, e.g. a pty slave of the firmware emulator
+     * @param io_loop Loop receiving for this and other protocols, nullptr for a receive thread of its own
+     */
+    explicit Protocol(const std::string &port_name = "/dev/ttyTHS1",
+                      std::shared_ptr<transbot_sdk::IoLoop> io_loop = nullptr);
+
+    /**
+     * @brief Constructor of protocol on any hardware
+     * @param hardware Hardware to send and receive data
+     * @param io_loop Loop receiving for this and other protocols, nullptr for a receive thread of its own. Hardware
+     * without an event descriptor gets a receive thread of its own anyway.
+     */
+    explicit Protocol(std::shared_ptr<transbot_sdk::HardwareInterface> hardware,
+                      std::shared_ptr<transbot_sdk::IoLoop> io_loop = nullptr);
 
     ~Protocol();
 
     bool init();
 
-    bool send(const std::shared_ptr<transbot_sdk::Package> &package);
+    /**
+     * @brief Queue a package for the transmit thread and return at once
+     * @details The transmit thread paces packages by the time their bytes take on the wire at the baud rate of the
+     * hardware, plus the guard time the firmware needs for their function. Safe to call from any thread.
+     * @param package The package to send, moved into the transmit queue
+     * @return true if the package is valid and queued
+     */
+    bool send(transbot_sdk::Package package);
+
+    /**
+     * @brief Queue packages to be written together and return at once
+     * @details The packages are queued next to each other, and the transmit thread writes them back to back in a single
+     * write of the hardware. Only packages whose guard time is longer than MAX_COALESCED_GUARD_TIME, e.g. those the
+     * firmware writes to flash or relays to the servo bus, end a write, and the rest follows after their guard time.
+     * Safe to call from any thread.
+     * @param packages The packages to send, in order
+     * @param count Number of packages, at most MAX_BATCH_SIZE
+     * @return true if all packages are valid and queued, nothing is queued otherwise
+     */
+    bool send_batch(const transbot_sdk::Package *packages, size_t count);
+
+    /**
+     * @brief Set the time the firmware needs after a package of a function before it accepts the next one
+     * @note Call this before init()
+     * @param function Send function
+     * @param guard_time Time to wait after the package has been put on the wire
+     */
+    void set_guard_time(transbot_sdk::SEND_FUNCTION function, std::chrono::microseconds guard_time);
+
+    /**
+     * @brief Get the time the transmit thread takes for a package, its bytes on the wire plus its guard time
+     * @details The inverse is the most packages like it the link carries per second.
+     * @param package The package
+     * @return Shortest time from writing the package until the next one is written
+     */
+    std::chrono::nanoseconds get_send_interval(const transbot_sdk::Package &package) const;
+
+    /**
+     * @brief Run the transmit thread with SCHED_FIFO, so packages of a real-time thread are not held up by others
+     * @note Call this after init()
+     * @param priority 1-99, 0 for the default scheduler
+     * @return false if the protocol is not running or the process may not change the scheduler
+     */
+    bool set_transmit_priority(int priority);
+
+    /**
+     * @brief Record every frame sent and received into a memory-mapped ring file, see FlightRecorder
+     * @note Call this before init()
+     * @param path Path of the ring file, created if it does not exist
+     * @param frames Number of frames kept in the file
+     * @return false if the file cannot be opened, frames are not recorded then
+     */
+    bool record_frames(const std::string &path, size_t frames);
+
+    /**
+     * @brief Take the oldest package of a function from the receive buffer
+     * @param receive_function Receive function
+     * @param package Set to the package taken
+     * @return false if no package of the function has been received
+     */
+    bool take(transbot_sdk::RECEIVE_FUNCTION receive_function, transbot_sdk::Package &package);
 
-    std::shared_ptr<transbot_sdk::Package> take(transbot_sdk::RECEIVE_FUNCTION receive_function);
+    /**
+     * @brief Send a SEND_REQUEST package and get its response as soon as it is parsed
+     * @details The response is matched by its function, which is the requested data type, and by servo id for
+     * ARM_SERVO_POSITION. Responses that match no pending request still go to the receive buffer.
+     * @param package The SEND_REQUEST package to send
+     * @param timeout Time to wait for the response
+     * @return Future of the response, which has no data set if the request failed or timed out
+     */
+    std::future<transbot_sdk::Package> request(const transbot_sdk::Package &package, std::chrono::milliseconds timeout);
+
+    /**
+     * @brief Send a SEND_REQUEST package and call back with its response as soon as it is parsed
+     * @param package The SEND_REQUEST package to send
+     * @param timeout Time to wait for the response
+     * @param callback Called exactly once, with the response or with a package without data if the request failed or
+     * timed out
+     * @return false if the package could not be sent, the callback has been called already then
+     */
+    bool request(const transbot_sdk::Package &package, std::chrono::milliseconds timeout, ResponseCallback callback);
+
+    /**
+     * @brief Call back with every received frame of a function, e.g. MOTION_STATUS reported automatically
+     * @details Frames completing a request are not passed to subscriptions. Frames still go to the receive buffer, so
+     * take() keeps working. Safe to call from any thread, also from a callback.
+     * @param function Receive function
+     * @param callback Called on the dispatcher thread, nullptr to unsubscribe
+     */
+    void subscribe(transbot_sdk::RECEIVE_FUNCTION function, FrameCallback callback);
+
+    /**
+     * @brief Get the latest frame received of a function, without waiting for the receive thread
+     * @details Every received frame updates it, also responses to requests and frames nobody takes from the receive
+     * buffer. Safe to call from any thread at any rate.
+     * @param function Receive function
+     * @param key Servo id for ARM_SERVO_POSITION, -1 for the latest of any servo
+     * @return The latest frame, with sequence 0 if none has been received
+     */
+    transbot_sdk::TelemetryFrame latest(transbot_sdk::RECEIVE_FUNCTION function, int key = -1) const;
+
+    /**
+     * @brief Get the motion info at a time, interpolated between the MOTION_STATUS frames received around it
+     * @details The last MOTION_HISTORY_SIZE frames are kept. Safe to call from any thread, never blocks nor allocates.
+     * @param time Time on the steady clock, e.g. the capture time of a camera frame
+     * @param motion_info Set to the motion info at the time
+     * @return false if the time is before the oldest or after the newest frame kept
+     */
+    bool motion_at(std::chrono::steady_clock::time_point time, transbot_sdk::Motion_Info &motion_info) const;
+
+    /**
+     * @brief Get the usage of the memory pool backing pending requests
+     * @return Usage statistics of the pool
+     */
+    MemoryPoolStats get_memory_pool_stats() const;
+
+    /**
+     * @brief Get the counters of frames accepted and rejected by the receive thread
+     * @return Counters of the frame parser
+     */
+    transbot_sdk::FrameParserStats get_parser_stats() const;
+
+    /**
+     * @brief Get the frames and bytes sent and received, and the latencies of each function
+     * @details The counters and histograms are updated by the threads of the protocol with relaxed atomics only, so
+     * the snapshot can be taken at any rate from any thread without slowing them down.
+     * @return Snapshot of the statistics
+     */
+    transbot_sdk::ProtocolStats get_stats() const;
+
+    //! capacity of the transmit queue
+    static const size_t TRANSMIT_QUEUE_SIZE = 64;
+    //! most packages of a batch, a batch has to fit into the transmit queue
+    static const size_t MAX_BATCH_SIZE = TRANSMIT_QUEUE_SIZE;
+    //! packages of a batch with a guard time up to this are written back to back with the packages after them
+    static constexpr std::chrono::microseconds MAX_COALESCED_GUARD_TIME{2000};
 
 private:
+    /**
+     * @brief A request waiting for its response
+     */
+    typedef struct _pending_request
+    {
+        //! unique id of the request
+        uint64_t id;
+        //! function of the response
+        transbot_sdk::RECEIVE_FUNCTION function;
+        //! servo id for ARM_SERVO_POSITION, -1 if any response of the function matches
+        int key;
+        //! time request() was called
+        std::chrono::steady_clock::time_point requested_at;
+        //! the request fails if no response arrives before this time
+        std::chrono::steady_clock::time_point deadline;
+        ResponseCallback callback;
+    } PendingRequest;
+
+    /**
+     * @brief A package waiting in the transmit queue
+     */
+    typedef struct _queued_package
+    {
+        transbot_sdk::Package package;
+        //! time the package was queued
+        std::chrono::steady_clock::time_point queued_at;
+        //! number of packages of the same batch queued right after this one
+        size_t batch_remaining;
+    } QueuedPackage;
+
+    /**
+     * @brief Counters of a send function, see SendFunctionStats
+     */
+    typedef struct _send_counters
+    {
+        std::atomic<uint64_t> sent_frames{0};
+        std::atomic<uint64_t> dropped_frames{0};
+        std::atomic<uint64_t> failed_writes{0};
+        transbot_sdk::LatencyHistogram queue_latency;
+        transbot_sdk::LatencyHistogram write_latency;
+    } SendCounters;
+
+    /**
+     * @brief Counters of a receive function, see ReceiveFunctionStats
+     */
+    typedef struct _receive_counters
+    {
+        std::atomic<uint64_t> received_frames{0};
+        std::atomic<uint64_t> timed_out_requests{0};
+        transbot_sdk::LatencyHistogram response_latency;
+    } ReceiveCounters;
+
+    //! receive buffer of a function, filled by the receive thread and taken from by any thread
+    typedef CircularBuffer<transbot_sdk::Package, true> ReceiveBuffer;
+
+    //! capacity of the queue of frames waiting for the dispatcher thread
+    static const size_t DISPATCH_QUEUE_SIZE = 64;
+    //! largest block of the request memory pool, enough for the shared state of a promise of a package
+    static const size_t REQUEST_BLOCK_SIZE = 256;
+    //! size of the request memory pool
+    static const size_t REQUEST_POOL_SIZE = 16384;
+    //! number of blocks in the request memory pool
+    static const size_t REQUEST_POOL_BLOCKS = 128;
+    //! number of MOTION_STATUS frames kept for motion_at(), 10 seconds of reports at 100Hz
+    static const size_t MOTION_HISTORY_SIZE = 1024;
+
     std::shared_ptr<transbot_sdk::HardwareInterface> m_hardware;
 
     void receive_thread();
 
-    uint8_t *m_receive_buffer_ptr;
-    bool m_is_running;
+    /**
+     * @brief Read what the hardware has received and handle the complete frames, on the receive thread or the io loop
+     */
+    void receive_available();
+
+    /**
+     * @brief Handler of the io loop, receives if the hardware is readable and fails expired requests
+     * @return Milliseconds until the next request deadline, -1 if no request is pending
+     */
+    int service_receive();
+
+    void transmit_thread();
+
+    void dispatch_thread();
+
+    /**
+     * @brief Get the time the hardware needs to put one byte on the wire: a start bit, 8 data bits and a stop bit
+     * @return Time of a byte at the baud rate of the hardware
+     */
+    std::chrono::nanoseconds get_byte_time() const;
+
+    /**
+     * @brief Get the default guard time of a function
+     * @param function Send function
+     * @return Time the firmware needs after a package of the function
+     */
+    static std::chrono::microseconds default_guard_time(transbot_sdk::SEND_FUNCTION function);
+
+    /**
+     * @brief Check a package can be sent
+     * @param package Package to check
+     * @return true if the package is a complete send package of a valid function
+     */
+    bool is_valid_send_package(const transbot_sdk::Package &package) const;
+
+    /**
+     * @brief Push a package into the transmit queue and wake up the transmit thread if it sleeps
+     * @param package Package to queue
+     * @return false if the protocol is not running or the queue is full
+     */
+    bool enqueue(transbot_sdk::Package package);
+
+    /**
+     * @brief Wake up the transmit thread if it sleeps, after packages have been pushed into the transmit queue
+     */
+    void wake_transmit_thread();
+
+    /**
+     * @brief Write packages back to back to the hardware in one call, only called on the transmit thread
+     * @param queued Packages to write, with the time they were queued
+     * @param count Number of packages
+     * @return Number of bytes written
+     */
+    size_t transmit(const QueuedPackage *queued, size_t count);
+
+    /**
+     * @brief Complete the oldest pending request matching a response
+     * @param package The response
+     * @param received_at Time the response was read from the hardware
+     * @return true if a pending request took the response
+     */
+    bool complete_request(const transbot_sdk::Package &package, std::chrono::steady_clock::time_point received_at);
+
+    /**
+     * @brief Fail pending requests whose deadline has passed
+     * @return Milliseconds until the next deadline, -1 if no request is pending
+     */
+    int expire_requests();
+
+    /**
+     * @brief Store a complete frame extracted by the frame parser into the receive buffer of its function
+     * @param frame Frame data, including header and checksum
+     * @param received_at Time the frame was read from the hardware
+     */
+    void handle_frame(const uint8_t *frame, std::chrono::steady_clock::time_point received_at);
+
+    transbot_sdk::FrameParser m_parser;
+    //! recorder of the frames sent and received, nullptr if they are not recorded
+    std::unique_ptr<transbot_sdk::FlightRecorder> m_flight_recorder;
+    //! latest frame of each receive function
+    transbot_sdk::TelemetryStore m_telemetry;
+    //! motion info of the latest MOTION_STATUS frames
+    transbot_sdk::MotionHistory m_motion_history;
+    std::atomic<bool> m_is_running;
     std::thread m_receive_thread;
-    std::unordered_map<transbot_sdk::RECEIVE_FUNCTION, std::shared_ptr<CircularBuffer<std::shared_ptr<transbot_sdk::Package>>>> m_receive_buffer;
+    //! loop receiving instead of m_receive_thread, if any
+    std::shared_ptr<transbot_sdk::IoLoop> m_io_loop;
+    //! registration of the hardware in m_io_loop, 0 if not registered
+    uint64_t m_io_registration;
+    std::thread m_transmit_thread;
+    std::thread m_dispatch_thread;
+    //! packages waiting for the transmit thread
+    MpscQueue<QueuedPackage> m_transmit_queue;
+    //! mutex the transmit thread sleeps on when the queue is empty
+    std::mutex m_transmit_mutex;
+    std::condition_variable m_transmit_condition;
+    //! set while the transmit thread is about to sleep or sleeping
+    std::atomic<bool> m_transmit_waiting;
+    //! frames of subscribed functions waiting for the dispatcher thread, the oldest is dropped when full
+    CircularBuffer<transbot_sdk::Package> m_dispatch_queue;
+    //! mutex the dispatcher thread sleeps on when the queue is empty
+    std::mutex m_dispatch_mutex;
+    std::condition_variable m_dispatch_condition;
+    //! set while the dispatcher thread is about to sleep or sleeping
+    std::atomic<bool> m_dispatch_waiting;
+    //! subscription of each receive function, indexed by function byte, replaced atomically
+    std::shared_ptr<const FrameCallback> m_subscriptions[256];
+    //! guard time of each send function
+    std::chrono::microseconds m_guard_time[256];
+    //! receive buffer of each receive function, indexed by function byte, empty for other bytes
+    std::unique_ptr<ReceiveBuffer> m_receive_buffer[256];
+    //! counters of each send function, indexed by function byte, empty for other bytes
+    std::unique_ptr<SendCounters> m_send_counters[256];
+    //! counters of each receive function, indexed by function byte, empty for other bytes
+    std::unique_ptr<ReceiveCounters> m_receive_counters[256];
+    std::atomic<uint64_t> m_sent_bytes;
+    std::atomic<uint64_t> m_received_bytes;
+    //! memory of the promises of pending requests, shared with the futures handed out
+    std::shared_ptr<MemoryPool> m_memory_pool;
+    //! mutex of the pending requests
+    std::mutex m_pending_mutex;
+    //! requests waiting for their response, oldest first
+    std::vector<PendingRequest> m_pending_requests;
+    //! id of the next request
+    uint64_t m_next_request_id;
+    //! deadline the receive thread wakes up for, in steady clock ticks
+    std::atomic<std::chrono::steady_clock::rep> m_next_deadline;
 };
 
 #endif // TRANSBOT_SDK_PROTOCOL_HPP
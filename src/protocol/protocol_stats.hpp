@@ -0,0 +1,64 @@
+#ifndef TRANSBOT_SDK_PROTOCOL_STATS_HPP
+#define TRANSBOT_SDK_PROTOCOL_STATS_HPP
+
+#include <cstdint>
+#include <vector>
+#include "frame_parser.hpp"
+#include "latency_histogram.hpp"
+#include "memory_pool.hpp"
+#include "package.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief Counters and latencies of the packages of a send function
+     */
+    typedef struct _send_function_stats
+    {
+        SEND_FUNCTION function;
+        //! packages written completely to the hardware
+        uint64_t sent_frames;
+        //! packages dropped because the transmit queue was full or the protocol was not running
+        uint64_t dropped_frames;
+        //! packages the hardware did not write completely
+        uint64_t failed_writes;
+        //! time from send() or request() until the transmit thread starts writing, including the pacing
+        LatencyStats queue_latency;
+        //! time the hardware takes to write a package
+        LatencyStats write_latency;
+    } SendFunctionStats;
+
+    /**
+     * @brief Counters and latencies of the frames of a receive function
+     */
+    typedef struct _receive_function_stats
+    {
+        RECEIVE_FUNCTION function;
+        //! valid frames received, including responses to requests
+        uint64_t received_frames;
+        //! requests for the function which timed out without a response
+        uint64_t timed_out_requests;
+        //! time from request() until the response has been read, one per answered request
+        LatencyStats response_latency;
+    } ReceiveFunctionStats;
+
+    /**
+     * @brief Runtime statistics of the protocol, a snapshot taken without stopping its threads
+     */
+    typedef struct _protocol_stats
+    {
+        uint64_t sent_frames;
+        uint64_t sent_bytes;
+        uint64_t received_frames;
+        //! bytes read from the hardware, including those the frame parser dropped
+        uint64_t received_bytes;
+        //! one entry per send function, in the order of SEND_FUNCTIONS
+        std::vector<SendFunctionStats> send_functions;
+        //! one entry per receive function, in the order of RECEIVE_FUNCTIONS
+        std::vector<ReceiveFunctionStats> receive_functions;
+        FrameParserStats parser;
+        MemoryPoolStats memory_pool;
+    } ProtocolStats;
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_PROTOCOL_STATS_HPP
@@ -0,0 +1,100 @@
+#ifndef TRANSBOT_SDK_SEQLOCK_HPP
+#define TRANSBOT_SDK_SEQLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+/**
+ * @brief A value written by a single thread and read by any number of threads without locks
+ * @details The sequence number is odd while the writer updates the value. A reader copies the value between two reads
+ * of the sequence number and copies it again if the number has changed, so readers never hold up the writer and the
+ * writer never waits for readers. The value is stored in atomic words, which keeps the torn copies readers throw away
+ * free of data races.
+ * @tparam T Trivially copyable type of the value
+ */
+template<class T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "The value of a seqlock is copied bytewise");
+
+public:
+    Seqlock()
+    {
+        sequence.store(0, std::memory_order_relaxed);
+        for (auto &word: words)
+        {
+            word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Seqlock(const Seqlock &) = delete;
+
+    Seqlock &operator=(const Seqlock &) = delete;
+
+    /**
+     * @brief Replace the value, only called by the single writer thread
+     * @param value New value
+     */
+    void store(const T &value)
+    {
+        uint64_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint64_t current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        // Readers seeing any of the new words also see the odd sequence number
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(current + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy the value, safe to call from any thread
+     * @param value Set to the latest value stored
+     * @return Number of values stored so far, 0 if the value has never been stored and is left untouched
+     */
+    uint64_t load(T &value) const
+    {
+        uint64_t buffer[WORDS];
+        while (true)
+        {
+            uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before == 0)
+            {
+                return 0;
+            }
+            if (before & 1)
+            {
+                // The writer is in the middle of an update, which takes a few stores unless it has been preempted
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < WORDS; i++)
+            {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            // The words are read before the sequence number is read again
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+            {
+                memcpy(&value, buffer, sizeof(T));
+                return before / 2;
+            }
+        }
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    //! twice the number of values stored, plus one while a value is being stored
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[WORDS];
+};
+
+#endif // TRANSBOT_SDK_SEQLOCK_HPP
@@ -0,0 +1,37 @@
+#include "telemetry_store.hpp"
+
+namespace transbot_sdk
+{
+    void TelemetryStore::update(const Package &package, std::chrono::steady_clock::time_point received_at)
+    {
+        Entry entry;
+        entry.package = package;
+        entry.received_at = received_at.time_since_epoch().count();
+        auto function = package.get_function().receive_function;
+        if (function == ARM_SERVO_POSITION)
+        {
+            m_servo_positions[package.get_data_ptr()[4]].store(entry);
+        }
+        m_latest[function].store(entry);
+    }
+
+    TelemetryFrame TelemetryStore::latest(RECEIVE_FUNCTION function, int key) const
+    {
+        const Seqlock<Entry> *slot = &m_latest[function];
+        if (function == ARM_SERVO_POSITION && key >= 0 && key < 256)
+        {
+            slot = &m_servo_positions[key];
+        }
+
+        TelemetryFrame frame;
+        Entry entry;
+        frame.sequence = slot->load(entry);
+        if (frame.sequence != 0)
+        {
+            frame.package = entry.package;
+            frame.received_at = std::chrono::steady_clock::time_point(
+                    std::chrono::steady_clock::duration(entry.received_at));
+        }
+        return frame;
+    }
+} // transbot_sdk
@@ -0,0 +1,71 @@
+#ifndef TRANSBOT_SDK_TELEMETRY_STORE_HPP
+#define TRANSBOT_SDK_TELEMETRY_STORE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include "package.hpp"
+#include "seqlock.hpp"
+
+namespace transbot_sdk
+{
+    /**
+     * @brief The latest frame received of a function
+     */
+    typedef struct _telemetry_frame
+    {
+        //! the frame, without data if none has been received
+        Package package;
+        //! number of frames of the function received so far, 0 if none has been received
+        uint64_t sequence;
+        //! time the frame was read from the hardware
+        std::chrono::steady_clock::time_point received_at;
+    } TelemetryFrame;
+
+    /**
+     * @brief Latest frame of each receive function, updated in place by the receive thread
+     * @details Every frame replaces the previous frame of its function, servo positions are kept per servo id. Readers
+     * copy the latest frame out of a seqlock, so they never wait for the receive thread nor for each other, however
+     * often they read.
+     */
+    class TelemetryStore
+    {
+    public:
+        TelemetryStore() = default;
+
+        TelemetryStore(const TelemetryStore &) = delete;
+
+        TelemetryStore &operator=(const TelemetryStore &) = delete;
+
+        /**
+         * @brief Replace the latest frame of the function of a package, only called on the receive thread
+         * @param package A complete receive package
+         * @param received_at Time the frame was read from the hardware
+         */
+        void update(const Package &package, std::chrono::steady_clock::time_point received_at);
+
+        /**
+         * @brief Get the latest frame of a function, safe to call from any thread
+         * @param function Receive function
+         * @param key Servo id for ARM_SERVO_POSITION, -1 for the latest of any servo, ignored for other functions
+         * @return The latest frame, with sequence 0 if none has been received
+         */
+        TelemetryFrame latest(RECEIVE_FUNCTION function, int key = -1) const;
+
+    private:
+        /**
+         * @brief What the seqlocks hold, the sequence number comes from the seqlock itself
+         */
+        typedef struct _entry
+        {
+            Package package;
+            std::chrono::steady_clock::rep received_at;
+        } Entry;
+
+        //! latest frame of each receive function, indexed by function byte
+        Seqlock<Entry> m_latest[256];
+        //! latest ARM_SERVO_POSITION frame of each servo, indexed by servo id
+        Seqlock<Entry> m_servo_positions[256];
+    };
+} // transbot_sdk
+
+#endif // TRANSBOT_SDK_TELEMETRY_STORE_HPP
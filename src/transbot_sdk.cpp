@@ -1,6 +1,6 @@
 #include "transbot_sdk/transbot_sdk.hpp"
-#include "protocol/package.hpp"
-#include "glog/logging.h"
+#include "protocol/codec.hpp"
+#include "log/async_log.hpp"
 
 namespace transbot_sdk
 {
@@ -10,288 +10,279 @@ namespace transbot_sdk
         return this->protocol.init();
     }
 
-    void Transbot::set_chassis_motion(double linear_velocity, double angular_velocity)
+    bool Transbot::enable_flight_recorder(const std::string &path, size_t frames)
+    {
+        return this->protocol.record_frames(path, frames);
+    }
+
+    bool Transbot::encode_chassis_motion(double linear_velocity, double angular_velocity, Package &package)
     {
         if (linear_velocity < -0.45)
         {
-            LOG(ERROR) << "Linear velocity out of range: " << linear_velocity << ", set to -45";
+            TRANSBOT_LOG(ERROR, "Linear velocity out of range: {}, set to -45", linear_velocity);
             linear_velocity = -0.45;
         }
         else if (linear_velocity > 0.45)
         {
-            LOG(ERROR) << "Linear velocity out of range: " << linear_velocity << ", set to 45";
+            TRANSBOT_LOG(ERROR, "Linear velocity out of range: {}, set to 45", linear_velocity);
             linear_velocity = 0.45;
         }
         if (angular_velocity < -2.00)
         {
-            LOG(ERROR) << "Angular velocity out of range: " << angular_velocity << ", set to -200";
+            TRANSBOT_LOG(ERROR, "Angular velocity out of range: {}, set to -200", angular_velocity);
             angular_velocity = -2.00;
         }
         else if (angular_velocity > 2.00)
         {
-            LOG(ERROR) << "Angular velocity out of range: " << angular_velocity << ", set to 200";
+            TRANSBOT_LOG(ERROR, "Angular velocity out of range: {}, set to 200", angular_velocity);
             angular_velocity = 2.00;
         }
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_CHASSIS_MOTION);
-        auto data = new Move_Control(static_cast<int8_t>(100*linear_velocity),
-                                     static_cast<int16_t>(100*angular_velocity));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        package = encode(Move_Control(static_cast<int8_t>(100*linear_velocity),
+                                      static_cast<int16_t>(100*angular_velocity)));
+        return true;
+    }
 
+    void Transbot::set_chassis_motion(double linear_velocity, double angular_velocity)
+    {
+        Package package;
+        if (!encode_chassis_motion(linear_velocity, angular_velocity, package))
+        {
+            return;
+        }
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set chassis motion successfully. \n"
-                      << "Linear velocity: " << static_cast<int>(linear_velocity) << "\n"
-                      << "Angular velocity: " << static_cast<int>(angular_velocity) << "\n";
+            TRANSBOT_LOG(INFO, "Set chassis motion successfully. Linear velocity: {}, Angular velocity: {}",
+                         static_cast<int>(linear_velocity), static_cast<int>(angular_velocity));
         }
         else
         {
-            LOG(ERROR) << "Set chassis motion failed."
-                       << "Linear velocity: " << static_cast<int>(linear_velocity)
-                       << "Angular velocity: " << static_cast<int>(angular_velocity);
+            TRANSBOT_LOG(ERROR, "Set chassis motion failed. Linear velocity: {}, Angular velocity: {}",
+                         static_cast<int>(linear_velocity), static_cast<int>(angular_velocity));
         }
+    }
 
-        delete data;
+    bool Transbot::encode_camara_angle(transbot_sdk::TRANSBOT_CAMARA_CHANNEL channel, int angle, Package &package)
+    {
+        if (angle < 50 || angle > 130)
+        {
+            TRANSBOT_LOG(ERROR, "Angle out of range: {}", angle);
+            return false;
+        }
+        package = encode(PWM_Servo_Control(static_cast<uint8_t>(channel),
+                                           static_cast<uint8_t>(angle)));
+        return true;
     }
 
     void Transbot::set_camara_angle(transbot_sdk::TRANSBOT_CAMARA_CHANNEL channel, int angle)
     {
-        if (angle < 50 || angle > 130)
+        Package package;
+        if (!encode_camara_angle(channel, angle, package))
         {
-            LOG(ERROR) << "Angle out of range: " << angle;
             return;
         }
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_PWM_SERVO);
-        auto data = new PWM_Servo_Control(static_cast<uint8_t>(channel),
-                                          static_cast<uint8_t>(angle));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set camara angle successfully."
-                      << "Channel: " << static_cast<int>(channel)
-                      << "Angle: " << angle;
+            TRANSBOT_LOG(INFO, "Set camara angle successfully. Channel: {}, Angle: {}",
+                         static_cast<int>(channel), angle);
         }
         else
         {
-            LOG(ERROR) << "Set camara angle failed."
-                       << "Channel: " << static_cast<int>(channel)
-                       << "Angle: " << angle;
+            TRANSBOT_LOG(ERROR, "Set camara angle failed. Channel: {}, Angle: {}", static_cast<int>(channel), angle);
         }
-
-        delete data;
     }
 
-    void Transbot::set_led_strip(int id, int r, int g, int b)
+    bool Transbot::encode_led_strip(int id, int r, int g, int b, Package &package)
     {
         if (id != 0xff && (id < 0 || id > 16))
         {
-            LOG(ERROR) << "Led id out of range: " << id;
-            return;
+            TRANSBOT_LOG(ERROR, "Led id out of range: {}", id);
+            return false;
         }
         if (r < 0 || r > 255)
         {
-            LOG(ERROR) << "Red out of range: " << r;
-            return;
+            TRANSBOT_LOG(ERROR, "Red out of range: {}", r);
+            return false;
         }
         if (g < 0 || g > 255)
         {
-            LOG(ERROR) << "Green out of range: " << g;
-            return;
+            TRANSBOT_LOG(ERROR, "Green out of range: {}", g);
+            return false;
         }
         if (b < 0 || b > 255)
         {
-            LOG(ERROR) << "Blue out of range: " << b;
-            return;
+            TRANSBOT_LOG(ERROR, "Blue out of range: {}", b);
+            return false;
         }
 
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_LED_STRIP);
-
-        auto data = new RGB_Control(static_cast<uint8_t>(id),
-                                    static_cast<uint8_t>(r),
-                                    static_cast<uint8_t>(g),
-                                    static_cast<uint8_t>(b));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        package = encode(RGB_Control(static_cast<uint8_t>(id),
+                                     static_cast<uint8_t>(r),
+                                     static_cast<uint8_t>(g),
+                                     static_cast<uint8_t>(b)));
+        return true;
+    }
 
+    void Transbot::set_led_strip(int id, int r, int g, int b)
+    {
+        Package package;
+        if (!encode_led_strip(id, r, g, b, package))
+        {
+            return;
+        }
+        // The strip may show something else than the framebuffer now
+        framebuffer.invalidate();
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set led strip successfully."
-                      << "Id: " << id
-                      << "R: " << r << "G: " << g << "B: " << b;
+            TRANSBOT_LOG(INFO, "Set led strip successfully. Id: {}, R: {}, G: {}, B: {}", id, r, g, b);
         }
         else
         {
-            LOG(ERROR) << "Set led strip failed."
-                       << "Id: " << id
-                       << "R: " << r << "G: " << g << "B: " << b;
+            TRANSBOT_LOG(ERROR, "Set led strip failed. Id: {}, R: {}, G: {}, B: {}", id, r, g, b);
         }
-
-        delete data;
     }
 
-    void Transbot::set_strip_effect(int effect, int velocity, int param)
+    bool Transbot::encode_strip_effect(int effect, int velocity, int param, Package &package)
     {
         if (effect < 0 || effect > 6)
         {
-            LOG(ERROR) << "Effect out of range: " << effect;
-            return;
+            TRANSBOT_LOG(ERROR, "Effect out of range: {}", effect);
+            return false;
         }
         if (velocity < 1 || velocity > 10)
         {
-            LOG(ERROR) << "Velocity out of range: " << velocity;
-            return;
+            TRANSBOT_LOG(ERROR, "Velocity out of range: {}", velocity);
+            return false;
         }
 
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_STRIP_EFFECT);
-        auto data = new RGB_Effect(static_cast<uint8_t>(effect),
-                                   static_cast<uint8_t>(velocity),
-                                   static_cast<uint8_t>(param));
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        package = encode(RGB_Effect(static_cast<uint8_t>(effect),
+                                    static_cast<uint8_t>(velocity),
+                                    static_cast<uint8_t>(param)));
+        return true;
+    }
+
+    void Transbot::set_strip_effect(int effect, int velocity, int param)
+    {
+        Package package;
+        if (!encode_strip_effect(effect, velocity, param, package))
+        {
+            return;
+        }
+        framebuffer.invalidate();
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set led strip effect successfully."
-                      << "Effect: " << effect
-                      << "Velocity: " << velocity << "Param: " << param;
+            TRANSBOT_LOG(INFO, "Set led strip effect successfully. Effect: {}, Velocity: {}, Param: {}",
+                         effect, velocity, param);
         }
         else
         {
-            LOG(ERROR) << "Set led strip effect failed."
-                       << "Effect: " << effect
-                       << "Velocity: " << velocity << "Param: " << param;
+            TRANSBOT_LOG(ERROR, "Set led strip effect failed. Effect: {}, Velocity: {}, Param: {}",
+                         effect, velocity, param);
         }
-
-        delete data;
     }
 
-    void Transbot::set_beep(int duration)
+    bool Transbot::encode_beep(int duration, Package &package)
     {
         if (duration < 0 || duration > 255)
         {
-            LOG(ERROR) << "Duration out of range: " << duration;
-            return;
+            TRANSBOT_LOG(ERROR, "Duration out of range: {}", duration);
+            return false;
         }
 
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_BEEP);
+        package = encode(Buzzer(static_cast<uint8_t>(duration)));
+        return true;
+    }
 
-        auto data = new Buzzer(static_cast<uint8_t>(duration));
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+    void Transbot::set_beep(int duration)
+    {
+        Package package;
+        if (!encode_beep(duration, package))
+        {
+            return;
+        }
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set beep successfully."
-                      << "Duration: " << duration;
+            TRANSBOT_LOG(INFO, "Set beep successfully. Duration: {}", duration);
         }
         else
         {
-            LOG(ERROR) << "Set beep failed."
-                       << "Duration: " << duration;
+            TRANSBOT_LOG(ERROR, "Set beep failed. Duration: {}", duration);
         }
+    }
 
-        delete data;
+    bool Transbot::encode_light(int lightness, Package &package)
+    {
+        if (lightness < 0 || lightness > 100)
+        {
+            TRANSBOT_LOG(ERROR, "Lightness out of range: {}", lightness);
+            return false;
+        }
+        package = encode(LED_Light(static_cast<uint8_t>(lightness)));
+        return true;
     }
 
     void Transbot::set_light(int lightness)
     {
-        if (lightness < 0 || lightness > 100)
+        Package package;
+        if (!encode_light(lightness, package))
         {
-            LOG(ERROR) << "Lightness out of range: " << lightness;
             return;
         }
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_LIGHT);
-
-        auto data = new LED_Light(static_cast<uint8_t>(lightness));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set light successfully."
-                      << "Lightness: " << lightness;
+            TRANSBOT_LOG(INFO, "Set light successfully. Lightness: {}", lightness);
         }
         else
         {
-            LOG(ERROR) << "Set light failed."
-                       << "Lightness: " << lightness;
+            TRANSBOT_LOG(ERROR, "Set light failed. Lightness: {}", lightness);
         }
-
-        delete data;
     }
 
     void Transbot::enable_gyro_assist(bool enable)
     {
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_GYRO_ENABLE);
-        auto data = new Gyro_Direction(static_cast<uint8_t>(enable ? transbot_sdk::TRANSBOT_ENABLE::ENABLE
-                                                                   : transbot_sdk::TRANSBOT_ENABLE::DISABLE));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        Package package = encode(Gyro_Direction(static_cast<uint8_t>(enable ? transbot_sdk::TRANSBOT_ENABLE::ENABLE
+                                                                            : transbot_sdk::TRANSBOT_ENABLE::DISABLE)));
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set gyro assist successfully."
-                      << "Enable: " << enable;
+            TRANSBOT_LOG(INFO, "Set gyro assist successfully. Enable: {}", enable);
         }
         else
         {
-            LOG(ERROR) << "Set gyro assist failed."
-                       << "Enable: " << enable;
+            TRANSBOT_LOG(ERROR, "Set gyro assist failed. Enable: {}", enable);
         }
-
-        delete data;
     }
 
     void Transbot::move_straight(int speed)
     {
         if (speed < -45 || speed > 45)
         {
-            LOG(ERROR) << "Speed out of range: " << speed;
+            TRANSBOT_LOG(ERROR, "Speed out of range: {}", speed);
             return;
         }
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_MOTOR_FORWARD);
-
-        auto data = new Forward(static_cast<int8_t>(speed));
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        Package package = encode(Forward(static_cast<int8_t>(speed)));
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Move straight successfully."
-                      << "Speed: " << speed;
+            TRANSBOT_LOG(INFO, "Move straight successfully. Speed: {}", speed);
         }
         else
         {
-            LOG(ERROR) << "Move straight failed."
-                       << "Speed: " << speed;
+            TRANSBOT_LOG(ERROR, "Move straight failed. Speed: {}", speed);
         }
-
-        delete data;
     }
 
     void Transbot::enable_servo_torque(bool enable)
     {
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_ARM_SERVO_TORQUE);
-        auto data = new Enable_Servo_Torque(static_cast<uint8_t>(enable ? transbot_sdk::TRANSBOT_ENABLE::ENABLE
-                                                                        : transbot_sdk::TRANSBOT_ENABLE::DISABLE));
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        Package package = encode(Enable_Servo_Torque(static_cast<uint8_t>(enable ? transbot_sdk::TRANSBOT_ENABLE::ENABLE
+                                                                                 : transbot_sdk::TRANSBOT_ENABLE::DISABLE)));
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set servo torque successfully."
-                      << "Enable: " << enable;
+            TRANSBOT_LOG(INFO, "Set servo torque successfully. Enable: {}", enable);
         }
         else
         {
-            LOG(ERROR) << "Set servo torque failed."
-                       << "Enable: " << enable;
+            TRANSBOT_LOG(ERROR, "Set servo torque failed. Enable: {}", enable);
         }
-
-        delete data;
     }
 
-    void Transbot::set_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed)
+    bool Transbot::encode_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed, Package &package)
     {
 
         switch (servoId)
@@ -299,53 +290,59 @@ namespace transbot_sdk
         case TRANSBOT_ARM_SERVO_ID::JOINT1:
             if (angle < 0 || angle > 225)
             {
-                LOG(ERROR) << "Angle out of range: " << angle;
-                return;
+                TRANSBOT_LOG(ERROR, "Angle out of range: {}", angle);
+                return false;
             }
             break;
         case TRANSBOT_ARM_SERVO_ID::JOINT2:
             if (angle < 30 || angle > 270)
             {
-                LOG(ERROR) << "Angle out of range: " << angle;
-                return;
+                TRANSBOT_LOG(ERROR, "Angle out of range: {}", angle);
+                return false;
             }
             break;
         case TRANSBOT_ARM_SERVO_ID::JOINT3:
             if (angle < 30 || angle > 180)
             {
-                LOG(ERROR) << "Angle out of range: " << angle;
-                return;
+                TRANSBOT_LOG(ERROR, "Angle out of range: {}", angle);
+                return false;
             }
             break;
         default:
-            LOG(ERROR) << "Servo id out of range: " << servoId;
-            return;
+            TRANSBOT_LOG(ERROR, "Servo id out of range: {}", servoId);
+            return false;
         }
         if (speed < 0)
         {
-            LOG(ERROR) << "Speed out of range: " << speed;
-            return;
+            TRANSBOT_LOG(ERROR, "Speed out of range: {}", speed);
+            return false;
         }
 
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_ARM_SERVO);
-
-        auto data = new Servo_Control(static_cast<uint8_t>(servoId),
-                                      static_cast<uint16_t>(angle_to_pwm(angle, servoId)),
-                                      static_cast<uint8_t>(speed));
+        package = encode(Servo_Control(static_cast<uint8_t>(servoId),
+                                       static_cast<uint16_t>(angle_to_pwm(angle, servoId)),
+                                       static_cast<uint16_t>(speed)));
+        return true;
+    }
 
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+    void Transbot::set_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed)
+    {
+        Package package;
+        if (!encode_single_arm_servo_angle(servoId, angle, speed, package))
+        {
+            return;
+        }
+        // The trajectory would move the arm away again
+        if (arm_trajectory.is_active())
+        {
+            arm_trajectory.stop();
+        }
         if (this->protocol.send(package))
         {
-            LOG(INFO) << "Set single arm servo angle successfully."
-                      << "Servo id: " << servoId
-                      << "Angle: " << angle;
+            TRANSBOT_LOG(INFO, "Set single arm servo angle successfully. Servo id: {}, Angle: {}", servoId, angle);
         }
         else
         {
-            LOG(ERROR) << "Set single arm servo angle failed."
-                       << "Servo id: " << servoId
-                       << "Angle: " << angle;
+            TRANSBOT_LOG(ERROR, "Set single arm servo angle failed. Servo id: {}, Angle: {}", servoId, angle);
         }
     }
 
@@ -360,264 +357,565 @@ namespace transbot_sdk
         case TRANSBOT_ARM_SERVO_ID::JOINT3:
             return (3100 - 900) * (angle + angle_offset[2]) / 180 + 900;
         default:
-            LOG(ERROR) << "Servo id out of range: " << servoId;
+            TRANSBOT_LOG(ERROR, "Servo id out of range: {}", servoId);
             return 100;
         }
     }
 
-    void Transbot::set_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed)
+    uint16_t Transbot::angle_to_pwm(double angle, TRANSBOT_ARM_SERVO_ID servoId)
+    {
+        double pwm;
+        switch (servoId)
+        {
+        case TRANSBOT_ARM_SERVO_ID::JOINT1:
+            pwm = (3100 - 900) * (angle - angle_offset[0] - 180) / (-180) + 900;
+            break;
+        case TRANSBOT_ARM_SERVO_ID::JOINT2:
+            pwm = (3100 - 900) * (angle - angle_offset[1] - 90 - 180) / (-180) + 900;
+            break;
+        case TRANSBOT_ARM_SERVO_ID::JOINT3:
+            pwm = (3100 - 900) * (angle + angle_offset[2]) / 180 + 900;
+            break;
+        default:
+            TRANSBOT_LOG(ERROR, "Servo id out of range: {}", servoId);
+            return 100;
+        }
+        return static_cast<uint16_t>(pwm + 0.5);
+    }
+
+    bool Transbot::encode_arm_joint_position(const double *angles, Package &package)
+    {
+        package = encode(Control_Arm_Joint_Position(angle_to_pwm(angles[0], TRANSBOT_ARM_SERVO_ID::JOINT1),
+                                                    angle_to_pwm(angles[1], TRANSBOT_ARM_SERVO_ID::JOINT2),
+                                                    angle_to_pwm(angles[2], TRANSBOT_ARM_SERVO_ID::JOINT3)));
+        return true;
+    }
+
+    bool Transbot::encode_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed, Package &package)
     {
         if (speed < 0)
         {
-            LOG(ERROR) << "Speed out of range: " << speed;
-            return;
+            TRANSBOT_LOG(ERROR, "Speed out of range: {}", speed);
+            return false;
         }
         if (joint1 < 0 || joint1 > 225)
         {
-            LOG(ERROR) << "Joint1 angle out of range: " << joint1;
-            return;
+            TRANSBOT_LOG(ERROR, "Joint1 angle out of range: {}", joint1);
+            return false;
         }
 
         if (joint2 < 30 || joint2 > 270)
         {
-            LOG(ERROR) << "Joint2 angle out of range: " << joint2;
-            return;
+            TRANSBOT_LOG(ERROR, "Joint2 angle out of range: {}", joint2);
+            return false;
         }
 
         if (joint3 < 30 || joint3 > 180)
         {
-            LOG(ERROR) << "Joint3 angle out of range: " << joint3;
-            return;
+            TRANSBOT_LOG(ERROR, "Joint3 angle out of range: {}", joint3);
+            return false;
         }
 
-        auto package =
-            std::make_shared<Package>(SEND_FUNCTION::SET_ARM_MOTION);
-        auto data = new Control_Arm_Joint_Position(static_cast<uint16_t>(angle_to_pwm(joint1, TRANSBOT_ARM_SERVO_ID::JOINT1)),
-                                                   static_cast<uint16_t>(angle_to_pwm(joint2, TRANSBOT_ARM_SERVO_ID::JOINT2)),
-                                                   static_cast<uint16_t>(angle_to_pwm(joint3, TRANSBOT_ARM_SERVO_ID::JOINT3)),
-                                                   static_cast<uint8_t>(speed));
-
-        package->set_data(reinterpret_cast<uint8_t *>(data));
+        package = encode(Control_Arm_Joint_Position(static_cast<uint16_t>(angle_to_pwm(joint1, TRANSBOT_ARM_SERVO_ID::JOINT1)),
+                                                    static_cast<uint16_t>(angle_to_pwm(joint2, TRANSBOT_ARM_SERVO_ID::JOINT2)),
+                                                    static_cast<uint16_t>(angle_to_pwm(joint3, TRANSBOT_ARM_SERVO_ID::JOINT3))));
+        return true;
+    }
 
+    void Transbot::set_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed)
+    {
+        Package package;
+        if (!encode_all_arm_servo_angle(joint1, joint2, joint3, speed, package))
+        {
+            return;
+        }
+        // The trajectory would move the arm away again
+        if (arm_trajectory.is_active())
+        {
+            arm_trajectory.stop();
+        }
         if (protocol.send(package))
         {
-            LOG(INFO) << "Set all arm servo angle successfully."
-                      << "Joint1: " << joint1 << "\n"
-                      << "Joint2: " << joint2 << "\n"
-                      << "Joint3: " << joint3 << "\n";
+            TRANSBOT_LOG(INFO, "Set all arm servo angle successfully. Joint1: {}, Joint2: {}, Joint3: {}",
+                         joint1, joint2, joint3);
         }
         else
         {
-            LOG(ERROR) << "Set all arm servo angle failed."
-                       << "Joint1: " << joint1 << "\n"
-                       << "Joint2: " << joint2 << "\n"
-                       << "Joint3: " << joint3 << "\n";
+            TRANSBOT_LOG(ERROR, "Set all arm servo angle failed. Joint1: {}, Joint2: {}, Joint3: {}",
+                         joint1, joint2, joint3);
         }
+    }
 
-        delete data;
+    bool Transbot::execute_arm_trajectory(const std::vector<Arm_Waypoint> &waypoints,
+                                          TRANSBOT_ARM_INTERPOLATION interpolation)
+    {
+        if (!arm_trajectory.execute(waypoints, interpolation))
+        {
+            TRANSBOT_LOG(ERROR, "Execute arm trajectory failed. Waypoints: {}", waypoints.size());
+            return false;
+        }
+        TRANSBOT_LOG(INFO, "Execute arm trajectory successfully. Waypoints: {}, Duration: {}",
+                     waypoints.size(), waypoints.back().time);
+        return true;
     }
 
-    std::string Transbot::get_firmware_version()
+    void Transbot::stop_arm_trajectory()
     {
-        auto package = std::make_shared<Package>(SEND_FUNCTION::SEND_REQUEST);
-        auto data = new Request_Firmware_Version;
-        package->set_data(reinterpret_cast<uint8_t *>(data));
-        if (protocol.send(package))
+        arm_trajectory.stop();
+    }
+
+    bool Transbot::is_arm_trajectory_active() const
+    {
+        return arm_trajectory.is_active();
+    }
+
+    bool Transbot::set_arm_trajectory_rate(double rate)
+    {
+        return arm_trajectory.set_rate(rate);
+    }
+
+    bool Transbot::start_control_loop(const ControlLoopOptions &options,
+                                      std::function<void(const ControlTick &)> callback)
+    {
+        return control_loop.start(options, std::move(callback));
+    }
+
+    void Transbot::stop_control_loop()
+    {
+        control_loop.stop();
+    }
+
+    ControlLoopStats Transbot::control_loop_stats() const
+    {
+        return control_loop.get_stats();
+    }
+
+    void Transbot::set_auto_report(bool enable)
+    {
+        Package package = encode(Auto_Msg_Sending(static_cast<uint8_t>(enable ? transbot_sdk::TRANSBOT_ENABLE::ENABLE
+                                                                              : transbot_sdk::TRANSBOT_ENABLE::DISABLE)));
+        if (this->protocol.send(package))
         {
-            LOG(INFO) << "Get firmware version successfully.";
+            TRANSBOT_LOG(INFO, "Set auto report successfully. Enable: {}", enable);
         }
         else
         {
-            LOG(ERROR) << "Get firmware version failed.";
-            return "Failed";
+            TRANSBOT_LOG(ERROR, "Set auto report failed. Enable: {}", enable);
         }
+    }
 
-        delete data;
-        // Take response
-        auto response = protocol.take(FIRMWARE_VERSION);
-        if (response == nullptr)
+    void Transbot::on_motion_info(std::function<void(const Motion_Info &)> callback)
+    {
+        if (!callback)
+        {
+            subscribe<Movement_Status_Response>(nullptr);
+            return;
+        }
+        subscribe<Movement_Status_Response>([callback](const Movement_Status_Response &status)
         {
-            LOG(ERROR) << "Get firmware version failed.";
+            callback(to_motion_info(status));
+        });
+    }
+
+    void Transbot::set_request_timeout(std::chrono::milliseconds timeout)
+    {
+        request_timeout = timeout;
+    }
+
+    std::string Transbot::get_firmware_version()
+    {
+        Package package = encode(Read_Data_Request(FIRMWARE_VERSION));
+        // Wait for the response, which completes as soon as it is parsed
+        auto response = protocol.request(package, request_timeout).get();
+        auto firmware_version = decode<Firmware_Version_Response>(response);
+        if (firmware_version == nullptr)
+        {
+            TRANSBOT_LOG(ERROR, "Get firmware version failed.");
             return "";
         }
-        auto major = response->get_data_ptr()[4];
-        auto minor = response->get_data_ptr()[5];
-        std::string version = std::to_string(major) + "." + std::to_string(minor);
-        LOG(INFO) << "Firmware version: " << version;
+        std::string version = std::to_string(firmware_version->major) + "." + std::to_string(firmware_version->minor);
+        TRANSBOT_LOG(INFO, "Firmware version: {}", version);
         return version;
     }
 
     int Transbot::get_yaw_angle()
     {
-        auto package = std::make_shared<Package>(SEND_FUNCTION::SEND_REQUEST);
-        auto data = new Request_Yaw;
-        package->set_data(reinterpret_cast<uint8_t *>(data));
-        if (protocol.send(package))
+        Package package = encode(Read_Data_Request(YAW_ANGLE));
+        // Wait for the response, which completes as soon as it is parsed
+        auto response = protocol.request(package, request_timeout).get();
+        auto yaw = decode<Yaw_Response>(response);
+        if (yaw == nullptr)
         {
-            LOG(INFO) << "Get yaw angle successfully.";
-        }
-        else
-        {
-            LOG(ERROR) << "Get yaw angle failed.";
+            TRANSBOT_LOG(ERROR, "Get yaw angle failed.");
+            return -1;
         }
+        int16_t angle = yaw->yaw;
+        TRANSBOT_LOG(INFO, "Yaw angle: {}", angle);
+        return static_cast<int>(angle);
+    }
 
-        delete data;
-        // Take response
-        auto response = protocol.take(YAW_ANGLE);
-        if (response == nullptr)
+    int Transbot::get_servo_position(int channel)
+    {
+        Package package = encode(Read_Data_Request(ARM_SERVO_POSITION, static_cast<uint8_t>(channel)));
+        // Wait for the response, which completes as soon as it is parsed
+        auto response = protocol.request(package, request_timeout).get();
+        auto servo_position = decode<Servo_Position_Response>(response);
+        if (servo_position == nullptr)
         {
-            LOG(ERROR) << "Get yaw angle failed.";
+            TRANSBOT_LOG(ERROR, "Get servo position failed.");
             return -1;
         }
-        auto angle = reinterpret_cast<uint16_t *>(response->get_data_ptr()[4]);
-        LOG(INFO) << "Yaw angle: " << angle;
-        return static_cast<int>(*angle);
+        uint16_t position = servo_position->position;
+        TRANSBOT_LOG(INFO, "Servo id: {}; Position: {}", (int)servo_position->servo_id, position);
+        return static_cast<int>(position);
     }
 
-    int Transbot::get_servo_position(int channel)
+    Motion_Info Transbot::get_motion_info()
     {
-        auto package = std::make_shared<Package>(SEND_FUNCTION::SEND_REQUEST);
-        auto data = new Request_Servo_Position(static_cast<uint8_t>(channel));
-        package->set_data(reinterpret_cast<uint8_t *>(data));
-        if (protocol.send(package))
+        auto motion_info = latest_motion_info();
+        if (motion_info.sequence == 0)
         {
-            LOG(INFO) << "Get servo position successfully.";
+            TRANSBOT_LOG(ERROR, "Get motion info failed.");
         }
-        else
+        return motion_info.value;
+    }
+
+    PID_Parameters Transbot::get_pid_parameters()
+    {
+        Package package = encode(Read_Data_Request(PID_PARAM));
+        // Wait for the response, which completes as soon as it is parsed
+        auto response = protocol.request(package, request_timeout).get();
+        auto pid = decode<PID_Parameters_Response>(response);
+        if (pid == nullptr)
         {
-            LOG(ERROR) << "Get servo position failed.";
+            TRANSBOT_LOG(ERROR, "Get PID parameters failed.");
+            return PID_Parameters(0.0, 0.0, 0.0);
         }
+        PID_Parameters pid_parameters = to_pid_parameters(*pid);
+        TRANSBOT_LOG(INFO, "P: {}; I: {}; D: {}", pid_parameters.P, pid_parameters.I, pid_parameters.D);
+        return pid_parameters;
+    }
+
+    PID_Parameters Transbot::to_pid_parameters(const PID_Parameters_Response &pid)
+    {
+        // Divide by 1000 to get the real value
+        double p_real = static_cast<uint16_t>(pid.P) / 1000.0;
+        double i_real = static_cast<uint16_t>(pid.I) / 1000.0;
+        double d_real = static_cast<uint16_t>(pid.D) / 1000.0;
+        return PID_Parameters(p_real, i_real, d_real);
+    }
 
-        delete data;
-        // Take response
-        auto response = protocol.take(ARM_SERVO_POSITION);
-        if (response == nullptr)
+    bool Transbot::is_gyro_assist_enabled()
+    {
+        Package package = encode(Read_Data_Request(GYRO_ASSIST_ENABLED));
+        // Wait for the response, which completes as soon as it is parsed
+        auto response = protocol.request(package, request_timeout).get();
+        auto gyro_assist = decode<Gyro_Assist_Response>(response);
+        if (gyro_assist == nullptr)
         {
-            LOG(ERROR) << "Get servo position failed.";
-            return -1;
+            TRANSBOT_LOG(ERROR, "Get gyro assist status failed.");
+            return false;
         }
-        uint8_t* data_ptr = response->get_data_ptr();
-        uint8_t servo_id = data_ptr[4];
-        uint8_t low = data_ptr[5], high = data_ptr[6];
-        uint16_t position = (high << 8) | low;
-        LOG(INFO) << "Servo id: " << (int)servo_id << "; Position: " << position;
-        return static_cast<int>(position);
+        TRANSBOT_LOG(INFO, "Gyro assist status: {}", (int)gyro_assist->gyro_assist);
+        return gyro_assist->gyro_assist == ENABLE;
     }
 
-    Motion_Info Transbot::get_motion_info()
+    Telemetry<Motion_Info> Transbot::latest_motion_info() const
+    {
+        return latest<Movement_Status_Response>(Motion_Info(0, 0, 0, 0, 0, 0, 0, 0, 0), &to_motion_info);
+    }
+
+    bool Transbot::get_motion_info_at(std::chrono::steady_clock::time_point time, Motion_Info &motion_info) const
+    {
+        return protocol.motion_at(time, motion_info);
+    }
+
+    Telemetry<int> Transbot::latest_yaw_angle() const
     {
-        std::shared_ptr<transbot_sdk::Package> response = protocol.take(MOTION_STATUS);
-        if (response == nullptr)
+        return latest<Yaw_Response>(0, [](const Yaw_Response &yaw)
         {
-            LOG(ERROR) << "Get motion info failed.";
-            return Motion_Info(0,0,0,0,0,0,0,0,0);
+            return static_cast<int>(static_cast<int16_t>(yaw.yaw));
+        });
+    }
+
+    Telemetry<int> Transbot::latest_servo_position(int channel) const
+    {
+        return latest<Servo_Position_Response>(0, [](const Servo_Position_Response &servo_position)
+        {
+            return static_cast<int>(static_cast<uint16_t>(servo_position.position));
+        }, channel);
+    }
+
+    Telemetry<PID_Parameters> Transbot::latest_pid_parameters() const
+    {
+        return latest<PID_Parameters_Response>(PID_Parameters(0.0, 0.0, 0.0), &to_pid_parameters);
+    }
+
+    Telemetry<bool> Transbot::latest_gyro_assist() const
+    {
+        return latest<Gyro_Assist_Response>(false, [](const Gyro_Assist_Response &gyro_assist)
+        {
+            return gyro_assist.gyro_assist == ENABLE;
+        });
+    }
+
+    ProtocolStats Transbot::stats() const
+    {
+        return protocol.get_stats();
+    }
+
+    CommandBatch Transbot::create_batch()
+    {
+        return CommandBatch(*this);
+    }
+
+    bool Transbot::submit(const CommandBatch &batch)
+    {
+        if (batch.packages.empty())
+        {
+            return true;
+        }
+        for (const auto &package: batch.packages)
+        {
+            uint8_t function = package.get_function().function;
+            if (function == SET_LED_STRIP || function == SET_STRIP_EFFECT)
+            {
+                framebuffer.invalidate();
+                break;
+            }
         }
-        int8_t *data_ptr = reinterpret_cast<int8_t *>(response->get_data_ptr());
+        if (this->protocol.send_batch(batch.packages.data(), batch.packages.size()))
+        {
+            TRANSBOT_LOG(INFO, "Submit command batch successfully. Commands: {}", batch.packages.size());
+            return true;
+        }
+        TRANSBOT_LOG(ERROR, "Submit command batch failed. Commands: {}", batch.packages.size());
+        return false;
+    }
 
-        int8_t linear_velocity_data = data_ptr[4];
+    LedFramebuffer &Transbot::led_framebuffer()
+    {
+        return framebuffer;
+    }
 
-        uint8_t low = data_ptr[5], high = data_ptr[6];
-        int16_t angular_velocity_data = (high << 8) | low;
+    CommandBatch::CommandBatch(Transbot &transbot) : transbot(transbot)
+    {
+    }
 
-        low = data_ptr[7]; high = data_ptr[8];
-        int16_t acc_x_data = (high << 8) | low;
+    bool CommandBatch::set_chassis_motion(double linear_velocity, double angular_velocity)
+    {
+        Package package;
+        if (!transbot.encode_chassis_motion(linear_velocity, angular_velocity, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
+
+    bool CommandBatch::set_camara_angle(TRANSBOT_CAMARA_CHANNEL channel, int angle)
+    {
+        Package package;
+        if (!transbot.encode_camara_angle(channel, angle, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        low = data_ptr[9]; high = data_ptr[10];
-        int16_t acc_y_data = (high << 8) | low;
+    bool CommandBatch::set_led_strip(int id, int r, int g, int b)
+    {
+        Package package;
+        if (!transbot.encode_led_strip(id, r, g, b, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        low = data_ptr[11]; high = data_ptr[12];
-        int16_t acc_z_data = (high << 8) | low;
+    bool CommandBatch::set_strip_effect(int effect, int velocity, int param)
+    {
+        Package package;
+        if (!transbot.encode_strip_effect(effect, velocity, param, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        low = data_ptr[13]; high = data_ptr[14];
-        int16_t gyro_x_data = (high << 8) | low;
+    bool CommandBatch::set_beep(int duration)
+    {
+        Package package;
+        if (!transbot.encode_beep(duration, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        low = data_ptr[15]; high = data_ptr[16];
-        int16_t gyro_y_data = (high << 8) | low;
+    bool CommandBatch::set_light(int lightness)
+    {
+        Package package;
+        if (!transbot.encode_light(lightness, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        low = data_ptr[17]; high = data_ptr[18];
-        int16_t gyro_z_data = (high << 8) | low;
+    bool CommandBatch::set_single_arm_servo_angle(TRANSBOT_ARM_SERVO_ID servoId, int angle, int speed)
+    {
+        Package package;
+        if (!transbot.encode_single_arm_servo_angle(servoId, angle, speed, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        uint8_t battery_voltage = reinterpret_cast<uint8_t *>(data_ptr + 19)[0];
+    bool CommandBatch::set_all_arm_servo_angle(int joint1, int joint2, int joint3, int speed)
+    {
+        Package package;
+        if (!transbot.encode_all_arm_servo_angle(joint1, joint2, joint3, speed, package))
+        {
+            return false;
+        }
+        packages.push_back(package);
+        return true;
+    }
 
-        double linear_velocit = linear_velocity_data/100.0;
-        double angular_velocity = angular_velocity_data/100.0;
+    size_t CommandBatch::size() const
+    {
+        return packages.size();
+    }
 
-        double accel_ratio = 16384.0;
-        int acc_x = acc_x_data/accel_ratio;
-        int acc_y = acc_y_data/accel_ratio;
-        int acc_z = acc_z_data/accel_ratio;
+    void CommandBatch::clear()
+    {
+        packages.clear();
+    }
 
-        double gyro_ratio = 1 / 65.5 / (180 / 3.1415926);
-        // double gyro_ratio = 1 / 16.4 / (180 / 3.1415926) // ±2
-        // double gyro_ratio = 1 / 32.8 / (180 / 3.1415926)
+    LedFramebuffer::LedFramebuffer(Transbot &transbot) : transbot(transbot), generation(1), shown_generation(0)
+    {
+        packages.reserve(LED_COUNT + 1);
+    }
 
-        double gyro_x = gyro_x_data * gyro_ratio;
-        double gyro_y = gyro_y_data * gyro_ratio;
-        double gyro_z = gyro_z_data * gyro_ratio;
-        
+    bool LedFramebuffer::set_pixel(int id, RGB_Color color)
+    {
+        if (id < 0 || id >= LED_COUNT)
+        {
+            TRANSBOT_LOG(ERROR, "Led id out of range: {}", id);
+            return false;
+        }
+        pixels[id] = color;
+        return true;
+    }
 
-        return Motion_Info(linear_velocit, angular_velocity, acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z, battery_voltage);
+    RGB_Color LedFramebuffer::get_pixel(int id) const
+    {
+        if (id < 0 || id >= LED_COUNT)
+        {
+            return RGB_Color();
+        }
+        return pixels[id];
     }
 
-    PID_Parameters Transbot::get_pid_parameters()
+    void LedFramebuffer::fill(RGB_Color color)
     {
-        auto package = std::make_shared<Package>(SEND_FUNCTION::SEND_REQUEST);
-        auto data = new Request_PID_Parameters;
-        package->set_data(reinterpret_cast<uint8_t *>(data));
-        if (protocol.send(package))
+        for (auto &pixel: pixels)
         {
-            LOG(INFO) << "Get PID parameters successfully.";
+            pixel = color;
         }
-        else
+    }
+
+    void LedFramebuffer::invalidate()
+    {
+        generation.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t LedFramebuffer::plan(bool is_known, bool &is_filled, RGB_Color &fill) const
+    {
+        size_t changed = 0;
+        for (int i = 0; i < LED_COUNT; i++)
         {
-            LOG(ERROR) << "Get PID parameters failed.";
+            if (!is_known || pixels[i] != shown[i])
+            {
+                changed++;
+            }
         }
 
-        delete data;
-        // Take response
-        auto response = protocol.take(PID_PARAM);
-        if (response == nullptr)
+        // A fill costs one frame plus one for every led of another color, so fill with the most common color
+        size_t most_common = 0;
+        for (int i = 0; i < LED_COUNT; i++)
         {
-            LOG(ERROR) << "Get PID parameters failed.";
-            return PID_Parameters(0.0, 0.0, 0.0);
+            size_t same = 0;
+            for (int j = 0; j < LED_COUNT; j++)
+            {
+                if (pixels[j] == pixels[i])
+                {
+                    same++;
+                }
+            }
+            if (same > most_common)
+            {
+                most_common = same;
+                fill = pixels[i];
+            }
         }
-        auto P = reinterpret_cast<int16_t *>(response->get_data_ptr()[4]);
-        auto I = reinterpret_cast<int16_t *>(response->get_data_ptr()[6]);
-        auto D = reinterpret_cast<int16_t *>(response->get_data_ptr()[8]);
-        // Divide by 1000 to get the real value
-        double p_real = static_cast<double>(*P) / 1000.0;
-        double i_real = static_cast<double>(*I) / 1000.0;
-        double d_real = static_cast<double>(*D) / 1000.0;
-        LOG(INFO) << "P: " << p_real << "; I: " << i_real << "; D: " << d_real;
+        size_t filled = 1 + LED_COUNT - most_common;
+        is_filled = filled < changed;
+        return is_filled ? filled : changed;
+    }
 
-        return PID_Parameters(p_real, i_real, d_real);
+    size_t LedFramebuffer::pending_frames() const
+    {
+        bool is_filled;
+        RGB_Color fill;
+        return plan(generation.load(std::memory_order_relaxed) == shown_generation, is_filled, fill);
     }
 
-    bool Transbot::is_gyro_assist_enabled()
+    bool LedFramebuffer::present()
     {
-        auto package = std::make_shared<Package>(SEND_FUNCTION::SEND_REQUEST);
-        auto data = new Request_Gyro_Assist;
-        package->set_data(reinterpret_cast<uint8_t *>(data));
-        if (protocol.send(package))
+        // Read before the frames are built, so that an invalidate() until they are queued is not lost
+        uint64_t current = generation.load(std::memory_order_relaxed);
+        bool is_known = current == shown_generation;
+        bool is_filled;
+        RGB_Color fill;
+        if (plan(is_known, is_filled, fill) == 0)
         {
-            LOG(INFO) << "Get gyro assist status successfully.";
+            return true;
         }
-        else
+
+        packages.clear();
+        if (is_filled)
         {
-            LOG(ERROR) << "Get gyro assist status failed.";
+            packages.push_back(encode(RGB_Control(0xff, fill.r, fill.g, fill.b)));
+        }
+        for (int i = 0; i < LED_COUNT; i++)
+        {
+            bool is_changed = is_filled ? pixels[i] != fill : !is_known || pixels[i] != shown[i];
+            if (is_changed)
+            {
+                packages.push_back(encode(RGB_Control(static_cast<uint8_t>(i), pixels[i].r, pixels[i].g, pixels[i].b)));
+            }
         }
 
-        delete data;
-        // Take response
-        auto response = protocol.take(GYRO_ASSIST_ENABLED);
-        if (response == nullptr)
+        if (!transbot.protocol.send_batch(packages.data(), packages.size()))
         {
-            LOG(ERROR) << "Get gyro assist status failed.";
+            TRANSBOT_LOG(ERROR, "Present led framebuffer failed. Frames: {}", packages.size());
             return false;
         }
-        auto status = response->get_data_ptr()[4];
-        LOG(INFO) << "Gyro assist status: " << status;
-        return status == ENABLE;
+        for (int i = 0; i < LED_COUNT; i++)
+        {
+            shown[i] = pixels[i];
+        }
+        shown_generation = current;
+        TRANSBOT_LOG(INFO, "Present led framebuffer successfully. Frames: {}", packages.size());
+        return true;
     }
-
 }